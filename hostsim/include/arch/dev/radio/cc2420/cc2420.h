@@ -0,0 +1,8 @@
+#ifndef CC2420_H_
+#define CC2420_H_
+
+#include "dev/radio.h"
+
+extern const struct radio_driver cc2420_driver;
+
+#endif /* CC2420_H_ */
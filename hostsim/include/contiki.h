@@ -0,0 +1,19 @@
+/*
+ * Stand-in for Contiki-NG's contiki.h used by the host harness. It pulls
+ * in the same kernel APIs the firmware relies on.
+ */
+#ifndef CONTIKI_H_
+#define CONTIKI_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sys/process.h"
+#include "sys/autostart.h"
+#include "sys/timer.h"
+#include "sys/etimer.h"
+#include "sys/rtimer.h"
+#include "sys/pt.h"
+#include "sys/clock.h"
+
+#endif /* CONTIKI_H_ */
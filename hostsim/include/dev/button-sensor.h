@@ -0,0 +1,6 @@
+#ifndef BUTTON_SENSOR_H_
+#define BUTTON_SENSOR_H_
+
+/* No button on host motes; the header only needs to exist. */
+
+#endif /* BUTTON_SENSOR_H_ */
@@ -0,0 +1,58 @@
+/*
+ * Radio driver interface for the host harness, a subset of Contiki-NG's
+ * os/dev/radio.h.
+ */
+#ifndef RADIO_H_
+#define RADIO_H_
+
+#include <stddef.h>
+
+typedef int radio_value_t;
+typedef unsigned radio_param_t;
+
+enum radio_param_e {
+  RADIO_PARAM_POWER_MODE,
+  RADIO_PARAM_CHANNEL,
+  RADIO_PARAM_PAN_ID,
+  RADIO_PARAM_16BIT_ADDR,
+  RADIO_PARAM_RX_MODE,
+  RADIO_PARAM_TX_MODE,
+  RADIO_PARAM_TXPOWER,
+  RADIO_PARAM_CCA_THRESHOLD,
+  RADIO_PARAM_RSSI,
+  RADIO_PARAM_LAST_RSSI,
+  RADIO_PARAM_LAST_LINK_QUALITY,
+};
+
+typedef enum radio_result_e {
+  RADIO_RESULT_OK,
+  RADIO_RESULT_NOT_SUPPORTED,
+  RADIO_RESULT_INVALID_VALUE,
+  RADIO_RESULT_ERROR
+} radio_result_t;
+
+enum {
+  RADIO_TX_OK,
+  RADIO_TX_ERR,
+  RADIO_TX_COLLISION,
+  RADIO_TX_NOACK,
+};
+
+struct radio_driver {
+  int (*init)(void);
+  int (*prepare)(const void *payload, unsigned short payload_len);
+  int (*transmit)(unsigned short transmit_len);
+  int (*send)(const void *payload, unsigned short payload_len);
+  int (*read)(void *buf, unsigned short buf_len);
+  int (*channel_clear)(void);
+  int (*receiving_packet)(void);
+  int (*pending_packet)(void);
+  int (*on)(void);
+  int (*off)(void);
+  radio_result_t (*get_value)(radio_param_t param, radio_value_t *value);
+  radio_result_t (*set_value)(radio_param_t param, radio_value_t value);
+  radio_result_t (*get_object)(radio_param_t param, void *dest, size_t size);
+  radio_result_t (*set_object)(radio_param_t param, const void *src, size_t size);
+};
+
+#endif /* RADIO_H_ */
@@ -0,0 +1,10 @@
+#ifndef RANDOM_H_
+#define RANDOM_H_
+
+/* Contiki-NG's pseudo-random generator, per mote, seeded at boot */
+#define RANDOM_RAND_MAX 65535U
+
+void random_init(unsigned short seed);
+unsigned short random_rand(void);
+
+#endif /* RANDOM_H_ */
@@ -0,0 +1,21 @@
+#ifndef LINKADDR_H_
+#define LINKADDR_H_
+
+#include <stdint.h>
+
+/* Z1 motes use 8-byte IEEE 802.15.4 addresses */
+#define LINKADDR_SIZE 8
+
+typedef union {
+  unsigned char u8[LINKADDR_SIZE];
+  uint16_t u16;
+} linkaddr_t;
+
+void linkaddr_copy(linkaddr_t *dest, const linkaddr_t *from);
+int linkaddr_cmp(const linkaddr_t *addr1, const linkaddr_t *addr2);
+void linkaddr_set_node_addr(linkaddr_t *addr);
+
+extern linkaddr_t linkaddr_node_addr;
+extern const linkaddr_t linkaddr_null;
+
+#endif /* LINKADDR_H_ */
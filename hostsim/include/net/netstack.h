@@ -0,0 +1,26 @@
+/*
+ * Network stack for the host harness: only the NullNet network layer is
+ * available, its output goes to the harness radio medium. The radio is
+ * the Z1's CC2420, for the values it reports.
+ */
+#ifndef NETSTACK_H_
+#define NETSTACK_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+#include "dev/radio.h"
+
+#define NETSTACK_NETWORK nullnet_driver
+#define NETSTACK_RADIO cc2420_driver
+
+struct network_driver {
+  char *name;
+  void (*init)(void);
+  void (*input)(void);
+  uint8_t (*output)(const linkaddr_t *localdest);
+};
+
+extern const struct network_driver nullnet_driver;
+extern const struct radio_driver NETSTACK_RADIO;
+
+#endif /* NETSTACK_H_ */
@@ -0,0 +1,61 @@
+/*
+ * Interface between the harness (hostsim) and a firmware image.
+ *
+ * Each firmware (border.c, coordinator.c, sensor.c) is linked together
+ * with the runtime in runtime/ into a shared object that exports a single
+ * `sim_fw` symbol. The harness keeps one copy of the shared object's
+ * writable segment per mote and swaps it in before calling any of the
+ * functions below, so every mote has its own Contiki kernel state and its
+ * own firmware globals.
+ *
+ * Times passed to the firmware are mote-local microseconds since boot.
+ */
+#ifndef SIM_API_H_
+#define SIM_API_H_
+
+#include <stdint.h>
+#include "net/linkaddr.h"
+
+#define SIM_API_VERSION 4
+
+/* Services the harness offers to the mote that is currently running */
+struct sim_host_api {
+  /* Queue a frame on the mote's MAC; dest NULL means broadcast */
+  void (*radio_send)(const void *data, uint16_t len, const linkaddr_t *dest);
+  /* Bytes written to the mote's serial port (printf) */
+  void (*serial_write)(const char *buf, int len);
+  /* Receiver on or off: frames sent to a mote that is off are lost, and
+     it misses the acks of its own unicast frames */
+  void (*radio_power)(int on);
+  /* 802.15.4 channel, 11 to 26: frames only reach and only disturb the
+     motes on the channel they were sent on */
+  void (*radio_channel)(int channel);
+};
+
+struct sim_fw_config {
+  uint16_t node_id;
+  uint32_t seed;
+  /* When >= 0, rand() always returns this value (known sensor readings) */
+  int fixed_rand;
+  /* Format LOG_* output; printf() always reaches the serial port */
+  int log_enabled;
+  const struct sim_host_api *host;
+};
+
+struct sim_fw_api {
+  uint32_t version;
+  void (*boot)(const struct sim_fw_config *config, uint64_t local_us);
+  /* Run expired timers and every pending process */
+  void (*run)(uint64_t local_us);
+  /* Hand a received frame to NullNet; rssi is reported as LAST_RSSI */
+  void (*input)(uint64_t local_us, const void *data, uint16_t len,
+                const linkaddr_t *src, const linkaddr_t *dest, int rssi);
+  /* Returns 1 and the local time of the next timer, 0 if none is armed */
+  int (*next_wakeup)(uint64_t *local_us);
+  /* Bytes received on the mote's serial port, to its uart0 input */
+  void (*serial_input)(uint64_t local_us, const char *buf, int len);
+};
+
+#define SIM_FW_SYMBOL "sim_fw"
+
+#endif /* SIM_API_H_ */
@@ -0,0 +1,24 @@
+/*
+ * Clock for the host harness. The Z1 port's clock_time_t is an unsigned
+ * long ticking at 128 Hz, and the firmware logs it with %lu, so the
+ * harness keeps both: 64 bits here rather than 32, which the firmware's
+ * 32-bit fields and differences of clock values do not notice before the
+ * clock wraps, after more than a year of simulated time.
+ */
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include <stdint.h>
+
+typedef unsigned long clock_time_t;
+
+#ifndef CLOCK_CONF_SECOND
+#define CLOCK_CONF_SECOND 128UL
+#endif
+#define CLOCK_SECOND CLOCK_CONF_SECOND
+
+void clock_init(void);
+clock_time_t clock_time(void);
+unsigned long clock_seconds(void);
+
+#endif /* CLOCK_H_ */
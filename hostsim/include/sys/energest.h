@@ -0,0 +1,42 @@
+/*
+ * Energest for host motes, same interface as Contiki-NG's sys/energest.h.
+ * Times are in microseconds of the mote's clock. The harness has no CPU
+ * model: each call into a process counts as a fixed active time, the rest
+ * is LPM. The radio listens while it is on, and transmits for the airtime
+ * of each frame it is handed (acks and retransmissions left out).
+ */
+#ifndef ENERGEST_H_
+#define ENERGEST_H_
+
+#include <stdint.h>
+
+#define ENERGEST_SECOND 1000000UL
+
+typedef enum energest_type {
+  ENERGEST_TYPE_CPU,
+  ENERGEST_TYPE_LPM,
+  ENERGEST_TYPE_DEEP_LPM,
+  ENERGEST_TYPE_TRANSMIT,
+  ENERGEST_TYPE_LISTEN,
+  ENERGEST_TYPE_MAX
+} energest_type_t;
+
+extern uint64_t energest_total_time[ENERGEST_TYPE_MAX];
+
+void energest_init(void);
+void energest_flush(void);
+
+static inline uint64_t
+energest_type_time(energest_type_t type)
+{
+  return energest_total_time[type];
+}
+static inline uint64_t
+energest_get_total_time(void)
+{
+  return energest_type_time(ENERGEST_TYPE_CPU) +
+         energest_type_time(ENERGEST_TYPE_LPM) +
+         energest_type_time(ENERGEST_TYPE_DEEP_LPM);
+}
+
+#endif /* ENERGEST_H_ */
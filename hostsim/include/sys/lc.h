@@ -0,0 +1,36 @@
+/*
+ * Local continuations for the host harness, using the GCC "labels as
+ * values" extension exactly like Contiki's lc-addrlabels.h.
+ */
+#ifndef LC_H_
+#define LC_H_
+
+typedef void *lc_t;
+
+#define LC_INIT(s) s = NULL
+
+#define LC_RESUME(s)                            \
+  do {                                          \
+    if(s != NULL) {                             \
+      goto *s;                                  \
+    }                                           \
+  } while(0)
+
+/* The address of a label outlives its statement expression, but GCC 12
+ * and later take it for the address of a local variable */
+#if __GNUC__ >= 12
+#define LC_SET(s)                                       \
+  do {                                                  \
+    _Pragma("GCC diagnostic push")                      \
+    _Pragma("GCC diagnostic ignored \"-Wdangling-pointer\"") \
+    ({ __label__ resume; resume: (s) = &&resume; });    \
+    _Pragma("GCC diagnostic pop")                       \
+  } while(0)
+#else
+#define LC_SET(s)                                       \
+  do { ({ __label__ resume; resume: (s) = &&resume; }); } while(0)
+#endif
+
+#define LC_END(s)
+
+#endif /* LC_H_ */
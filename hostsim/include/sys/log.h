@@ -0,0 +1,54 @@
+/*
+ * Logging for the host harness, with the macro names of Contiki-NG's
+ * sys/log.h. Formatting is skipped unless the harness enables node logs,
+ * which keeps large runs fast.
+ */
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <stdio.h>
+#include "net/linkaddr.h"
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERR  1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DBG  4
+
+extern int log_enabled;
+
+void log_lladdr(const linkaddr_t *lladdr);
+
+#define LOG(newline, level, levelstr, ...)                              \
+  do {                                                                  \
+    if(log_enabled && (level) <= (LOG_LEVEL)) {                         \
+      if(newline) {                                                     \
+        printf("[%-4s: %-10s] ", levelstr, LOG_MODULE);                 \
+      }                                                                 \
+      printf(__VA_ARGS__);                                              \
+    }                                                                   \
+  } while(0)
+
+#define LOG_LLADDR(level, lladdr)                                       \
+  do {                                                                  \
+    if(log_enabled && (level) <= (LOG_LEVEL)) {                         \
+      log_lladdr(lladdr);                                               \
+    }                                                                   \
+  } while(0)
+
+#define LOG_ERR(...)  LOG(1, LOG_LEVEL_ERR, "ERR", __VA_ARGS__)
+#define LOG_WARN(...) LOG(1, LOG_LEVEL_WARN, "WARN", __VA_ARGS__)
+#define LOG_INFO(...) LOG(1, LOG_LEVEL_INFO, "INFO", __VA_ARGS__)
+#define LOG_DBG(...)  LOG(1, LOG_LEVEL_DBG, "DBG", __VA_ARGS__)
+
+#define LOG_ERR_(...)  LOG(0, LOG_LEVEL_ERR, "ERR", __VA_ARGS__)
+#define LOG_WARN_(...) LOG(0, LOG_LEVEL_WARN, "WARN", __VA_ARGS__)
+#define LOG_INFO_(...) LOG(0, LOG_LEVEL_INFO, "INFO", __VA_ARGS__)
+#define LOG_DBG_(...)  LOG(0, LOG_LEVEL_DBG, "DBG", __VA_ARGS__)
+
+#define LOG_ERR_LLADDR(lladdr)  LOG_LLADDR(LOG_LEVEL_ERR, lladdr)
+#define LOG_WARN_LLADDR(lladdr) LOG_LLADDR(LOG_LEVEL_WARN, lladdr)
+#define LOG_INFO_LLADDR(lladdr) LOG_LLADDR(LOG_LEVEL_INFO, lladdr)
+#define LOG_DBG_LLADDR(lladdr)  LOG_LLADDR(LOG_LEVEL_DBG, lladdr)
+
+#endif /* LOG_H_ */
@@ -0,0 +1,63 @@
+/*
+ * Protothreads, same semantics as Contiki's sys/pt.h.
+ */
+#ifndef PT_H_
+#define PT_H_
+
+#include "sys/lc.h"
+
+struct pt {
+  lc_t lc;
+};
+
+#define PT_WAITING 0
+#define PT_YIELDED 1
+#define PT_EXITED  2
+#define PT_ENDED   3
+
+#define PT_INIT(pt) LC_INIT((pt)->lc)
+
+#define PT_THREAD(name_args) char name_args
+
+#define PT_BEGIN(pt) { char PT_YIELD_FLAG = 1; if(PT_YIELD_FLAG) {;} LC_RESUME((pt)->lc)
+
+#define PT_END(pt) LC_END((pt)->lc); PT_YIELD_FLAG = 0; \
+                   PT_INIT(pt); return PT_ENDED; }
+
+#define PT_WAIT_UNTIL(pt, condition)            \
+  do {                                          \
+    LC_SET((pt)->lc);                           \
+    if(!(condition)) {                          \
+      return PT_WAITING;                        \
+    }                                           \
+  } while(0)
+
+#define PT_WAIT_WHILE(pt, cond) PT_WAIT_UNTIL((pt), !(cond))
+
+#define PT_EXIT(pt)                             \
+  do {                                          \
+    PT_INIT(pt);                                \
+    return PT_EXITED;                           \
+  } while(0)
+
+#define PT_YIELD(pt)                            \
+  do {                                          \
+    PT_YIELD_FLAG = 0;                          \
+    LC_SET((pt)->lc);                           \
+    if(PT_YIELD_FLAG == 0) {                    \
+      return PT_YIELDED;                        \
+    }                                           \
+  } while(0)
+
+#define PT_YIELD_UNTIL(pt, cond)                \
+  do {                                          \
+    PT_YIELD_FLAG = 0;                          \
+    LC_SET((pt)->lc);                           \
+    if((PT_YIELD_FLAG == 0) || !(cond)) {       \
+      return PT_YIELDED;                        \
+    }                                           \
+  } while(0)
+
+#define PT_SCHEDULE(f) ((f) < PT_EXITED)
+
+#endif /* PT_H_ */
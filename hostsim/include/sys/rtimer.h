@@ -0,0 +1,54 @@
+/*
+ * Real-time timer for the host harness, with Contiki-NG's sys/rtimer.h
+ * API. The Z1 counts rtimer ticks at 32768 Hz on a 16-bit timer, from
+ * the same crystal and the same start as the clock: a clock tick every
+ * RTIMER_SECOND / CLOCK_SECOND rtimer ticks. As on the hardware there is
+ * one rtimer, and setting one while another is pending replaces it
+ * without moving the interrupt: the new task runs at the old time.
+ * The callback runs before any process, as from the timer interrupt.
+ */
+#ifndef RTIMER_H_
+#define RTIMER_H_
+
+#include <stdint.h>
+
+#ifndef RTIMER_CONF_SECOND
+#define RTIMER_CONF_SECOND (4096U * 8)
+#endif
+#define RTIMER_SECOND RTIMER_CONF_SECOND
+
+typedef uint16_t rtimer_clock_t;
+#define RTIMER_CLOCK_DIFF(a, b) ((int16_t)((a) - (b)))
+#define RTIMER_CLOCK_LT(a, b) (RTIMER_CLOCK_DIFF((a), (b)) < 0)
+
+#define US_TO_RTIMERTICKS(US) ((US) >= 0 ? \
+  (((int32_t)(US) * (RTIMER_SECOND) + 500000) / 1000000L) : \
+  ((int32_t)(US) * (RTIMER_SECOND) - 500000) / 1000000L)
+#define RTIMERTICKS_TO_US(T) ((T) >= 0 ? \
+  (((int32_t)(T) * 1000000L + ((RTIMER_SECOND) / 2)) / (RTIMER_SECOND)) : \
+  ((int32_t)(T) * 1000000L - ((RTIMER_SECOND) / 2)) / (RTIMER_SECOND))
+
+struct rtimer;
+typedef void (*rtimer_callback_t)(struct rtimer *t, void *ptr);
+
+struct rtimer {
+  rtimer_clock_t time;
+  rtimer_callback_t func;
+  void *ptr;
+};
+
+enum {
+  RTIMER_OK,
+  RTIMER_ERR_FULL,
+  RTIMER_ERR_TIME,
+  RTIMER_ERR_ALREADY_SCHEDULED,
+};
+
+void rtimer_init(void);
+int rtimer_set(struct rtimer *task, rtimer_clock_t time,
+               rtimer_clock_t duration, rtimer_callback_t func, void *ptr);
+void rtimer_run_next(void);
+rtimer_clock_t rtimer_arch_now(void);
+#define RTIMER_NOW() rtimer_arch_now()
+
+#endif /* RTIMER_H_ */
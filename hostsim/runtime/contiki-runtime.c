@@ -0,0 +1,781 @@
+/*
+ * Contiki kernel for host motes: processes, timers, clock, serial port.
+ *
+ * The process and etimer code follows Contiki-NG's sys/process.c and
+ * sys/etimer.c so the firmware protothreads see the same scheduling
+ * (poll before events, one event per process_run(), etimers posting
+ * PROCESS_EVENT_TIMER through etimer_process).
+ */
+#include "contiki.h"
+#include "dev/serial-line.h"
+#include "lib/crc16.h"
+#include "cpu/msp430/dev/uart0.h"
+#include "sys/log.h"
+#include "sys/energest.h"
+#include "runtime.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const struct sim_host_api *runtime_host;
+uint64_t runtime_local_us;
+int log_enabled;
+
+static int fixed_rand = -1;
+static uint32_t rand_state = 1;
+static uint32_t random_state = 1;
+/*---------------------------------------------------------------------------*/
+/* Clock */
+void
+clock_init(void)
+{
+}
+clock_time_t
+clock_time(void)
+{
+  return (clock_time_t)(runtime_local_us * CLOCK_SECOND / 1000000);
+}
+unsigned long
+clock_seconds(void)
+{
+  return (unsigned long)(runtime_local_us / 1000000);
+}
+/*---------------------------------------------------------------------------*/
+/* Timers */
+void
+timer_set(struct timer *t, clock_time_t interval)
+{
+  t->interval = interval;
+  t->start = clock_time();
+}
+void
+timer_reset(struct timer *t)
+{
+  t->start += t->interval;
+}
+void
+timer_restart(struct timer *t)
+{
+  t->start = clock_time();
+}
+int
+timer_expired(struct timer *t)
+{
+  clock_time_t diff = (clock_time() - t->start) + 1;
+  return t->interval < diff;
+}
+clock_time_t
+timer_remaining(struct timer *t)
+{
+  return t->start + t->interval - clock_time();
+}
+/*---------------------------------------------------------------------------*/
+/* Processes */
+struct process *process_list = NULL;
+struct process *process_current = NULL;
+
+static process_event_t lastevent;
+
+struct event_data {
+  process_event_t ev;
+  process_data_t data;
+  struct process *p;
+};
+
+static process_num_events_t nevents, fevent;
+static struct event_data events[PROCESS_CONF_NUMEVENTS];
+static unsigned char poll_requested;
+
+#define PROCESS_STATE_NONE    0
+#define PROCESS_STATE_RUNNING 1
+#define PROCESS_STATE_CALLED  2
+
+static void call_process(struct process *p, process_event_t ev, process_data_t data);
+
+process_event_t
+process_alloc_event(void)
+{
+  return lastevent++;
+}
+void
+process_start(struct process *p, process_data_t data)
+{
+  struct process *q;
+
+  for(q = process_list; q != p && q != NULL; q = q->next);
+  if(q == p) {
+    return;
+  }
+  p->next = process_list;
+  process_list = p;
+  p->state = PROCESS_STATE_RUNNING;
+  PT_INIT(&p->pt);
+  process_post_synch(p, PROCESS_EVENT_INIT, data);
+}
+static void
+exit_process(struct process *p, struct process *fromprocess)
+{
+  struct process *q;
+  struct process *old_current = process_current;
+
+  for(q = process_list; q != p && q != NULL; q = q->next);
+  if(q == NULL) {
+    return;
+  }
+  if(process_is_running(p)) {
+    p->state = PROCESS_STATE_NONE;
+    for(q = process_list; q != NULL; q = q->next) {
+      if(p != q) {
+        call_process(q, PROCESS_EVENT_EXITED, (process_data_t)p);
+      }
+    }
+    if(p->thread != NULL && p != fromprocess) {
+      process_current = p;
+      p->thread(&p->pt, PROCESS_EVENT_EXIT, NULL);
+    }
+  }
+  if(p == process_list) {
+    process_list = process_list->next;
+  } else {
+    for(q = process_list; q != NULL; q = q->next) {
+      if(q->next == p) {
+        q->next = p->next;
+        break;
+      }
+    }
+  }
+  process_current = old_current;
+}
+static void
+call_process(struct process *p, process_event_t ev, process_data_t data)
+{
+  int ret;
+
+  if((p->state & PROCESS_STATE_RUNNING) && p->thread != NULL) {
+    process_current = p;
+    p->state = PROCESS_STATE_CALLED;
+    runtime_energest_call();
+    ret = p->thread(&p->pt, ev, data);
+    if(ret == PT_EXITED || ret == PT_ENDED || ev == PROCESS_EVENT_EXIT) {
+      exit_process(p, p);
+    } else {
+      p->state = PROCESS_STATE_RUNNING;
+    }
+  }
+}
+void
+process_exit(struct process *p)
+{
+  exit_process(p, PROCESS_CURRENT());
+}
+void
+process_init(void)
+{
+  lastevent = PROCESS_EVENT_MAX;
+  nevents = fevent = 0;
+  process_current = process_list = NULL;
+}
+static void
+do_poll(void)
+{
+  struct process *p;
+
+  poll_requested = 0;
+  for(p = process_list; p != NULL; p = p->next) {
+    if(p->needspoll) {
+      p->state = PROCESS_STATE_RUNNING;
+      p->needspoll = 0;
+      call_process(p, PROCESS_EVENT_POLL, NULL);
+    }
+  }
+}
+static void
+do_event(void)
+{
+  process_event_t ev;
+  process_data_t data;
+  struct process *receiver;
+  struct process *p;
+
+  if(nevents > 0) {
+    ev = events[fevent].ev;
+    data = events[fevent].data;
+    receiver = events[fevent].p;
+    fevent = (fevent + 1) % PROCESS_CONF_NUMEVENTS;
+    --nevents;
+
+    if(receiver == PROCESS_BROADCAST) {
+      for(p = process_list; p != NULL; p = p->next) {
+        if(poll_requested) {
+          do_poll();
+        }
+        call_process(p, ev, data);
+      }
+    } else {
+      if(ev == PROCESS_EVENT_INIT) {
+        receiver->state = PROCESS_STATE_RUNNING;
+      }
+      call_process(receiver, ev, data);
+    }
+  }
+}
+int
+process_run(void)
+{
+  if(poll_requested) {
+    do_poll();
+  }
+  do_event();
+  return nevents + poll_requested;
+}
+int
+process_nevents(void)
+{
+  return nevents + poll_requested;
+}
+int
+process_post(struct process *p, process_event_t ev, process_data_t data)
+{
+  process_num_events_t snum;
+
+  if(nevents == PROCESS_CONF_NUMEVENTS) {
+    return PROCESS_ERR_FULL;
+  }
+  snum = (process_num_events_t)(fevent + nevents) % PROCESS_CONF_NUMEVENTS;
+  events[snum].ev = ev;
+  events[snum].data = data;
+  events[snum].p = p;
+  ++nevents;
+  return PROCESS_ERR_OK;
+}
+void
+process_post_synch(struct process *p, process_event_t ev, process_data_t data)
+{
+  struct process *caller = process_current;
+
+  call_process(p, ev, data);
+  process_current = caller;
+}
+void
+process_poll(struct process *p)
+{
+  if(p != NULL) {
+    if(p->state == PROCESS_STATE_RUNNING ||
+       p->state == PROCESS_STATE_CALLED) {
+      p->needspoll = 1;
+      poll_requested = 1;
+    }
+  }
+}
+int
+process_is_running(struct process *p)
+{
+  return p->state != PROCESS_STATE_NONE;
+}
+void
+autostart_start(struct process * const processes[])
+{
+  int i;
+
+  for(i = 0; processes[i] != NULL; ++i) {
+    process_start(processes[i], NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Event timers */
+static struct etimer *timerlist;
+static clock_time_t next_expiration;
+
+PROCESS(etimer_process, "Event timer");
+
+static void
+update_time(void)
+{
+  clock_time_t tdist;
+  clock_time_t now;
+  struct etimer *t;
+
+  if(timerlist == NULL) {
+    next_expiration = 0;
+  } else {
+    now = clock_time();
+    t = timerlist;
+    tdist = t->timer.start + t->timer.interval - now;
+    for(t = t->next; t != NULL; t = t->next) {
+      if(t->timer.start + t->timer.interval - now < tdist) {
+        tdist = t->timer.start + t->timer.interval - now;
+      }
+    }
+    next_expiration = now + tdist;
+  }
+}
+PROCESS_THREAD(etimer_process, ev, data)
+{
+  struct etimer *t, *u;
+
+  PROCESS_BEGIN();
+
+  timerlist = NULL;
+
+  while(1) {
+    PROCESS_YIELD();
+
+    if(ev == PROCESS_EVENT_EXITED) {
+      struct process *p = data;
+
+      while(timerlist != NULL && timerlist->p == p) {
+        timerlist = timerlist->next;
+      }
+      if(timerlist != NULL) {
+        t = timerlist;
+        while(t->next != NULL) {
+          if(t->next->p == p) {
+            t->next = t->next->next;
+          } else {
+            t = t->next;
+          }
+        }
+      }
+      continue;
+    } else if(ev != PROCESS_EVENT_POLL) {
+      continue;
+    }
+
+again:
+    u = NULL;
+    for(t = timerlist; t != NULL; t = t->next) {
+      if(timer_expired(&t->timer)) {
+        if(process_post(t->p, PROCESS_EVENT_TIMER, t) == PROCESS_ERR_OK) {
+          t->p = PROCESS_NONE;
+          if(u != NULL) {
+            u->next = t->next;
+          } else {
+            timerlist = t->next;
+          }
+          t->next = NULL;
+          update_time();
+          goto again;
+        } else {
+          etimer_request_poll();
+        }
+      }
+      u = t;
+    }
+  }
+
+  PROCESS_END();
+}
+void
+etimer_request_poll(void)
+{
+  process_poll(&etimer_process);
+}
+static void
+add_timer(struct etimer *timer)
+{
+  struct etimer *t;
+
+  etimer_request_poll();
+
+  if(timer->p != PROCESS_NONE) {
+    for(t = timerlist; t != NULL; t = t->next) {
+      if(t == timer) {
+        timer->p = PROCESS_CURRENT();
+        update_time();
+        return;
+      }
+    }
+  }
+
+  timer->p = PROCESS_CURRENT();
+  timer->next = timerlist;
+  timerlist = timer;
+
+  update_time();
+}
+void
+etimer_set(struct etimer *et, clock_time_t interval)
+{
+  timer_set(&et->timer, interval);
+  add_timer(et);
+}
+void
+etimer_reset_with_new_interval(struct etimer *et, clock_time_t interval)
+{
+  timer_reset(&et->timer);
+  et->timer.interval = interval;
+  add_timer(et);
+}
+void
+etimer_reset(struct etimer *et)
+{
+  timer_reset(&et->timer);
+  add_timer(et);
+}
+void
+etimer_restart(struct etimer *et)
+{
+  timer_restart(&et->timer);
+  add_timer(et);
+}
+void
+etimer_adjust(struct etimer *et, int timediff)
+{
+  et->timer.start += timediff;
+  update_time();
+}
+int
+etimer_expired(struct etimer *et)
+{
+  return et->p == PROCESS_NONE;
+}
+clock_time_t
+etimer_expiration_time(struct etimer *et)
+{
+  return et->timer.start + et->timer.interval;
+}
+clock_time_t
+etimer_start_time(struct etimer *et)
+{
+  return et->timer.start;
+}
+int
+etimer_pending(void)
+{
+  return timerlist != NULL;
+}
+clock_time_t
+etimer_next_expiration_time(void)
+{
+  return etimer_pending() ? next_expiration : 0;
+}
+void
+etimer_stop(struct etimer *et)
+{
+  struct etimer *t;
+
+  if(et == timerlist) {
+    timerlist = timerlist->next;
+    update_time();
+  } else {
+    for(t = timerlist; t != NULL && t->next != et; t = t->next);
+    if(t != NULL) {
+      t->next = et->next;
+      update_time();
+    }
+  }
+  et->next = NULL;
+  et->p = PROCESS_NONE;
+}
+/*---------------------------------------------------------------------------*/
+/* Real-time timer, as Contiki-NG's sys/rtimer.c over a 16-bit compare
+   register */
+static struct rtimer *next_rtimer;
+static uint64_t rtimer_due_us; /* when the compare register matches */
+
+rtimer_clock_t
+rtimer_arch_now(void)
+{
+  return (rtimer_clock_t)(runtime_local_us * RTIMER_SECOND / 1000000);
+}
+static void
+rtimer_arch_schedule(rtimer_clock_t t)
+{
+  uint64_t now = runtime_local_us * RTIMER_SECOND / 1000000;
+  /* a time gone by matches after the counter wraps */
+  uint64_t ticks = now + (rtimer_clock_t)(t - (rtimer_clock_t)now);
+
+  rtimer_due_us = (ticks * 1000000 + RTIMER_SECOND - 1) / RTIMER_SECOND;
+}
+void
+rtimer_init(void)
+{
+  next_rtimer = NULL;
+}
+int
+rtimer_set(struct rtimer *rtimer, rtimer_clock_t time,
+           rtimer_clock_t duration, rtimer_callback_t func, void *ptr)
+{
+  int first = next_rtimer == NULL;
+
+  rtimer->func = func;
+  rtimer->ptr = ptr;
+  rtimer->time = time;
+  next_rtimer = rtimer;
+  if(first) {
+    rtimer_arch_schedule(time);
+  }
+  return RTIMER_OK;
+}
+void
+rtimer_run_next(void)
+{
+  struct rtimer *t;
+
+  if(next_rtimer == NULL) {
+    return;
+  }
+  t = next_rtimer;
+  next_rtimer = NULL;
+  t->func(t, t->ptr);
+  if(next_rtimer != NULL) {
+    rtimer_arch_schedule(next_rtimer->time);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Serial port */
+process_event_t serial_line_event_message;
+
+static char serial_rxbuf[SERIAL_LINE_CONF_BUFSIZE];
+static int serial_rxlen;
+
+PROCESS(serial_line_process, "Serial driver");
+
+PROCESS_THREAD(serial_line_process, ev, data)
+{
+  PROCESS_BEGIN();
+  serial_line_event_message = process_alloc_event();
+  while(1) {
+    PROCESS_YIELD();
+  }
+  PROCESS_END();
+}
+int
+serial_line_input_byte(unsigned char c)
+{
+  static char line[SERIAL_LINE_CONF_BUFSIZE];
+
+  if(c == '\r') {
+    return 1;
+  }
+  if(c != '\n' && serial_rxlen < SERIAL_LINE_CONF_BUFSIZE - 1) {
+    serial_rxbuf[serial_rxlen++] = c;
+    return 1;
+  }
+  if(c == '\n') {
+    memcpy(line, serial_rxbuf, serial_rxlen);
+    line[serial_rxlen] = '\0';
+    serial_rxlen = 0;
+    process_post(PROCESS_BROADCAST, serial_line_event_message, line);
+  }
+  return 1;
+}
+void
+serial_line_init(void)
+{
+  process_start(&serial_line_process, NULL);
+}
+static int (*uart0_input)(unsigned char c);
+
+void
+uart0_set_input(int (*input)(unsigned char c))
+{
+  uart0_input = input;
+}
+int
+printf(const char *fmt, ...)
+{
+  char buf[256];
+  va_list ap;
+  int len;
+
+  va_start(ap, fmt);
+  len = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if(len > (int)sizeof(buf) - 1) {
+    len = sizeof(buf) - 1;
+  }
+  if(len > 0) {
+    runtime_host->serial_write(buf, len);
+  }
+  return len;
+}
+int
+putchar(int c)
+{
+  char ch = (char)c;
+
+  runtime_host->serial_write(&ch, 1);
+  return c;
+}
+/* glibc's inline putchar() calls putc(c, stdout) */
+int
+putc(int c, FILE *stream)
+{
+  if(stream != stdout) {
+    return EOF;
+  }
+  return putchar(c);
+}
+int
+fputc(int c, FILE *stream)
+{
+  return putc(c, stream);
+}
+void
+log_lladdr(const linkaddr_t *lladdr)
+{
+  unsigned i;
+
+  if(lladdr == NULL) {
+    printf("(NULL LL addr)");
+    return;
+  }
+  for(i = 0; i < LINKADDR_SIZE; i++) {
+    if(i > 0 && i % 2 == 0) {
+      printf(".");
+    }
+    printf("%02x", lladdr->u8[i]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* libc rand() is per mote, and can be pinned to make readings known */
+int
+rand(void)
+{
+  if(fixed_rand >= 0) {
+    return fixed_rand;
+  }
+  rand_state = rand_state * 1103515245 + 12345;
+  return (int)((rand_state >> 16) & 0x7fff);
+}
+void
+srand(unsigned int seed)
+{
+  rand_state = seed;
+}
+/*---------------------------------------------------------------------------*/
+/* lib/random.c: the firmware's own generator, apart from the readings */
+void
+random_init(unsigned short seed)
+{
+  random_state = seed;
+}
+unsigned short
+random_rand(void)
+{
+  random_state = random_state * 1664525UL + 1013904223UL;
+  return (unsigned short)(random_state >> 16);
+}
+/*---------------------------------------------------------------------------*/
+/* lib/crc16.c: CRC-16/CCITT, LSB first, as in Contiki-NG */
+unsigned short
+crc16_add(unsigned char b, unsigned short acc)
+{
+  acc ^= b;
+  acc = (acc >> 8) | (acc << 8);
+  acc ^= (acc & 0xff00) << 4;
+  acc ^= (acc >> 8) >> 4;
+  acc ^= (acc & 0xff00) >> 5;
+  return acc;
+}
+unsigned short
+crc16_data(const unsigned char *data, int len, unsigned short acc)
+{
+  int i;
+
+  for(i = 0; i < len; i++) {
+    acc = crc16_add(data[i], acc);
+  }
+  return acc;
+}
+/*---------------------------------------------------------------------------*/
+/* Entry points used by the harness */
+static void
+run_until_idle(void)
+{
+  if(next_rtimer != NULL && runtime_local_us >= rtimer_due_us) {
+    rtimer_run_next();
+  }
+  do {
+    if(etimer_pending() &&
+       (clock_time_t)(clock_time() - etimer_next_expiration_time()) < 0x80000000UL) {
+      etimer_request_poll();
+    }
+  } while(process_run() > 0);
+}
+static void
+sim_boot(const struct sim_fw_config *config, uint64_t local_us)
+{
+  runtime_host = config->host;
+  runtime_local_us = local_us;
+  log_enabled = config->log_enabled;
+  fixed_rand = config->fixed_rand;
+  rand_state = config->seed;
+  /* as the platform does, before the processes start */
+  random_init((unsigned short)(config->seed ^ (config->seed >> 16)));
+
+  clock_init();
+  energest_init();
+  process_init();
+  rtimer_init();
+  process_start(&etimer_process, NULL);
+  netstack_runtime_init(config->node_id);
+  autostart_start(autostart_processes);
+  run_until_idle();
+}
+static void
+sim_run(uint64_t local_us)
+{
+  runtime_local_us = local_us;
+  run_until_idle();
+}
+static void
+sim_input(uint64_t local_us, const void *data, uint16_t len,
+          const linkaddr_t *src, const linkaddr_t *dest, int rssi)
+{
+  runtime_local_us = local_us;
+  runtime_last_rssi = rssi;
+  netstack_runtime_input(data, len, src, dest);
+  run_until_idle();
+}
+static int
+sim_next_wakeup(uint64_t *local_us)
+{
+  clock_time_t now;
+  clock_time_t due;
+  uint64_t ticks;
+
+  if(!etimer_pending() && next_rtimer == NULL) {
+    return 0;
+  }
+  *local_us = UINT64_MAX;
+  if(etimer_pending()) {
+    now = clock_time();
+    due = etimer_next_expiration_time() - now;
+    if(due >= 0x80000000UL) {
+      due = 0;
+    }
+    ticks = runtime_local_us * CLOCK_SECOND / 1000000 + due;
+    /* First microsecond at which clock_time() reaches the expiration tick */
+    *local_us = (ticks * 1000000 + CLOCK_SECOND - 1) / CLOCK_SECOND;
+  }
+  if(next_rtimer != NULL && rtimer_due_us < *local_us) {
+    *local_us = rtimer_due_us;
+  }
+  return 1;
+}
+static void
+sim_serial_input(uint64_t local_us, const char *buf, int len)
+{
+  int i;
+
+  runtime_local_us = local_us;
+  /* Dropped until the firmware sets an input, as by the UART */
+  for(i = 0; i < len && uart0_input != NULL; i++) {
+    uart0_input((unsigned char)buf[i]);
+  }
+  run_until_idle();
+}
+__attribute__((visibility("default")))
+const struct sim_fw_api sim_fw = {
+  SIM_API_VERSION,
+  sim_boot,
+  sim_run,
+  sim_input,
+  sim_next_wakeup,
+  sim_serial_input,
+};
+/*---------------------------------------------------------------------------*/
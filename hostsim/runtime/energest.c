@@ -0,0 +1,74 @@
+/*
+ * Energest counters of a host mote, see include/sys/energest.h.
+ */
+#include "contiki.h"
+#include "sys/energest.h"
+#include "runtime.h"
+
+/* Active time of one call into a process on a Z1 */
+#define CPU_US_PER_CALL 100
+/* 250 kbit/s, and the PHY header, MAC header and FCS around the payload */
+#define AIR_US_PER_BYTE 32
+#define FRAME_OVERHEAD 17
+
+uint64_t energest_total_time[ENERGEST_TYPE_MAX];
+
+static uint64_t cpu_us;
+static uint64_t tx_us;
+static int radio_on;
+static uint64_t radio_on_since;
+static uint64_t radio_on_us;
+/*---------------------------------------------------------------------------*/
+void
+energest_init(void)
+{
+  int i;
+
+  for(i = 0; i < ENERGEST_TYPE_MAX; i++) {
+    energest_total_time[i] = 0;
+  }
+  cpu_us = 0;
+  tx_us = 0;
+  radio_on = 1;
+  radio_on_since = runtime_local_us;
+  radio_on_us = 0;
+}
+void
+energest_flush(void)
+{
+  uint64_t on = radio_on_us;
+
+  if(radio_on) {
+    on += runtime_local_us - radio_on_since;
+  }
+  energest_total_time[ENERGEST_TYPE_CPU] = cpu_us;
+  energest_total_time[ENERGEST_TYPE_LPM] =
+    runtime_local_us > cpu_us ? runtime_local_us - cpu_us : 0;
+  energest_total_time[ENERGEST_TYPE_TRANSMIT] = tx_us;
+  energest_total_time[ENERGEST_TYPE_LISTEN] = on > tx_us ? on - tx_us : 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+runtime_energest_call(void)
+{
+  cpu_us += CPU_US_PER_CALL;
+}
+void
+runtime_energest_transmit(uint16_t len)
+{
+  tx_us += (uint64_t)(len + FRAME_OVERHEAD) * AIR_US_PER_BYTE;
+}
+void
+runtime_energest_radio(int on)
+{
+  if(on == radio_on) {
+    return;
+  }
+  if(on) {
+    radio_on_since = runtime_local_us;
+  } else {
+    radio_on_us += runtime_local_us - radio_on_since;
+  }
+  radio_on = on;
+}
+/*---------------------------------------------------------------------------*/
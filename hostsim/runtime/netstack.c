@@ -0,0 +1,130 @@
+/*
+ * NullNet, link-layer addresses and the CC2420 driver for host motes.
+ * Frames leave through the harness radio medium instead of a MAC, and the
+ * radio only reports RSSI, turns on and off and changes channel.
+ */
+#include "contiki.h"
+#include "net/netstack.h"
+#include "net/nullnet/nullnet.h"
+#include "arch/dev/radio/cc2420/cc2420.h"
+#include "runtime.h"
+
+#include <string.h>
+
+int runtime_last_rssi;
+static int channel = 26;
+/*---------------------------------------------------------------------------*/
+linkaddr_t linkaddr_node_addr;
+const linkaddr_t linkaddr_null = { { 0, 0, 0, 0, 0, 0, 0, 0 } };
+
+void
+linkaddr_copy(linkaddr_t *dest, const linkaddr_t *src)
+{
+  memcpy(dest, src, LINKADDR_SIZE);
+}
+int
+linkaddr_cmp(const linkaddr_t *addr1, const linkaddr_t *addr2)
+{
+  return memcmp(addr1, addr2, LINKADDR_SIZE) == 0;
+}
+void
+linkaddr_set_node_addr(linkaddr_t *t)
+{
+  linkaddr_copy(&linkaddr_node_addr, t);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *nullnet_buf;
+uint16_t nullnet_len;
+static nullnet_input_callback current_callback = NULL;
+
+void
+nullnet_set_input_callback(nullnet_input_callback callback)
+{
+  current_callback = callback;
+}
+static uint8_t
+output(const linkaddr_t *dest)
+{
+  if(dest != NULL && linkaddr_cmp(dest, &linkaddr_null)) {
+    dest = NULL;
+  }
+  runtime_energest_transmit(nullnet_len);
+  runtime_host->radio_send(nullnet_buf, nullnet_len, dest);
+  return 1;
+}
+const struct network_driver nullnet_driver = {
+  "nullnet",
+  NULL,
+  NULL,
+  output,
+};
+void
+netstack_runtime_input(const void *data, uint16_t len,
+                       const linkaddr_t *src, const linkaddr_t *dest)
+{
+  if(current_callback != NULL) {
+    current_callback(data, len, src, dest);
+  }
+}
+void
+netstack_runtime_init(uint16_t node_id)
+{
+  linkaddr_t addr;
+
+  /* Same mapping as Cooja's Z1 motes: node id in the first bytes */
+  memset(&addr, 0, sizeof(addr));
+  addr.u8[0] = node_id & 0xff;
+  addr.u8[1] = node_id >> 8;
+  linkaddr_set_node_addr(&addr);
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+get_value(radio_param_t param, radio_value_t *value)
+{
+  switch(param) {
+  case RADIO_PARAM_LAST_RSSI:
+    *value = runtime_last_rssi;
+    return RADIO_RESULT_OK;
+  case RADIO_PARAM_CHANNEL:
+    *value = channel;
+    return RADIO_RESULT_OK;
+  default:
+    return RADIO_RESULT_NOT_SUPPORTED;
+  }
+}
+static radio_result_t
+set_value(radio_param_t param, radio_value_t value)
+{
+  switch(param) {
+  case RADIO_PARAM_CHANNEL:
+    if(value < 11 || value > 26) {
+      return RADIO_RESULT_INVALID_VALUE;
+    }
+    channel = value;
+    runtime_host->radio_channel(value);
+    return RADIO_RESULT_OK;
+  default:
+    return RADIO_RESULT_NOT_SUPPORTED;
+  }
+}
+static int
+on(void)
+{
+  runtime_energest_radio(1);
+  runtime_host->radio_power(1);
+  return 1;
+}
+static int
+off(void)
+{
+  runtime_energest_radio(0);
+  runtime_host->radio_power(0);
+  return 1;
+}
+const struct radio_driver cc2420_driver = {
+  .on = on,
+  .off = off,
+  .get_value = get_value,
+  .set_value = set_value,
+};
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,24 @@
+/*
+ * State shared by the runtime files linked into each firmware image.
+ * Everything here lives in the image's writable segment and is therefore
+ * private to the mote currently loaded by the harness.
+ */
+#ifndef RUNTIME_H_
+#define RUNTIME_H_
+
+#include "sim-api.h"
+
+extern const struct sim_host_api *runtime_host;
+extern uint64_t runtime_local_us;
+extern int runtime_last_rssi;
+
+void netstack_runtime_init(uint16_t node_id);
+void netstack_runtime_input(const void *data, uint16_t len,
+                            const linkaddr_t *src, const linkaddr_t *dest);
+
+/* Energest accounting (energest.c) */
+void runtime_energest_call(void);
+void runtime_energest_transmit(uint16_t len);
+void runtime_energest_radio(int on);
+
+#endif /* RUNTIME_H_ */
@@ -0,0 +1,74 @@
+/*
+ * Event queue: a binary min-heap ordered by time, then insertion order so
+ * that events scheduled for the same microsecond run deterministically.
+ */
+#include <stdlib.h>
+#include "hostsim.h"
+
+static struct event *heap;
+static size_t heap_len, heap_cap;
+static uint64_t next_seq;
+/*---------------------------------------------------------------------------*/
+static int
+before(const struct event *a, const struct event *b)
+{
+  if(a->time != b->time) {
+    return a->time < b->time;
+  }
+  return a->seq < b->seq;
+}
+/*---------------------------------------------------------------------------*/
+void
+events_push(sim_time_t time, enum event_type type, uint32_t mote)
+{
+  size_t i;
+
+  if(heap_len == heap_cap) {
+    heap_cap = heap_cap ? 2 * heap_cap : 1024;
+    heap = realloc(heap, heap_cap * sizeof(*heap));
+    if(heap == NULL) {
+      abort();
+    }
+  }
+  i = heap_len++;
+  heap[i].time = time;
+  heap[i].seq = next_seq++;
+  heap[i].mote = mote;
+  heap[i].type = type;
+  while(i > 0 && before(&heap[i], &heap[(i - 1) / 2])) {
+    struct event tmp = heap[i];
+    heap[i] = heap[(i - 1) / 2];
+    heap[(i - 1) / 2] = tmp;
+    i = (i - 1) / 2;
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+events_pop(struct event *ev)
+{
+  size_t i = 0;
+
+  if(heap_len == 0) {
+    return 0;
+  }
+  *ev = heap[0];
+  heap[0] = heap[--heap_len];
+  for(;;) {
+    size_t l = 2 * i + 1, r = l + 1, m = i;
+    if(l < heap_len && before(&heap[l], &heap[m])) {
+      m = l;
+    }
+    if(r < heap_len && before(&heap[r], &heap[m])) {
+      m = r;
+    }
+    if(m == i) {
+      break;
+    }
+    struct event tmp = heap[i];
+    heap[i] = heap[m];
+    heap[m] = tmp;
+    i = m;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,228 @@
+/*
+ * hostsim: runs the border, coordinator and sensor firmware natively on
+ * Linux, thousands of motes per process, over a unit-disk radio medium
+ * modelled after Cooja's UDGM.
+ */
+#ifndef HOSTSIM_H_
+#define HOSTSIM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "sim-api.h"
+
+typedef uint64_t sim_time_t;            /* microseconds */
+#define SIM_SECOND 1000000ULL
+
+#define FRAME_MAX 127                   /* 802.15.4 PSDU */
+#define REPORT_MAX (23 + 255 * 2 + 255 * 8) /* border report frame, at most */
+#define RADIO_CHANNEL_MIN 11            /* 802.15.4 at 2.4 GHz */
+#define RADIO_CHANNELS 16
+#define RADIO_DEFAULT_CHANNEL 26        /* Contiki-NG's */
+
+enum mote_role {
+  ROLE_BORDER,
+  ROLE_COORDINATOR,
+  ROLE_SENSOR,
+  ROLE_COUNT
+};
+
+/* One firmware shared object and the writable segment swapped per mote */
+struct firmware {
+  const char *name;
+  void *handle;
+  const struct sim_fw_api *api;
+  uint8_t *segment;
+  size_t segment_len;
+  uint8_t *pristine;
+  struct mote *loaded;
+};
+
+struct frame {
+  uint8_t data[FRAME_MAX];
+  uint16_t len;
+  uint8_t broadcast;
+  linkaddr_t dest;
+};
+
+struct neighbor {
+  uint32_t mote;
+  float distance;
+};
+
+enum mac_state {
+  MAC_IDLE,
+  MAC_BACKOFF,
+  MAC_TX,
+};
+
+/* CSMA as in Contiki-NG's csma-output.c, one queue per mote */
+struct mac {
+  struct frame *queue;
+  int head;
+  int count;
+  uint8_t collisions;
+  uint8_t transmissions;
+  enum mac_state state;
+  uint8_t acked;
+  uint8_t tx_channel;           /* of the frame on the air, - RADIO_CHANNEL_MIN */
+};
+
+struct mote_stats {
+  uint64_t tx_frames;
+  uint64_t tx_bytes;
+  uint64_t rx_frames;
+  uint64_t rx_collided;
+  uint64_t rx_lost;
+  uint64_t mac_noack_drops;
+  uint64_t mac_busy_drops;
+  uint64_t mac_queue_drops;
+  uint64_t radio_on_us;         /* up to radio_since while the radio is on */
+};
+
+struct mote {
+  uint32_t index;
+  uint16_t id;
+  enum mote_role role;
+  struct firmware *fw;
+  uint8_t *image;
+  double x, y;
+  sim_time_t boot_at;
+  int32_t drift_ppm;
+  uint8_t booted;
+  uint8_t crashed;
+  uint8_t killed;               /* by --kill, crashed too */
+  sim_time_t wake_at;
+
+  struct neighbor *neighbors;
+  uint32_t n_neighbors;
+
+  /* Radio medium */
+  uint8_t radio_off;
+  sim_time_t radio_since;
+  uint8_t transmitting;
+  uint8_t channel;              /* - RADIO_CHANNEL_MIN */
+  /* Signals in range on each channel, and when the first of them started */
+  uint32_t rx_signals[RADIO_CHANNELS];
+  sim_time_t rx_first_start[RADIO_CHANNELS];
+  int64_t rx_lock;
+  uint8_t rx_corrupt;
+  struct mac mac;
+
+  char line[256];
+  int line_len;
+  uint8_t report[REPORT_MAX];
+  int report_len;
+  uint16_t report_seq;          /* last sequence number, valid once reports > 0 */
+  uint32_t reports;
+  uint8_t in_period;            /* reported in the network period under way */
+  struct mote_stats stats;
+};
+
+struct sim_config {
+  const char *csc_file;
+  const char *fw_dir;
+  const char *csv_file;
+  unsigned borders;
+  unsigned coordinators;
+  unsigned sensors_per_coordinator;
+  double coordinator_radius;
+  double sensor_radius;
+  double duration;
+  double warmup;
+  uint64_t seed;
+  double tx_range;
+  double interference_range;
+  double success_ratio_tx;
+  double success_ratio_rx;
+  double max_drift_ppm;
+  double boot_delay;
+  int reading;
+  int mac_queue;
+  double backoff_us;
+  int log;
+  /* --serial: lines written to the border's serial port, in time order */
+  struct serial_command {
+    double time;
+    const char *line;
+  } *serial;
+  unsigned n_serial;
+  /* --kill: motes stopped for good */
+  struct kill_command {
+    double time;
+    uint16_t id;
+  } *kill;
+  unsigned n_kill;
+};
+
+struct sim {
+  struct sim_config config;
+  struct firmware fw[ROLE_COUNT];
+  struct mote *motes;
+  uint32_t n_motes;
+  uint32_t n_role[ROLE_COUNT];
+  uint32_t n_killed[ROLE_COUNT];
+  int64_t by_id[65536];
+  sim_time_t now;
+  struct mote *current;
+  uint64_t rng;
+};
+
+extern struct sim sim;
+
+/* main.c */
+double sim_random(void);
+uint32_t sim_random_u32(void);
+
+/* events.c */
+enum event_type {
+  EV_BOOT,
+  EV_WAKE,
+  EV_MAC,
+  EV_TX_END,
+  EV_SERIAL,
+  EV_KILL,
+};
+
+struct event {
+  sim_time_t time;
+  uint64_t seq;
+  uint32_t mote;
+  uint8_t type;
+};
+
+void events_push(sim_time_t time, enum event_type type, uint32_t mote);
+int events_pop(struct event *ev);
+
+/* mote.c */
+void mote_init(void);
+int firmware_load(struct firmware *fw, const char *dir, const char *name);
+void mote_attach(struct mote *m);
+void mote_boot(struct mote *m);
+void mote_wake(struct mote *m);
+void mote_input(struct mote *m, const struct frame *f, const struct mote *src,
+                int rssi);
+void mote_serial_input(struct mote *m, const char *line);
+void mote_kill(struct mote *m);
+
+/* radio.c */
+void radio_init(void);
+void mac_send(struct mote *m, const void *data, uint16_t len,
+              const linkaddr_t *dest);
+void mac_attempt(struct mote *m);
+void radio_tx_end(struct mote *m);
+
+/* topology.c */
+int topology_load_csc(const char *path);
+int topology_generate(void);
+struct mote *topology_add(enum mote_role role, uint16_t id, double x, double y);
+
+/* stats.c */
+void mote_serial_text(struct mote *m, char c);
+
+int stats_open(void);
+void stats_serial_line(struct mote *m, const char *line);
+void stats_border_byte(struct mote *m, uint8_t c);
+void stats_print(FILE *out, double wall_seconds);
+void stats_close(void);
+
+#endif /* HOSTSIM_H_ */
@@ -0,0 +1,351 @@
+/*
+ * hostsim command line and event loop.
+ */
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "hostsim.h"
+
+struct sim sim;
+/*---------------------------------------------------------------------------*/
+/* xorshift64*, seeded from --seed so runs are reproducible */
+uint32_t
+sim_random_u32(void)
+{
+  sim.rng ^= sim.rng >> 12;
+  sim.rng ^= sim.rng << 25;
+  sim.rng ^= sim.rng >> 27;
+  return (uint32_t)((sim.rng * 2685821657736338717ULL) >> 32);
+}
+/*---------------------------------------------------------------------------*/
+double
+sim_random(void)
+{
+  return sim_random_u32() / 4294967296.0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+usage(FILE *out)
+{
+  fprintf(out,
+    "usage: hostsim [options]\n"
+    "\n"
+    "Topology (generated unless --csc is given):\n"
+    "  --csc FILE               motes and radio medium from a Cooja simulation\n"
+    "  -b, --borders N          borders in the middle (1)\n"
+    "  -c, --coordinators N     coordinators around the border (4)\n"
+    "  -s, --sensors N          sensors per coordinator (4)\n"
+    "  --coordinator-radius M   coordinators placed within M of the border (40)\n"
+    "  --sensor-radius M        sensors placed within M of their coordinator (30)\n"
+    "\n"
+    "Radio medium (Cooja UDGM):\n"
+    "  --range M                transmission range (50)\n"
+    "  --interference M         interference range (100)\n"
+    "  --tx-ratio P             success ratio per transmission (1.0)\n"
+    "  --rx-ratio P             success ratio per reception at full range (1.0)\n"
+    "  --mac-queue N            frames queued per mote (8)\n"
+    "  --backoff-us US          CSMA backoff period (one Z1 clock tick)\n"
+    "\n"
+    "Run:\n"
+    "  -t, --duration S         simulated seconds (300)\n"
+    "  --warmup S               ignore reports before S in the summary (60)\n"
+    "  --seed N                 random seed (1)\n"
+    "  --boot-delay S           motes boot uniformly within S seconds (1)\n"
+    "  --drift PPM              clock drift drawn within +-PPM (0)\n"
+    "  --reading N              value rand() returns on every mote, -1 for\n"
+    "                           random readings (1)\n"
+    "  --csv FILE               write one row per border report, per period\n"
+    "                           of the network with several borders\n"
+    "  --log                    print the serial output of every mote\n"
+    "  --serial S:LINE          write LINE to the borders' serial port at S\n"
+    "                           seconds, e.g. 120:config period=4000 (repeatable)\n"
+    "  --kill S:ID              stop the mote with id ID for good at S seconds\n"
+    "                           (repeatable)\n"
+    "  --fw-dir DIR             where border.so, coordinator.so and sensor.so are\n"
+    "                           (next to the hostsim binary)\n");
+}
+/*---------------------------------------------------------------------------*/
+/* S:LINE, kept in time order; the same time keeps the order given */
+static int
+add_serial(struct sim_config *c, const char *arg)
+{
+  char *end;
+  double t = strtod(arg, &end);
+  unsigned i;
+
+  if(end == arg || *end != ':' || t < 0) {
+    return -1;
+  }
+  c->serial = realloc(c->serial, (c->n_serial + 1) * sizeof(*c->serial));
+  if(c->serial == NULL) {
+    abort();
+  }
+  for(i = c->n_serial; i > 0 && c->serial[i - 1].time > t; i--) {
+    c->serial[i] = c->serial[i - 1];
+  }
+  c->serial[i].time = t;
+  c->serial[i].line = end + 1;
+  c->n_serial++;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* S:ID, the events put them in time order */
+static int
+add_kill(struct sim_config *c, const char *arg)
+{
+  char *end;
+  double t = strtod(arg, &end);
+  unsigned long id;
+
+  if(end == arg || *end != ':' || t < 0) {
+    return -1;
+  }
+  id = strtoul(end + 1, &end, 0);
+  if(*end != '\0' || id == 0 || id > 65535) {
+    return -1;
+  }
+  c->kill = realloc(c->kill, (c->n_kill + 1) * sizeof(*c->kill));
+  if(c->kill == NULL) {
+    abort();
+  }
+  c->kill[c->n_kill].time = t;
+  c->kill[c->n_kill].id = id;
+  c->n_kill++;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+parse_args(int argc, char **argv)
+{
+  enum {
+    OPT_CSC = 256, OPT_COORD_RADIUS, OPT_SENSOR_RADIUS, OPT_RANGE,
+    OPT_INTERFERENCE, OPT_TX_RATIO, OPT_RX_RATIO, OPT_MAC_QUEUE, OPT_BACKOFF,
+    OPT_WARMUP, OPT_SEED, OPT_BOOT_DELAY, OPT_DRIFT, OPT_READING, OPT_CSV,
+    OPT_LOG, OPT_FW_DIR, OPT_SERIAL, OPT_KILL,
+  };
+  static const struct option options[] = {
+    { "csc", required_argument, NULL, OPT_CSC },
+    { "borders", required_argument, NULL, 'b' },
+    { "coordinators", required_argument, NULL, 'c' },
+    { "sensors", required_argument, NULL, 's' },
+    { "coordinator-radius", required_argument, NULL, OPT_COORD_RADIUS },
+    { "sensor-radius", required_argument, NULL, OPT_SENSOR_RADIUS },
+    { "range", required_argument, NULL, OPT_RANGE },
+    { "interference", required_argument, NULL, OPT_INTERFERENCE },
+    { "tx-ratio", required_argument, NULL, OPT_TX_RATIO },
+    { "rx-ratio", required_argument, NULL, OPT_RX_RATIO },
+    { "mac-queue", required_argument, NULL, OPT_MAC_QUEUE },
+    { "backoff-us", required_argument, NULL, OPT_BACKOFF },
+    { "duration", required_argument, NULL, 't' },
+    { "warmup", required_argument, NULL, OPT_WARMUP },
+    { "seed", required_argument, NULL, OPT_SEED },
+    { "boot-delay", required_argument, NULL, OPT_BOOT_DELAY },
+    { "drift", required_argument, NULL, OPT_DRIFT },
+    { "reading", required_argument, NULL, OPT_READING },
+    { "csv", required_argument, NULL, OPT_CSV },
+    { "log", no_argument, NULL, OPT_LOG },
+    { "fw-dir", required_argument, NULL, OPT_FW_DIR },
+    { "serial", required_argument, NULL, OPT_SERIAL },
+    { "kill", required_argument, NULL, OPT_KILL },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  struct sim_config *c = &sim.config;
+  int opt;
+
+  c->borders = 1;
+  c->coordinators = 4;
+  c->sensors_per_coordinator = 4;
+  c->coordinator_radius = 40;
+  c->sensor_radius = 30;
+  c->duration = 300;
+  c->warmup = 60;
+  c->seed = 1;
+  c->tx_range = 50;
+  c->interference_range = 100;
+  c->success_ratio_tx = 1.0;
+  c->success_ratio_rx = 1.0;
+  c->boot_delay = 1;
+  c->reading = 1;
+  c->mac_queue = 8;
+  c->backoff_us = 1000000.0 / 128;
+
+  while((opt = getopt_long(argc, argv, "b:c:s:t:h", options, NULL)) != -1) {
+    switch(opt) {
+    case OPT_CSC: c->csc_file = optarg; break;
+    case 'b': c->borders = strtoul(optarg, NULL, 0); break;
+    case 'c': c->coordinators = strtoul(optarg, NULL, 0); break;
+    case 's': c->sensors_per_coordinator = strtoul(optarg, NULL, 0); break;
+    case OPT_COORD_RADIUS: c->coordinator_radius = atof(optarg); break;
+    case OPT_SENSOR_RADIUS: c->sensor_radius = atof(optarg); break;
+    case OPT_RANGE: c->tx_range = atof(optarg); break;
+    case OPT_INTERFERENCE: c->interference_range = atof(optarg); break;
+    case OPT_TX_RATIO: c->success_ratio_tx = atof(optarg); break;
+    case OPT_RX_RATIO: c->success_ratio_rx = atof(optarg); break;
+    case OPT_MAC_QUEUE: c->mac_queue = atoi(optarg); break;
+    case OPT_BACKOFF: c->backoff_us = atof(optarg); break;
+    case 't': c->duration = atof(optarg); break;
+    case OPT_WARMUP: c->warmup = atof(optarg); break;
+    case OPT_SEED: c->seed = strtoull(optarg, NULL, 0); break;
+    case OPT_BOOT_DELAY: c->boot_delay = atof(optarg); break;
+    case OPT_DRIFT: c->max_drift_ppm = atof(optarg); break;
+    case OPT_READING: c->reading = atoi(optarg); break;
+    case OPT_CSV: c->csv_file = optarg; break;
+    case OPT_LOG: c->log = 1; break;
+    case OPT_FW_DIR: c->fw_dir = optarg; break;
+    case OPT_SERIAL:
+      if(add_serial(c, optarg) < 0) {
+        usage(stderr);
+        return -1;
+      }
+      break;
+    case OPT_KILL:
+      if(add_kill(c, optarg) < 0) {
+        usage(stderr);
+        return -1;
+      }
+      break;
+    case 'h': usage(stdout); exit(0);
+    default: usage(stderr); return -1;
+    }
+  }
+  if(optind != argc || c->mac_queue < 1 || c->duration <= 0 ||
+     c->borders < 1) {
+    usage(stderr);
+    return -1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static const char *
+default_fw_dir(void)
+{
+  static char path[PATH_MAX];
+  ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+
+  if(len <= 0) {
+    return ".";
+  }
+  path[len] = '\0';
+  return dirname(path);
+}
+/*---------------------------------------------------------------------------*/
+static double
+wall_clock(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  static const char *fw_names[ROLE_COUNT] = { "border", "coordinator", "sensor" };
+  sim_time_t end;
+  struct event ev;
+  double started;
+  unsigned serial_next = 0;
+  uint32_t i;
+  int r;
+
+  if(parse_args(argc, argv) < 0) {
+    return 1;
+  }
+  for(i = 0; i < 65536; i++) {
+    sim.by_id[i] = -1;
+  }
+  sim.rng = sim.config.seed * 0x9e3779b97f4a7c15ULL + 1;
+
+  mote_init();
+  if(sim.config.fw_dir == NULL) {
+    sim.config.fw_dir = default_fw_dir();
+  }
+  for(r = 0; r < ROLE_COUNT; r++) {
+    if(firmware_load(&sim.fw[r], sim.config.fw_dir, fw_names[r]) < 0) {
+      return 1;
+    }
+  }
+
+  if(sim.config.csc_file != NULL) {
+    if(topology_load_csc(sim.config.csc_file) < 0) {
+      return 1;
+    }
+  } else if(topology_generate() < 0) {
+    return 1;
+  }
+  if(sim.n_motes == 0) {
+    fprintf(stderr, "hostsim: no motes\n");
+    return 1;
+  }
+
+  radio_init();
+  for(i = 0; i < sim.n_motes; i++) {
+    struct mote *m = &sim.motes[i];
+    mote_attach(m);
+    m->drift_ppm = (int32_t)((2 * sim_random() - 1) * sim.config.max_drift_ppm);
+    m->boot_at = (sim_time_t)(sim_random() * sim.config.boot_delay * SIM_SECOND);
+    events_push(m->boot_at, EV_BOOT, m->index);
+  }
+  /* In time order, the events of the same time pop in push order */
+  for(i = 0; i < sim.config.n_serial; i++) {
+    events_push((sim_time_t)(sim.config.serial[i].time * SIM_SECOND), EV_SERIAL, 0);
+  }
+  for(i = 0; i < sim.config.n_kill; i++) {
+    if(sim.by_id[sim.config.kill[i].id] < 0) {
+      fprintf(stderr, "hostsim: --kill: no mote %u\n", sim.config.kill[i].id);
+      return 1;
+    }
+    events_push((sim_time_t)(sim.config.kill[i].time * SIM_SECOND), EV_KILL,
+                sim.by_id[sim.config.kill[i].id]);
+  }
+  if(stats_open() < 0) {
+    return 1;
+  }
+
+  end = (sim_time_t)(sim.config.duration * SIM_SECOND);
+  started = wall_clock();
+  while(events_pop(&ev) && ev.time <= end) {
+    struct mote *m = &sim.motes[ev.mote];
+
+    sim.now = ev.time;
+    switch(ev.type) {
+    case EV_BOOT:
+      mote_boot(m);
+      break;
+    case EV_WAKE:
+      if(ev.time == m->wake_at) {
+        mote_wake(m);
+      }
+      break;
+    case EV_MAC:
+      mac_attempt(m);
+      break;
+    case EV_TX_END:
+      radio_tx_end(m);
+      break;
+    case EV_SERIAL:
+      for(i = 0; i < sim.n_motes; i++) {
+        if(sim.motes[i].role == ROLE_BORDER) {
+          mote_serial_input(&sim.motes[i], sim.config.serial[serial_next].line);
+        }
+      }
+      serial_next++;
+      break;
+    case EV_KILL:
+      mote_kill(m);
+      break;
+    }
+  }
+
+  stats_print(stdout, wall_clock() - started);
+  stats_close();
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,375 @@
+/*
+ * Motes: loading firmware images and switching between motes.
+ *
+ * Like Cooja's native motes, every firmware is loaded once and each mote
+ * owns a copy of its writable segment (.data, .bss, GOT). Before calling
+ * into a firmware the harness copies the mote's segment in, and copies it
+ * back out when another mote of the same firmware needs to run.
+ *
+ * A firmware that faults (for instance after writing past one of its
+ * arrays) only takes its own mote down: the mote is reported as crashed
+ * and never scheduled again, the rest of the network keeps running.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hostsim.h"
+
+struct segment_search {
+  ElfW(Addr) base;
+  uint8_t *start;
+  size_t len;
+  int found;
+};
+
+static const linkaddr_t broadcast_addr;
+static sigjmp_buf fault_jmp;
+static volatile sig_atomic_t in_firmware;
+/*---------------------------------------------------------------------------*/
+static int
+find_segment(struct dl_phdr_info *info, size_t size, void *data)
+{
+  struct segment_search *search = data;
+  int i;
+
+  (void)size;
+  if(info->dlpi_addr != search->base) {
+    return 0;
+  }
+  for(i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+    if(ph->p_type == PT_LOAD && (ph->p_flags & PF_W)) {
+      search->start = (uint8_t *)(info->dlpi_addr + ph->p_vaddr);
+      search->len = ph->p_memsz;
+      search->found++;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+firmware_load(struct firmware *fw, const char *dir, const char *name)
+{
+  char path[1024];
+  struct link_map *map;
+  struct segment_search search;
+
+  snprintf(path, sizeof(path), "%s/%s.so", dir, name);
+  fw->name = name;
+  fw->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if(fw->handle == NULL) {
+    fprintf(stderr, "hostsim: %s\n", dlerror());
+    return -1;
+  }
+  fw->api = dlsym(fw->handle, SIM_FW_SYMBOL);
+  if(fw->api == NULL || fw->api->version != SIM_API_VERSION) {
+    fprintf(stderr, "hostsim: %s does not export a matching %s\n",
+            path, SIM_FW_SYMBOL);
+    return -1;
+  }
+  if(dlinfo(fw->handle, RTLD_DI_LINKMAP, &map) != 0) {
+    fprintf(stderr, "hostsim: %s\n", dlerror());
+    return -1;
+  }
+
+  memset(&search, 0, sizeof(search));
+  search.base = map->l_addr;
+  dl_iterate_phdr(find_segment, &search);
+  if(search.found != 1) {
+    fprintf(stderr, "hostsim: %s must have exactly one writable segment "
+            "(link with -z norelro)\n", path);
+    return -1;
+  }
+  fw->segment = search.start;
+  fw->segment_len = search.len;
+  fw->pristine = malloc(fw->segment_len);
+  if(fw->pristine == NULL) {
+    return -1;
+  }
+  memcpy(fw->pristine, fw->segment, fw->segment_len);
+  fw->loaded = NULL;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+mote_load(struct mote *m)
+{
+  struct firmware *fw = m->fw;
+
+  if(fw->loaded != m) {
+    if(fw->loaded != NULL) {
+      memcpy(fw->loaded->image, fw->segment, fw->segment_len);
+    }
+    memcpy(fw->segment, m->image, fw->segment_len);
+    fw->loaded = m;
+  }
+  sim.current = m;
+}
+/*---------------------------------------------------------------------------*/
+static void
+fault_handler(int sig)
+{
+  if(in_firmware) {
+    in_firmware = 0;
+    siglongjmp(fault_jmp, sig);
+  }
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+/*---------------------------------------------------------------------------*/
+void
+mote_init(void)
+{
+  static char altstack[64 * 1024];
+  stack_t ss;
+  struct sigaction sa;
+
+  /* Run the handler on its own stack in case the firmware smashed it */
+  ss.ss_sp = altstack;
+  ss.ss_size = sizeof(altstack);
+  ss.ss_flags = 0;
+  sigaltstack(&ss, NULL);
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = fault_handler;
+  sa.sa_flags = SA_ONSTACK;
+  sigaction(SIGSEGV, &sa, NULL);
+  sigaction(SIGBUS, &sa, NULL);
+  sigaction(SIGFPE, &sa, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+mote_crashed(struct mote *m, int sig)
+{
+  m->crashed = 1;
+  m->wake_at = 0;
+  m->fw->loaded = NULL;
+  sim.current = NULL;
+  fprintf(stderr, "hostsim: %.6f mote %u (%s) crashed with signal %d\n",
+          (double)sim.now / SIM_SECOND, m->id, m->fw->name, sig);
+}
+/*---------------------------------------------------------------------------*/
+static uint64_t
+local_time(const struct mote *m, sim_time_t t)
+{
+  __int128 dt = t - m->boot_at;
+
+  return (uint64_t)(dt + dt * m->drift_ppm / 1000000);
+}
+/*---------------------------------------------------------------------------*/
+static sim_time_t
+global_time(const struct mote *m, uint64_t local)
+{
+  __int128 num = (__int128)local * 1000000;
+  __int128 den = 1000000 + m->drift_ppm;
+
+  return m->boot_at + (sim_time_t)((num + den - 1) / den);
+}
+/*---------------------------------------------------------------------------*/
+static void
+schedule_wakeup(struct mote *m)
+{
+  uint64_t local;
+  sim_time_t at;
+
+  if(!m->fw->api->next_wakeup(&local)) {
+    m->wake_at = 0;
+    return;
+  }
+  at = global_time(m, local);
+  if(at <= sim.now) {
+    at = sim.now + 1;
+  }
+  if(at != m->wake_at) {
+    m->wake_at = at;
+    events_push(at, EV_WAKE, m->index);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+host_radio_send(const void *data, uint16_t len, const linkaddr_t *dest)
+{
+  mac_send(sim.current, data, len, dest);
+}
+/*---------------------------------------------------------------------------*/
+static void
+host_radio_channel(int channel)
+{
+  struct mote *m = sim.current;
+
+  if(channel < RADIO_CHANNEL_MIN ||
+     channel >= RADIO_CHANNEL_MIN + RADIO_CHANNELS ||
+     channel - RADIO_CHANNEL_MIN == m->channel) {
+    return;
+  }
+  m->channel = channel - RADIO_CHANNEL_MIN;
+  /* The frame being received is lost */
+  m->rx_lock = -1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+host_radio_power(int on)
+{
+  struct mote *m = sim.current;
+
+  if(on && m->radio_off) {
+    m->radio_off = 0;
+    m->radio_since = sim.now;
+  } else if(!on && !m->radio_off) {
+    m->radio_off = 1;
+    m->stats.radio_on_us += sim.now - m->radio_since;
+    /* The frame being received is lost */
+    m->rx_lock = -1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+mote_serial_text(struct mote *m, char c)
+{
+  if(c == '\n') {
+    m->line[m->line_len] = '\0';
+    stats_serial_line(m, m->line);
+    m->line_len = 0;
+  } else if(m->line_len < (int)sizeof(m->line) - 1) {
+    m->line[m->line_len++] = c;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+host_serial_write(const char *buf, int len)
+{
+  struct mote *m = sim.current;
+  int i;
+
+  for(i = 0; i < len; i++) {
+    /* The border mixes report frames with its log lines */
+    if(m->role == ROLE_BORDER) {
+      stats_border_byte(m, (uint8_t)buf[i]);
+    } else {
+      mote_serial_text(m, buf[i]);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static const struct sim_host_api host_api = {
+  host_radio_send,
+  host_serial_write,
+  host_radio_power,
+  host_radio_channel,
+};
+/*---------------------------------------------------------------------------*/
+/* Call into the loaded firmware, then reschedule the mote's timers */
+#define FIRMWARE_CALL(m, call)                          \
+  do {                                                  \
+    int sig = sigsetjmp(fault_jmp, 1);                  \
+    if(sig == 0) {                                      \
+      in_firmware = 1;                                  \
+      (m)->fw->api->call;                               \
+      in_firmware = 0;                                  \
+      schedule_wakeup(m);                               \
+      sim.current = NULL;                               \
+    } else {                                            \
+      mote_crashed(m, sig);                             \
+    }                                                   \
+  } while(0)
+/*---------------------------------------------------------------------------*/
+void
+mote_attach(struct mote *m)
+{
+  m->fw = &sim.fw[m->role];
+  m->image = malloc(m->fw->segment_len);
+  m->mac.queue = calloc(sim.config.mac_queue, sizeof(struct frame));
+  if(m->image == NULL || m->mac.queue == NULL) {
+    abort();
+  }
+  memcpy(m->image, m->fw->pristine, m->fw->segment_len);
+  m->rx_lock = -1;
+  m->channel = RADIO_DEFAULT_CHANNEL - RADIO_CHANNEL_MIN;
+}
+/*---------------------------------------------------------------------------*/
+void
+mote_boot(struct mote *m)
+{
+  struct sim_fw_config config;
+
+  config.node_id = m->id;
+  config.seed = (uint32_t)(sim.config.seed * 2654435761u) ^ m->id;
+  config.fixed_rand = sim.config.reading;
+  config.log_enabled = sim.config.log;
+  config.host = &host_api;
+
+  mote_load(m);
+  m->booted = 1;
+  m->radio_since = sim.now;
+  FIRMWARE_CALL(m, boot(&config, local_time(m, sim.now)));
+}
+/*---------------------------------------------------------------------------*/
+void
+mote_wake(struct mote *m)
+{
+  m->wake_at = 0;
+  if(m->crashed) {
+    return;
+  }
+  mote_load(m);
+  FIRMWARE_CALL(m, run(local_time(m, sim.now)));
+}
+/*---------------------------------------------------------------------------*/
+void
+mote_input(struct mote *m, const struct frame *f, const struct mote *src,
+           int rssi)
+{
+  linkaddr_t src_addr;
+
+  if(!m->booted || m->crashed) {
+    return;
+  }
+  memset(&src_addr, 0, sizeof(src_addr));
+  src_addr.u8[0] = src->id & 0xff;
+  src_addr.u8[1] = src->id >> 8;
+
+  mote_load(m);
+  FIRMWARE_CALL(m, input(local_time(m, sim.now), f->data, f->len, &src_addr,
+                         f->broadcast ? &broadcast_addr : &f->dest, rssi));
+}
+/*---------------------------------------------------------------------------*/
+/* As if its battery ran out: it neither runs, listens nor acknowledges */
+void
+mote_kill(struct mote *m)
+{
+  if(m->killed) {
+    return;
+  }
+  m->killed = 1;
+  m->crashed = 1;
+  m->wake_at = 0;
+  if(m->booted && !m->radio_off) {
+    m->radio_off = 1;
+    m->stats.radio_on_us += sim.now - m->radio_since;
+  }
+  m->rx_lock = -1;
+  sim.n_killed[m->role]++;
+}
+/*---------------------------------------------------------------------------*/
+void
+mote_serial_input(struct mote *m, const char *line)
+{
+  char buf[256];
+  int len;
+
+  if(!m->booted || m->crashed) {
+    return;
+  }
+  len = snprintf(buf, sizeof(buf), "%s\n", line);
+  if(len > (int)sizeof(buf) - 1) {
+    len = sizeof(buf) - 1;
+    buf[len - 1] = '\n';
+  }
+  mote_load(m);
+  FIRMWARE_CALL(m, serial_input(local_time(m, sim.now), buf, len));
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,318 @@
+/*
+ * Radio medium and MAC.
+ *
+ * The medium follows Cooja's UDGM: a frame reaches every mote within the
+ * transmission range with probability 1 - (d/R)^2 (1 - success_ratio_rx),
+ * and any other signal within the interference range during the frame
+ * corrupts it. Radios are half duplex and clear channel assessment only
+ * sees signals that started at least one turnaround time earlier. Only
+ * the motes on the channel of a frame hear it or are disturbed by it.
+ *
+ * The MAC mirrors Contiki-NG's CSMA: random backoff of up to 2^BE - 1
+ * clock ticks before each attempt, BE growing with busy channels,
+ * retransmission of unacknowledged unicast frames, and a bounded queue.
+ * A mote whose radio is off receives nothing, but still transmits (the
+ * CC2420 turns on to send): it only misses the ack.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hostsim.h"
+
+#define PHY_OVERHEAD 6            /* preamble, SFD, length */
+#define MAC_OVERHEAD_UNICAST 23   /* FCF, seqno, PAN, 2 x 8-byte addr, FCS */
+#define MAC_OVERHEAD_BROADCAST 17 /* short broadcast destination */
+#define BYTE_US 32                /* 250 kbit/s */
+#define TURNAROUND_US 192
+#define ACK_US (TURNAROUND_US + 11 * BYTE_US)
+
+#define CSMA_MIN_BE 3
+#define CSMA_MAX_BE 5
+#define CSMA_MAX_BACKOFF 5
+#define CSMA_MAX_FRAME_RETRIES 7
+
+#define SS_STRONG -10
+#define SS_WEAK -95
+/*---------------------------------------------------------------------------*/
+static int
+cell_of(double v, double origin, double size)
+{
+  return (int)floor((v - origin) / size);
+}
+/*---------------------------------------------------------------------------*/
+void
+radio_init(void)
+{
+  double range = sim.config.interference_range;
+  double min_x = 0, min_y = 0, max_x = 0, max_y = 0;
+  uint32_t i, *cell_start, *cell_motes;
+  int w, h;
+
+  if(range < sim.config.tx_range) {
+    range = sim.config.tx_range;
+  }
+  for(i = 0; i < sim.n_motes; i++) {
+    struct mote *m = &sim.motes[i];
+    if(i == 0 || m->x < min_x) min_x = m->x;
+    if(i == 0 || m->y < min_y) min_y = m->y;
+    if(i == 0 || m->x > max_x) max_x = m->x;
+    if(i == 0 || m->y > max_y) max_y = m->y;
+  }
+  w = cell_of(max_x, min_x, range) + 1;
+  h = cell_of(max_y, min_y, range) + 1;
+
+  /* Bucket motes by grid cell so neighbors come from the 3x3 block */
+  cell_start = calloc((size_t)w * h + 1, sizeof(uint32_t));
+  cell_motes = malloc(sim.n_motes * sizeof(uint32_t));
+  if(cell_start == NULL || cell_motes == NULL) {
+    abort();
+  }
+  for(i = 0; i < sim.n_motes; i++) {
+    struct mote *m = &sim.motes[i];
+    cell_start[cell_of(m->y, min_y, range) * w +
+               cell_of(m->x, min_x, range) + 1]++;
+  }
+  for(i = 1; i <= (uint32_t)(w * h); i++) {
+    cell_start[i] += cell_start[i - 1];
+  }
+  {
+    uint32_t *fill = malloc(((size_t)w * h) * sizeof(uint32_t));
+    if(fill == NULL) {
+      abort();
+    }
+    memcpy(fill, cell_start, (size_t)w * h * sizeof(uint32_t));
+    for(i = 0; i < sim.n_motes; i++) {
+      struct mote *m = &sim.motes[i];
+      cell_motes[fill[cell_of(m->y, min_y, range) * w +
+                      cell_of(m->x, min_x, range)]++] = i;
+    }
+    free(fill);
+  }
+
+  for(i = 0; i < sim.n_motes; i++) {
+    struct mote *m = &sim.motes[i];
+    int cx = cell_of(m->x, min_x, range);
+    int cy = cell_of(m->y, min_y, range);
+    uint32_t cap = 0;
+    int dx, dy;
+
+    for(dy = -1; dy <= 1; dy++) {
+      for(dx = -1; dx <= 1; dx++) {
+        int x = cx + dx, y = cy + dy;
+        uint32_t k;
+        if(x < 0 || y < 0 || x >= w || y >= h) {
+          continue;
+        }
+        for(k = cell_start[y * w + x]; k < cell_start[y * w + x + 1]; k++) {
+          struct mote *n = &sim.motes[cell_motes[k]];
+          double d = hypot(n->x - m->x, n->y - m->y);
+          if(n == m || d > range) {
+            continue;
+          }
+          if(m->n_neighbors == cap) {
+            cap = cap ? 2 * cap : 16;
+            m->neighbors = realloc(m->neighbors, cap * sizeof(struct neighbor));
+            if(m->neighbors == NULL) {
+              abort();
+            }
+          }
+          m->neighbors[m->n_neighbors].mote = n->index;
+          m->neighbors[m->n_neighbors].distance = (float)d;
+          m->n_neighbors++;
+        }
+      }
+    }
+  }
+  free(cell_start);
+  free(cell_motes);
+}
+/*---------------------------------------------------------------------------*/
+static sim_time_t
+backoff(const struct mote *m)
+{
+  int be = m->mac.collisions + CSMA_MIN_BE;
+  uint32_t slots;
+
+  if(be > CSMA_MAX_BE) {
+    be = CSMA_MAX_BE;
+  }
+  slots = (1u << be) - 1;
+  return (sim_time_t)((sim_random_u32() % slots) * sim.config.backoff_us);
+}
+/*---------------------------------------------------------------------------*/
+static void
+schedule_attempt(struct mote *m, sim_time_t delay)
+{
+  m->mac.state = MAC_BACKOFF;
+  events_push(sim.now + delay, EV_MAC, m->index);
+}
+/*---------------------------------------------------------------------------*/
+void
+mac_send(struct mote *m, const void *data, uint16_t len,
+         const linkaddr_t *dest)
+{
+  struct mac *mac = &m->mac;
+  struct frame *f;
+  unsigned overhead = dest ? MAC_OVERHEAD_UNICAST : MAC_OVERHEAD_BROADCAST;
+
+  if(mac->count == sim.config.mac_queue || len + overhead > FRAME_MAX) {
+    m->stats.mac_queue_drops++;
+    return;
+  }
+  f = &mac->queue[(mac->head + mac->count) % sim.config.mac_queue];
+  memcpy(f->data, data, len);
+  f->len = len;
+  f->broadcast = dest == NULL;
+  if(dest != NULL) {
+    f->dest = *dest;
+  }
+  if(mac->count++ == 0) {
+    mac->collisions = 0;
+    mac->transmissions = 0;
+    schedule_attempt(m, backoff(m));
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+next_frame(struct mote *m, sim_time_t delay)
+{
+  struct mac *mac = &m->mac;
+
+  mac->head = (mac->head + 1) % sim.config.mac_queue;
+  mac->count--;
+  mac->collisions = 0;
+  mac->transmissions = 0;
+  if(mac->count > 0) {
+    schedule_attempt(m, delay + backoff(m));
+  } else {
+    mac->state = MAC_IDLE;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static sim_time_t
+airtime(const struct frame *f)
+{
+  unsigned overhead = f->broadcast ? MAC_OVERHEAD_BROADCAST
+                                   : MAC_OVERHEAD_UNICAST;
+  return (sim_time_t)(PHY_OVERHEAD + overhead + f->len) * BYTE_US;
+}
+/*---------------------------------------------------------------------------*/
+static int
+channel_clear(const struct mote *m)
+{
+  return m->rx_signals[m->channel] == 0 ||
+         sim.now - m->rx_first_start[m->channel] < TURNAROUND_US;
+}
+/*---------------------------------------------------------------------------*/
+void
+mac_attempt(struct mote *m)
+{
+  struct mac *mac = &m->mac;
+  const struct frame *f = &mac->queue[mac->head];
+  uint8_t c = m->channel;
+  uint32_t i;
+
+  if(m->killed) {
+    /* its queue goes with it */
+    mac->count = 0;
+    mac->state = MAC_IDLE;
+    return;
+  }
+  if(!channel_clear(m)) {
+    if(++mac->collisions > CSMA_MAX_BACKOFF) {
+      m->stats.mac_busy_drops++;
+      next_frame(m, 0);
+    } else {
+      schedule_attempt(m, backoff(m));
+    }
+    return;
+  }
+
+  mac->state = MAC_TX;
+  mac->acked = 0;
+  mac->tx_channel = c;
+  m->transmitting = 1;
+  m->stats.tx_frames++;
+  m->stats.tx_bytes += f->len;
+  if(m->radio_off) {
+    m->stats.radio_on_us += airtime(f);
+  }
+  if(m->rx_lock >= 0) {
+    m->rx_corrupt = 1;
+  }
+  for(i = 0; i < m->n_neighbors; i++) {
+    struct mote *n = &sim.motes[m->neighbors[i].mote];
+    if(n->rx_signals[c]++ == 0) {
+      n->rx_first_start[c] = sim.now;
+      if(!n->transmitting && !n->radio_off && n->channel == c &&
+         m->neighbors[i].distance <= sim.config.tx_range) {
+        n->rx_lock = m->index;
+        n->rx_corrupt = 0;
+      }
+    } else if(n->rx_lock >= 0 && n->channel == c) {
+      n->rx_corrupt = 1;
+    }
+  }
+  events_push(sim.now + airtime(f), EV_TX_END, m->index);
+}
+/*---------------------------------------------------------------------------*/
+static int
+rssi_at(double distance)
+{
+  return (int)(SS_STRONG + distance / sim.config.tx_range * (SS_WEAK - SS_STRONG));
+}
+/*---------------------------------------------------------------------------*/
+static int
+accepts(const struct mote *n, const struct frame *f)
+{
+  return f->broadcast ||
+         (f->dest.u8[0] | (f->dest.u8[1] << 8)) == n->id;
+}
+/*---------------------------------------------------------------------------*/
+void
+radio_tx_end(struct mote *m)
+{
+  struct mac *mac = &m->mac;
+  const struct frame *f = &mac->queue[mac->head];
+  int tx_ok = sim_random() < sim.config.success_ratio_tx;
+  uint32_t i;
+
+  m->transmitting = 0;
+  for(i = 0; i < m->n_neighbors; i++) {
+    struct mote *n = &sim.motes[m->neighbors[i].mote];
+    double d = m->neighbors[i].distance;
+    double ratio = (d * d) / (sim.config.tx_range * sim.config.tx_range);
+
+    n->rx_signals[mac->tx_channel]--;
+    if(n->rx_lock != (int64_t)m->index) {
+      continue;
+    }
+    n->rx_lock = -1;
+    if(n->rx_corrupt || !tx_ok) {
+      n->stats.rx_collided++;
+      continue;
+    }
+    if(sim_random() >= 1.0 - ratio * (1.0 - sim.config.success_ratio_rx)) {
+      n->stats.rx_lost++;
+      continue;
+    }
+    if(!accepts(n, f)) {
+      continue;
+    }
+    n->stats.rx_frames++;
+    if(!f->broadcast && !m->radio_off) {
+      mac->acked = 1;
+    }
+    mote_input(n, f, m, rssi_at(d));
+  }
+
+  if(f->broadcast || mac->acked) {
+    next_frame(m, f->broadcast ? 0 : ACK_US);
+  } else if(++mac->transmissions > CSMA_MAX_FRAME_RETRIES) {
+    m->stats.mac_noack_drops++;
+    next_frame(m, ACK_US);
+  } else {
+    schedule_attempt(m, ACK_US + backoff(m));
+  }
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,448 @@
+/*
+ * Measurements: the border's per-period report frames, and radio/MAC
+ * counters summed over all motes.
+ *
+ * Every sensor adds one reading per period to the aggregate, so the
+ * number of readings the border got, over the number of sensors, is the
+ * delivery ratio of the period; the stand-ins for lost answers the
+ * aggregate counts apart (see aggregate.h) are left out of it. With several borders, each gets the
+ * readings of its own coordinators: their reports add up to a period of
+ * the network, over when a border reports again or all of them have.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "hostsim.h"
+
+/* Border report frame, see border.c */
+#define REPORT_MAGIC_0 0xA5
+#define REPORT_MAGIC_1 0x5A
+#define REPORT_VERSION 7
+#define REPORT_HEADER_LEN 14
+#define REPORT_TRACE_LEN(hops) ((hops) > 0 ? 1 + 2 * (hops) : 0)
+#define REPORT_AGGREGATE_LEN(buckets, hops) \
+  (13 + 2 * (buckets) + REPORT_TRACE_LEN(hops))
+#define REPORT_ENTRY_LEN(hops) (25 + REPORT_TRACE_LEN(hops))
+#define REPORT_ENTRY_SYNC_ERROR 10
+#define REPORT_ENTRY_PEAK_NODE 19
+#define REPORT_ENTRY_PEAK_CURRENT 21
+#define REPORT_ENTRY_CURRENT 23
+#define REPORT_ENTRY_TRACE 25
+#define TRACE_MAX_HOPS 16
+
+static FILE *csv;
+/* Network period under way */
+static struct {
+  unsigned borders;
+  unsigned border; /* the one that reported, if only one did */
+  unsigned seq;
+  uint32_t net_clock;
+  unsigned coordinators;
+  unsigned long count;
+  unsigned long filled; /* of count, stand-ins */
+  uint32_t sum;
+  unsigned min;
+  unsigned max;
+  unsigned latency;
+} period;
+static uint64_t reports;
+static uint64_t missing_reports;
+static uint64_t refused_joins; /* coordinators a full border turned away */
+static uint64_t steady_reports;
+static uint64_t complete_reports;
+static double steady_ratio_sum;
+static double steady_filled_sum; /* stand-ins per sensor */
+static unsigned max_filled_age;
+static double first_complete = -1;
+static unsigned max_sync_error;
+/* Currents the coordinators report, in uA */
+static double current_sum;
+static uint64_t current_entries;
+static unsigned max_current;
+static unsigned peak_current;
+static unsigned peak_node;
+/* Traces of the oldest reading of each coordinator, in ms */
+static uint64_t traces;
+static double latency_sum;
+static unsigned latency_max;
+static double hop_sum[TRACE_MAX_HOPS];
+static uint64_t hop_count[TRACE_MAX_HOPS];
+/*---------------------------------------------------------------------------*/
+int
+stats_open(void)
+{
+  if(sim.config.csv_file == NULL) {
+    return 0;
+  }
+  csv = fopen(sim.config.csv_file, "w");
+  if(csv == NULL) {
+    perror(sim.config.csv_file);
+    return -1;
+  }
+  fprintf(csv, "time_s,border,seq,net_clock,coordinators,readings,sum,min,"
+          "max,sensors,delivery_ratio,frames_sent,oldest_reading_ms,"
+          "filled\n");
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned
+get_u16(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8);
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+get_u32(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+/*---------------------------------------------------------------------------*/
+/* Frames all motes sent since the start */
+static uint64_t
+frames_sent(void)
+{
+  uint64_t frames = 0;
+  uint32_t i;
+
+  for(i = 0; i < sim.n_motes; i++) {
+    frames += sim.motes[i].stats.tx_frames;
+  }
+  return frames;
+}
+/*---------------------------------------------------------------------------*/
+static void
+period_flush(void)
+{
+  double t = (double)sim.now / SIM_SECOND;
+  unsigned long expected = sim.n_role[ROLE_SENSOR] - sim.n_killed[ROLE_SENSOR];
+  unsigned long fresh = period.count - period.filled;
+  double ratio = expected ? (double)fresh / expected : 0;
+  uint32_t i;
+
+  if(expected && fresh >= expected && first_complete < 0) {
+    first_complete = t;
+  }
+  if(t >= sim.config.warmup) {
+    steady_reports++;
+    steady_ratio_sum += ratio;
+    steady_filled_sum += expected ? (double)period.filled / expected : 0;
+    if(expected && fresh >= expected) {
+      complete_reports++;
+    }
+  }
+  if(csv != NULL) {
+    fprintf(csv, "%.3f,%u,%u,%u,%u,%lu,%u,%u,%u,%lu,%.4f,%llu,%u,%lu\n", t,
+            period.border, period.seq, period.net_clock, period.coordinators,
+            period.count, period.sum, period.min, period.max, expected, ratio,
+            (unsigned long long)frames_sent(), period.latency, period.filled);
+  }
+  memset(&period, 0, sizeof(period));
+  for(i = 0; i < sim.n_motes; i++) {
+    sim.motes[i].in_period = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+border_report(struct mote *m, const uint8_t *frame)
+{
+  double t = (double)sim.now / SIM_SECOND;
+  unsigned coordinators = frame[3];
+  unsigned trace_hops = frame[5];
+  unsigned seq = frame[6] | (frame[7] << 8);
+  uint32_t net_clock = get_u32(frame + 8);
+  unsigned refused = get_u16(frame + 12);
+  const uint8_t *aggregate = frame + REPORT_HEADER_LEN;
+  const uint8_t *entries = aggregate + REPORT_AGGREGATE_LEN(frame[4], trace_hops);
+  uint32_t sum = get_u32(aggregate);
+  unsigned long count = aggregate[4] | (aggregate[5] << 8);
+  unsigned min = aggregate[6] | (aggregate[7] << 8);
+  unsigned max = aggregate[8] | (aggregate[9] << 8);
+  unsigned filled = aggregate[10] | (aggregate[11] << 8);
+  unsigned filled_age = aggregate[12];
+  const uint8_t *e;
+  unsigned error;
+  unsigned current;
+  unsigned latency;
+  unsigned report_latency = 0; /* oldest reading of the report, in ms */
+  unsigned hops;
+  unsigned i, j;
+
+  if(m->reports++ > 0) {
+    missing_reports += (uint16_t)(seq - m->report_seq - 1);
+  }
+  m->report_seq = seq;
+  reports++;
+  refused_joins += refused;
+  if(m->in_period) {
+    period_flush();
+  }
+  for(i = 0; i < coordinators; i++) {
+    e = entries + i * REPORT_ENTRY_LEN(trace_hops);
+    hops = trace_hops > 0 ? e[REPORT_ENTRY_TRACE] : 0;
+    latency = 0;
+    for(j = 0; j < hops && j < trace_hops; j++) {
+      latency += get_u16(e + REPORT_ENTRY_TRACE + 1 + 2 * j);
+    }
+    if(latency > report_latency) {
+      report_latency = latency;
+    }
+    if(t < sim.config.warmup) {
+      continue;
+    }
+    error = e[REPORT_ENTRY_SYNC_ERROR];
+    if(error > max_sync_error) {
+      max_sync_error = error;
+    }
+    current = e[REPORT_ENTRY_CURRENT] | (e[REPORT_ENTRY_CURRENT + 1] << 8);
+    if(current > 0) {
+      current_sum += current;
+      current_entries++;
+      if(current > max_current) {
+        max_current = current;
+      }
+    }
+    current = e[REPORT_ENTRY_PEAK_CURRENT] | (e[REPORT_ENTRY_PEAK_CURRENT + 1] << 8);
+    if(current > peak_current) {
+      peak_current = current;
+      peak_node = e[REPORT_ENTRY_PEAK_NODE] | (e[REPORT_ENTRY_PEAK_NODE + 1] << 8);
+    }
+    if(hops > 0) {
+      for(j = 0; j < hops && j < trace_hops && j < TRACE_MAX_HOPS; j++) {
+        hop_sum[j] += get_u16(e + REPORT_ENTRY_TRACE + 1 + 2 * j);
+        hop_count[j]++;
+      }
+      traces++;
+      latency_sum += latency;
+      if(latency > latency_max) {
+        latency_max = latency;
+      }
+    }
+  }
+  m->in_period = 1;
+  period.border = period.borders++ == 0 ? m->id : 0;
+  period.seq = seq;
+  period.net_clock = net_clock;
+  period.coordinators += coordinators;
+  if(count > 0) {
+    if(period.count == 0 || min < period.min) {
+      period.min = min;
+    }
+    if(period.count == 0 || max > period.max) {
+      period.max = max;
+    }
+  }
+  period.count += count;
+  period.filled += filled;
+  period.sum += sum;
+  if(filled > 0 && t >= sim.config.warmup && filled_age > max_filled_age) {
+    max_filled_age = filled_age;
+  }
+  if(report_latency > period.latency) {
+    period.latency = report_latency;
+  }
+  if(period.borders == sim.n_role[ROLE_BORDER]) {
+    period_flush();
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+stats_serial_line(struct mote *m, const char *line)
+{
+  if(sim.config.log) {
+    printf("%.6f ID:%u %s\n", (double)sim.now / SIM_SECOND, m->id, line);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+crc16(const uint8_t *data, int len)
+{
+  unsigned short acc = 0;
+  int i;
+
+  /* Contiki's lib/crc16.c */
+  for(i = 0; i < len; i++) {
+    acc ^= data[i];
+    acc = (acc >> 8) | (acc << 8);
+    acc ^= (acc & 0xff00) << 4;
+    acc ^= (acc >> 8) >> 4;
+    acc ^= (acc & 0xff00) >> 5;
+  }
+  return acc;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the length of the frame at the start of the buffer, 0 if more
+ * bytes are needed, or -1 if the first byte does not start a frame.
+ */
+static int
+report_frame_len(const uint8_t *buf, int len)
+{
+  int frame_len;
+
+  if(len < 1) {
+    return 0;
+  }
+  if(buf[0] != REPORT_MAGIC_0) {
+    return -1;
+  }
+  if(len < 4) {
+    return 0;
+  }
+  if(len < REPORT_HEADER_LEN) {
+    return 0;
+  }
+  if(buf[1] != REPORT_MAGIC_1 || buf[2] != REPORT_VERSION) {
+    return -1;
+  }
+  frame_len = REPORT_HEADER_LEN + REPORT_AGGREGATE_LEN(buf[4], buf[5]) +
+              buf[3] * REPORT_ENTRY_LEN(buf[5]) + 2;
+  if(len < frame_len) {
+    return 0;
+  }
+  if(crc16(buf + 2, frame_len - 4) != get_u16(buf + frame_len - 2)) {
+    return -1;
+  }
+  return frame_len;
+}
+/*---------------------------------------------------------------------------*/
+void
+stats_border_byte(struct mote *m, uint8_t c)
+{
+  int len;
+
+  m->report[m->report_len++] = c;
+  while((len = report_frame_len(m->report, m->report_len)) != 0) {
+    if(len < 0) {
+      /* Not a frame: log text, pass the first byte on and resync */
+      mote_serial_text(m, (char)m->report[0]);
+      len = 1;
+    } else {
+      border_report(m, m->report);
+    }
+    m->report_len -= len;
+    memmove(m->report, m->report + len, m->report_len);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Share of the time since boot the radio of the mote was on */
+static double
+radio_on_ratio(const struct mote *m)
+{
+  uint64_t on = m->stats.radio_on_us;
+
+  if(!m->booted || sim.now <= m->boot_at) {
+    return 0;
+  }
+  if(!m->radio_off) {
+    on += sim.now - m->radio_since;
+  }
+  return (double)on / (sim.now - m->boot_at);
+}
+/*---------------------------------------------------------------------------*/
+void
+stats_print(FILE *out, double wall_seconds)
+{
+  struct mote_stats total;
+  double simulated = sim.config.duration;
+  uint32_t crashed = 0;
+  double radio_sum[ROLE_COUNT] = { 0 };
+  double radio_max[ROLE_COUNT] = { 0 };
+  uint32_t i;
+
+  memset(&total, 0, sizeof(total));
+  for(i = 0; i < sim.n_motes; i++) {
+    const struct mote_stats *s = &sim.motes[i].stats;
+    double radio = radio_on_ratio(&sim.motes[i]);
+    crashed += sim.motes[i].crashed && !sim.motes[i].killed;
+    radio_sum[sim.motes[i].role] += radio;
+    if(radio > radio_max[sim.motes[i].role]) {
+      radio_max[sim.motes[i].role] = radio;
+    }
+    total.tx_frames += s->tx_frames;
+    total.tx_bytes += s->tx_bytes;
+    total.rx_frames += s->rx_frames;
+    total.rx_collided += s->rx_collided;
+    total.rx_lost += s->rx_lost;
+    total.mac_noack_drops += s->mac_noack_drops;
+    total.mac_busy_drops += s->mac_busy_drops;
+    total.mac_queue_drops += s->mac_queue_drops;
+  }
+
+  fprintf(out, "motes            %u borders, %u coordinators, %u sensors\n",
+          sim.n_role[ROLE_BORDER], sim.n_role[ROLE_COORDINATOR],
+          sim.n_role[ROLE_SENSOR]);
+  fprintf(out, "simulated        %.1f s in %.2f s wall (%.0fx real time)\n",
+          simulated, wall_seconds,
+          wall_seconds > 0 ? simulated / wall_seconds : 0);
+  fprintf(out, "border reports   %llu", (unsigned long long)reports);
+  if(missing_reports > 0) {
+    fprintf(out, " (%llu missing)", (unsigned long long)missing_reports);
+  }
+  if(refused_joins > 0) {
+    fprintf(out, ", %llu joins refused", (unsigned long long)refused_joins);
+  }
+  fprintf(out, "\n");
+  if(sim.n_role[ROLE_SENSOR] > 0) {
+    if(first_complete >= 0) {
+      fprintf(out, "first full round %.1f s\n", first_complete);
+    } else {
+      fprintf(out, "first full round never\n");
+    }
+    fprintf(out, "after warmup     delivery ratio %.3f, complete rounds %llu/%llu\n",
+            steady_reports ? steady_ratio_sum / steady_reports : 0,
+            (unsigned long long)complete_reports,
+            (unsigned long long)steady_reports);
+    if(steady_filled_sum > 0) {
+      fprintf(out, "stand-ins        %.3f of the sensors, %u rounds old at most\n",
+              steady_filled_sum / steady_reports, max_filled_age);
+    }
+  }
+  if(sim.n_role[ROLE_COORDINATOR] > 0) {
+    fprintf(out, "sync error bound %u ticks at most after warmup\n",
+            max_sync_error);
+  }
+  fprintf(out, "frames           %llu sent (%llu payload bytes), %llu received, "
+          "%llu collided, %llu lost\n",
+          (unsigned long long)total.tx_frames,
+          (unsigned long long)total.tx_bytes,
+          (unsigned long long)total.rx_frames,
+          (unsigned long long)total.rx_collided,
+          (unsigned long long)total.rx_lost);
+  fprintf(out, "mac drops        %llu no ack, %llu channel busy, %llu queue full\n",
+          (unsigned long long)total.mac_noack_drops,
+          (unsigned long long)total.mac_busy_drops,
+          (unsigned long long)total.mac_queue_drops);
+  if(sim.n_role[ROLE_COORDINATOR] > 0 && sim.n_role[ROLE_SENSOR] > 0) {
+    fprintf(out, "radio on         coordinators %.1f%% (max %.1f%%), "
+            "sensors %.1f%% (max %.1f%%)\n",
+            100 * radio_sum[ROLE_COORDINATOR] / sim.n_role[ROLE_COORDINATOR],
+            100 * radio_max[ROLE_COORDINATOR],
+            100 * radio_sum[ROLE_SENSOR] / sim.n_role[ROLE_SENSOR],
+            100 * radio_max[ROLE_SENSOR]);
+  }
+  if(current_entries > 0) {
+    fprintf(out, "energest current coordinators %.0f uA (max %u uA), "
+            "highest node %u at %u uA\n",
+            current_sum / current_entries, max_current, peak_node,
+            peak_current);
+  }
+  if(traces > 0) {
+    fprintf(out, "oldest reading   %.0f ms on average, %u ms at most; "
+            "per hop", latency_sum / traces, latency_max);
+    for(i = 0; i < TRACE_MAX_HOPS && hop_count[i] > 0; i++) {
+      fprintf(out, " %.0f", hop_sum[i] / hop_count[i]);
+    }
+    fprintf(out, " ms\n");
+  }
+  if(crashed > 0) {
+    fprintf(out, "crashed motes    %u\n", crashed);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+stats_close(void)
+{
+  if(csv != NULL) {
+    fclose(csv);
+  }
+}
+/*---------------------------------------------------------------------------*/
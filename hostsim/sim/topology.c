@@ -0,0 +1,210 @@
+/*
+ * Topologies: either read from a Cooja .csc file (mote types, positions,
+ * ids and UDGM parameters) or generated as clusters: coordinators spread
+ * around the border, sensors spread around their coordinator. Several
+ * borders stand on a small circle in the middle, each coordinator hears
+ * all of them.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hostsim.h"
+
+static uint32_t capacity;
+/*---------------------------------------------------------------------------*/
+struct mote *
+topology_add(enum mote_role role, uint16_t id, double x, double y)
+{
+  struct mote *m;
+
+  if(sim.by_id[id] >= 0) {
+    fprintf(stderr, "hostsim: duplicate mote id %u\n", id);
+    return NULL;
+  }
+  if(sim.n_motes == capacity) {
+    capacity = capacity ? 2 * capacity : 64;
+    sim.motes = realloc(sim.motes, capacity * sizeof(struct mote));
+    if(sim.motes == NULL) {
+      abort();
+    }
+  }
+  m = &sim.motes[sim.n_motes];
+  memset(m, 0, sizeof(*m));
+  m->index = sim.n_motes++;
+  m->id = id;
+  m->role = role;
+  m->x = x;
+  m->y = y;
+  sim.by_id[id] = m->index;
+  sim.n_role[role]++;
+  return m;
+}
+/*---------------------------------------------------------------------------*/
+static char *
+read_file(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  char *buf;
+  long len;
+
+  if(f == NULL) {
+    perror(path);
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  buf = malloc(len + 1);
+  if(buf == NULL || fread(buf, 1, len, f) != (size_t)len) {
+    fclose(f);
+    free(buf);
+    return NULL;
+  }
+  buf[len] = '\0';
+  fclose(f);
+  return buf;
+}
+/*---------------------------------------------------------------------------*/
+static int
+xml_double(const char *doc, const char *tag, double *value)
+{
+  char open[64];
+  const char *p;
+
+  snprintf(open, sizeof(open), "<%s>", tag);
+  p = strstr(doc, open);
+  if(p == NULL) {
+    return 0;
+  }
+  *value = strtod(p + strlen(open), NULL);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+role_of(const char *source, const char *end, enum mote_role *role)
+{
+  static const char *names[ROLE_COUNT] = { "border", "coordinator", "sensor" };
+  int r;
+
+  for(r = 0; r < ROLE_COUNT; r++) {
+    const char *p = strstr(source, names[r]);
+    if(p != NULL && p < end) {
+      *role = r;
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+topology_load_csc(const char *path)
+{
+  char *doc = read_file(path);
+  char *end;
+  const char *type, *next_type;
+  double v;
+
+  if(doc == NULL) {
+    return -1;
+  }
+  /* Plugins after the simulation also list motes */
+  end = strstr(doc, "</simulation>");
+  if(end != NULL) {
+    *end = '\0';
+  }
+  if(xml_double(doc, "transmitting_range", &v)) {
+    sim.config.tx_range = v;
+  }
+  if(xml_double(doc, "interference_range", &v)) {
+    sim.config.interference_range = v;
+  }
+  if(xml_double(doc, "success_ratio_tx", &v)) {
+    sim.config.success_ratio_tx = v;
+  }
+  if(xml_double(doc, "success_ratio_rx", &v)) {
+    sim.config.success_ratio_rx = v;
+  }
+  if(xml_double(doc, "motedelay_us", &v)) {
+    sim.config.boot_delay = v / SIM_SECOND;
+  }
+
+  for(type = strstr(doc, "<motetype>"); type != NULL; type = next_type) {
+    const char *source = strstr(type, "<source>");
+    const char *mote;
+    enum mote_role role;
+
+    next_type = strstr(type + 1, "<motetype>");
+    if(source == NULL || !role_of(source, strstr(source, "</source>"), &role)) {
+      fprintf(stderr, "hostsim: %s: mote type without a known firmware\n",
+              path);
+      free(doc);
+      return -1;
+    }
+    for(mote = strstr(type, "<mote>");
+        mote != NULL && (next_type == NULL || mote < next_type);
+        mote = strstr(mote + 1, "<mote>")) {
+      const char *pos = strstr(mote, "<pos ");
+      const char *id = strstr(mote, "<id>");
+      double x, y;
+
+      if(pos == NULL || id == NULL ||
+         sscanf(pos, "<pos x=\"%lf\" y=\"%lf\"", &x, &y) != 2) {
+        fprintf(stderr, "hostsim: %s: mote without position or id\n", path);
+        free(doc);
+        return -1;
+      }
+      if(topology_add(role, (uint16_t)atoi(id + 4), x, y) == NULL) {
+        free(doc);
+        return -1;
+      }
+    }
+  }
+  free(doc);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+random_in_disk(double cx, double cy, double radius, double *x, double *y)
+{
+  double r = radius * sqrt(sim_random());
+  double a = 2 * M_PI * sim_random();
+
+  *x = cx + r * cos(a);
+  *y = cy + r * sin(a);
+}
+/*---------------------------------------------------------------------------*/
+int
+topology_generate(void)
+{
+  unsigned b, c, s;
+  unsigned borders = sim.config.borders;
+  uint32_t id = 1;
+  uint32_t total = borders + sim.config.coordinators *
+                   (1 + sim.config.sensors_per_coordinator);
+
+  if(total > 65535) {
+    fprintf(stderr, "hostsim: at most 65535 motes\n");
+    return -1;
+  }
+  for(b = 0; b < borders; b++) {
+    double r = borders > 1 ? sim.config.coordinator_radius / 4 : 0;
+    double a = 2 * M_PI * b / borders;
+    topology_add(ROLE_BORDER, id++, r * cos(a), r * sin(a));
+  }
+  for(c = 0; c < sim.config.coordinators; c++) {
+    double cx, cy;
+    random_in_disk(0, 0, sim.config.coordinator_radius, &cx, &cy);
+    topology_add(ROLE_COORDINATOR, id++, cx, cy);
+  }
+  for(c = 0; c < sim.config.coordinators; c++) {
+    /* Copy the centre, adding motes may move the array */
+    double cx = sim.motes[borders + c].x, cy = sim.motes[borders + c].y;
+    for(s = 0; s < sim.config.sensors_per_coordinator; s++) {
+      double x, y;
+      random_in_disk(cx, cy, sim.config.sensor_radius, &x, &y);
+      topology_add(ROLE_SENSOR, id++, x, y);
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,202 @@
+#include "aggregate.h"
+#include "protocol.h"
+
+#if AGGREGATE_TRACE_HOPS > 0
+static void trace_start(aggregate_trace_t *t) {
+  t->hops = 0;
+  t->since = clock_time();
+}
+
+// Of the reading, in ms, were it let go now
+static uint32_t trace_age(const aggregate_trace_t *t) {
+  uint32_t age = (uint32_t)(clock_time() - t->since) * 1000 / CLOCK_SECOND;
+  for (int i = 0; i < t->hops; i++) {
+    age += t->delay[i];
+  }
+  return age;
+}
+
+void aggregate_trace_merge(aggregate_trace_t *t, const aggregate_trace_t *other) {
+  if (trace_age(other) > trace_age(t)) {
+    *t = *other;
+  }
+}
+
+void aggregate_trace_hop(aggregate_trace_t *t) {
+  uint32_t held = (uint32_t)(clock_time() - t->since) * 1000 / CLOCK_SECOND;
+  if (t->hops < AGGREGATE_TRACE_HOPS) {
+    t->delay[t->hops++] = held < 0xffff ? held : 0xffff;
+  } else {
+    held += t->delay[AGGREGATE_TRACE_HOPS - 1];
+    t->delay[AGGREGATE_TRACE_HOPS - 1] = held < 0xffff ? held : 0xffff;
+  }
+  t->since = clock_time();
+}
+#endif
+
+void aggregate_init(aggregate_t *a) {
+  a->sum = 0;
+  a->count = 0;
+  a->min = 0xffff;
+  a->max = 0;
+  a->filled = 0;
+  a->filled_age = 0;
+#if AGGREGATE_BUCKETS > 0
+  for (int i = 0; i < AGGREGATE_BUCKETS; i++) {
+    a->histogram[i] = 0;
+  }
+#endif
+#if AGGREGATE_TRACE_HOPS > 0
+  trace_start(&a->trace);
+#endif
+}
+
+void aggregate_add(aggregate_t *a, uint16_t reading) {
+#if AGGREGATE_TRACE_HOPS > 0
+  if (a->count == 0) {
+    trace_start(&a->trace); // the others are older
+  }
+#endif
+  a->sum += reading;
+  a->count++;
+  if (reading < a->min) a->min = reading;
+  if (reading > a->max) a->max = reading;
+#if AGGREGATE_BUCKETS > 0
+  {
+    unsigned bucket = reading / AGGREGATE_BUCKET_WIDTH;
+    a->histogram[bucket < AGGREGATE_BUCKETS ? bucket : AGGREGATE_BUCKETS - 1]++;
+  }
+#endif
+}
+
+void aggregate_merge(aggregate_t *a, const aggregate_t *other) {
+  if (other->count == 0) {
+    return;
+  }
+#if AGGREGATE_TRACE_HOPS > 0
+  if (a->count == 0) {
+    a->trace = other->trace;
+  } else {
+    aggregate_trace_merge(&a->trace, &other->trace);
+  }
+#endif
+  a->sum += other->sum;
+  a->count += other->count;
+  if (other->min < a->min) a->min = other->min;
+  if (other->max > a->max) a->max = other->max;
+  if (other->filled > 0 && (a->filled == 0 || other->filled_age > a->filled_age)) {
+    a->filled_age = other->filled_age;
+  }
+  a->filled += other->filled;
+#if AGGREGATE_BUCKETS > 0
+  for (int i = 0; i < AGGREGATE_BUCKETS; i++) {
+    a->histogram[i] += other->histogram[i];
+  }
+#endif
+}
+
+void aggregate_fill(aggregate_t *a, const aggregate_t *last, uint8_t age) {
+  aggregate_t stand_in = *last;
+  unsigned oldest = last->filled_age + age;
+  stand_in.filled = last->count;
+  stand_in.filled_age = oldest < 255 ? oldest : 255;
+#if AGGREGATE_TRACE_HOPS > 0
+  if (a->count > 0) {
+    stand_in.trace = a->trace;
+  } else {
+    trace_start(&stand_in.trace);
+  }
+#endif
+  aggregate_merge(a, &stand_in);
+}
+
+void aggregate_rounds_init(aggregate_rounds_t *r) {
+  for (int i = 0; i < AGGREGATE_ROUNDS; i++) {
+    r->round[i] = AGGREGATE_NO_ROUND;
+    r->merged[i] = 0;
+  }
+}
+
+aggregate_t *aggregate_round(aggregate_rounds_t *r, uint8_t round, uint8_t current) {
+  unsigned i = round % AGGREGATE_ROUNDS;
+  if ((uint8_t)(current - round) >= AGGREGATE_ROUNDS) {
+    return NULL; // too late, or not started
+  }
+  if (r->round[i] != round) {
+    r->round[i] = round;
+    r->merged[i] = 0;
+    aggregate_init(&r->a[i]);
+  }
+  return &r->a[i];
+}
+
+int aggregate_round_child(aggregate_rounds_t *r, uint8_t round, unsigned child) {
+  uint16_t bit = (uint16_t)(1U << child); // int is 16 bits on the MSP430
+  unsigned i = round % AGGREGATE_ROUNDS;
+  if (r->merged[i] & bit) {
+    return 0;
+  }
+  r->merged[i] |= bit;
+  return 1;
+}
+
+void aggregate_rounds_forget(aggregate_rounds_t *r, unsigned child) {
+  for (int i = 0; i < AGGREGATE_ROUNDS; i++) {
+    r->merged[i] &= (uint16_t)~(1U << child);
+  }
+}
+
+unsigned aggregate_encode(const aggregate_t *a, uint8_t *buf) {
+  unsigned pos = 0;
+  pos = put_u32(buf, pos, a->sum);
+  pos = put_u16(buf, pos, a->count);
+  pos = put_u16(buf, pos, a->min);
+  pos = put_u16(buf, pos, a->max);
+  pos = put_u16(buf, pos, a->filled);
+  buf[pos++] = a->filled_age;
+#if AGGREGATE_BUCKETS > 0
+  for (int i = 0; i < AGGREGATE_BUCKETS; i++) {
+    pos = put_u16(buf, pos, a->histogram[i]);
+  }
+#endif
+#if AGGREGATE_TRACE_HOPS > 0
+  pos += aggregate_trace_encode(&a->trace, buf + pos);
+#endif
+  return pos;
+}
+
+#if AGGREGATE_TRACE_HOPS > 0
+unsigned aggregate_trace_encode(const aggregate_trace_t *t, uint8_t *buf) {
+  unsigned pos = 0;
+  buf[pos++] = t->hops;
+  for (int i = 0; i < AGGREGATE_TRACE_HOPS; i++) {
+    pos = put_u16(buf, pos, i < t->hops ? t->delay[i] : 0);
+  }
+  return pos;
+}
+#endif
+
+unsigned aggregate_decode(aggregate_t *a, const uint8_t *buf) {
+  unsigned pos = 0;
+  a->sum = get_u32(buf);
+  a->count = get_u16(buf + 4);
+  a->min = get_u16(buf + 6);
+  a->max = get_u16(buf + 8);
+  a->filled = get_u16(buf + 10);
+  a->filled_age = buf[12];
+  pos = 13;
+#if AGGREGATE_BUCKETS > 0
+  for (int i = 0; i < AGGREGATE_BUCKETS; i++, pos += 2) {
+    a->histogram[i] = get_u16(buf + pos);
+  }
+#endif
+#if AGGREGATE_TRACE_HOPS > 0
+  a->trace.hops = buf[pos] < AGGREGATE_TRACE_HOPS ? buf[pos] : AGGREGATE_TRACE_HOPS;
+  pos++;
+  for (int i = 0; i < AGGREGATE_TRACE_HOPS; i++, pos += 2) {
+    a->trace.delay[i] = get_u16(buf + pos);
+  }
+  a->trace.since = clock_time();
+#endif
+  return pos;
+}
@@ -0,0 +1,128 @@
+#ifndef AGGREGATE_H_
+#define AGGREGATE_H_
+
+#include "contiki.h"
+
+/*
+ * Partial aggregate of sensor readings. Each node merges the aggregates of
+ * its children into its own before answering its parent, so the border gets
+ * network-wide statistics without seeing the readings.
+ *
+ * A child whose answer for a round is lost has its last answer stand in for
+ * it, up to AGGREGATE_FILL_AGE rounds old: the aggregate counts these
+ * readings in `filled` and the age of the oldest, so that the border tells
+ * the readings it got (count - filled, over count is the coverage) from the
+ * ones it was missing.
+ */
+
+// Histogram of the readings, AGGREGATE_CONF_BUCKETS 0 leaves it out
+#ifdef AGGREGATE_CONF_BUCKETS
+#define AGGREGATE_BUCKETS AGGREGATE_CONF_BUCKETS
+#else
+#define AGGREGATE_BUCKETS 4
+#endif
+
+#ifdef AGGREGATE_CONF_BUCKET_WIDTH
+#define AGGREGATE_BUCKET_WIDTH AGGREGATE_CONF_BUCKET_WIDTH
+#else
+#define AGGREGATE_BUCKET_WIDTH 1
+#endif
+
+// Trace of the oldest reading of the aggregate, AGGREGATE_CONF_TRACE_HOPS
+// of its path, off by default: how long each node held it, in ms of its own
+// clock, the node that took the reading first. Their sum is the age of the
+// reading when the last one let it go, air time left out. A path longer
+// than that counts the rest in its last hop.
+#ifdef AGGREGATE_CONF_TRACE_HOPS
+#define AGGREGATE_TRACE_HOPS AGGREGATE_CONF_TRACE_HOPS
+#else
+#define AGGREGATE_TRACE_HOPS 0
+#endif
+
+// Rounds a child's last answer stands in for its lost ones, 0 for none
+#ifdef AGGREGATE_CONF_FILL_AGE
+#define AGGREGATE_FILL_AGE AGGREGATE_CONF_FILL_AGE
+#else
+#define AGGREGATE_FILL_AGE 2
+#endif
+
+#if AGGREGATE_TRACE_HOPS > 0
+typedef struct aggregate_trace {
+  uint8_t hops; // delays recorded
+  uint16_t delay[AGGREGATE_TRACE_HOPS];
+  clock_time_t since; // when it reached this node, not sent
+} aggregate_trace_t;
+#endif
+
+typedef struct aggregate {
+  uint32_t sum;
+  uint16_t count; // number of readings
+  uint16_t min;
+  uint16_t max;
+  uint16_t filled; // of the readings, last ones of children that missed the round
+  uint8_t filled_age; // of the oldest of them, in rounds
+#if AGGREGATE_BUCKETS > 0
+  uint16_t histogram[AGGREGATE_BUCKETS]; // the last bucket takes everything above
+#endif
+#if AGGREGATE_TRACE_HOPS > 0
+  aggregate_trace_t trace;
+#endif
+} aggregate_t;
+
+// Encoded size: sum (4), count (2), min (2), max (2), filled (2), filled
+// age (1), buckets (2 each),
+// then with AGGREGATE_TRACE_HOPS hops (1) and delays (2 each), LSB first
+#if AGGREGATE_TRACE_HOPS > 0
+#define AGGREGATE_TRACE_LEN (1 + 2 * AGGREGATE_TRACE_HOPS)
+#else
+#define AGGREGATE_TRACE_LEN 0
+#endif
+#define AGGREGATE_LEN (13 + 2 * AGGREGATE_BUCKETS + AGGREGATE_TRACE_LEN)
+
+void aggregate_init(aggregate_t *a);
+void aggregate_add(aggregate_t *a, uint16_t reading);
+void aggregate_merge(aggregate_t *a, const aggregate_t *other);
+// Merges last, a child's answer for a round age rounds before a's, as the
+// stand-in for its lost answer. The trace only follows fresh readings.
+void aggregate_fill(aggregate_t *a, const aggregate_t *last, uint8_t age);
+
+// Partial aggregates of the last AGGREGATE_ROUNDS rounds. A node with
+// children answers for an older round than the one it collects, and each
+// answer of a child is merged into the round it was tagged with, once: the
+// children merged into a round, answered or filled in, are kept per index
+// in their table.
+#define AGGREGATE_ROUNDS 4 // divides 256, rounds are counted on 8 bits
+#define AGGREGATE_MAX_CHILDREN 16 // the bits of merged[]
+
+typedef struct aggregate_rounds {
+  uint16_t round[AGGREGATE_ROUNDS]; // held by each entry, AGGREGATE_NO_ROUND if none
+  aggregate_t a[AGGREGATE_ROUNDS];
+  uint16_t merged[AGGREGATE_ROUNDS]; // a bit per child index
+} aggregate_rounds_t;
+
+#define AGGREGATE_NO_ROUND 0xffff
+
+void aggregate_rounds_init(aggregate_rounds_t *r);
+// Aggregate of round, emptied first if its entry held an older round.
+// NULL if round is not one of the AGGREGATE_ROUNDS rounds up to current.
+aggregate_t *aggregate_round(aggregate_rounds_t *r, uint8_t round, uint8_t current);
+// Marks child as merged into round, whose entry aggregate_round gave;
+// returns 0 if it was already
+int aggregate_round_child(aggregate_rounds_t *r, uint8_t round, unsigned child);
+// The index of child goes to a new one, merged into none yet
+void aggregate_rounds_forget(aggregate_rounds_t *r, unsigned child);
+
+// Both return the number of bytes written or read. A decoded trace
+// reached this node now.
+unsigned aggregate_encode(const aggregate_t *a, uint8_t *buf);
+unsigned aggregate_decode(aggregate_t *a, const uint8_t *buf);
+
+#if AGGREGATE_TRACE_HOPS > 0
+// Keeps the trace of other if its reading is older
+void aggregate_trace_merge(aggregate_trace_t *t, const aggregate_trace_t *other);
+// Records how long this node held it, when it lets it go
+void aggregate_trace_hop(aggregate_trace_t *t);
+unsigned aggregate_trace_encode(const aggregate_trace_t *t, uint8_t *buf);
+#endif
+
+#endif /* AGGREGATE_H_ */
@@ -0,0 +1,118 @@
+#include "border-select.h"
+#include "net/netstack.h"
+#include <string.h>
+
+// Outside of WiFi's channels 1, 6 and 11 first
+static const uint8_t channels[16] = { 26, 15, 20, 25, 11, 12, 13, 14, 16, 17, 18, 19, 21, 22, 23, 24 };
+static uint8_t tuned = 26; // Contiki-NG's default
+
+static border_candidate_t borders[BORDER_SELECT_MAX];
+static uint8_t count;
+
+uint8_t border_select_channel(unsigned i) {
+  return channels[i % BORDER_SELECT_CHANNELS];
+}
+
+uint8_t border_select_next(uint8_t channel) {
+  for (unsigned i = 0; i < BORDER_SELECT_CHANNELS; i++) {
+    if (channels[i] == channel) {
+      return border_select_channel(i + 1);
+    }
+  }
+  return channels[0];
+}
+
+void border_select_tune(uint8_t channel) {
+  if (channel != tuned && NETSTACK_RADIO.set_value(RADIO_PARAM_CHANNEL, channel) == RADIO_RESULT_OK) {
+    tuned = channel;
+  }
+}
+
+uint8_t border_select_tuned(void) {
+  return tuned;
+}
+
+void border_select_init(void) {
+  radio_value_t channel;
+  if (NETSTACK_RADIO.get_value(RADIO_PARAM_CHANNEL, &channel) == RADIO_RESULT_OK) {
+    tuned = channel;
+  }
+  count = 0;
+}
+
+void border_select_heard(const linkaddr_t *addr, uint8_t load) {
+  border_candidate_t *b = (border_candidate_t *)border_select_lookup(addr);
+  radio_value_t rssi = 0;
+  NETSTACK_RADIO.get_value(RADIO_PARAM_LAST_RSSI, &rssi);
+  if (b == NULL) {
+    if (count < BORDER_SELECT_MAX) {
+      b = &borders[count++];
+    } else {
+      // replaces the one heard the longest ago
+      b = &borders[0];
+      for (int i = 1; i < count; i++) {
+        if ((int32_t)(borders[i].heard - b->heard) < 0) {
+          b = &borders[i];
+        }
+      }
+    }
+    linkaddr_copy(&b->addr, addr);
+    b->rssi = rssi;
+  } else if (b->channel == tuned) {
+    b->rssi = (3 * b->rssi + rssi) / 4;
+  } else {
+    b->rssi = rssi; // it moved
+  }
+  b->channel = tuned;
+  b->load = load;
+  b->heard = clock_time();
+}
+
+const border_candidate_t *border_select_lookup(const linkaddr_t *addr) {
+  for (int i = 0; i < count; i++) {
+    if (linkaddr_cmp(&borders[i].addr, addr)) {
+      return &borders[i];
+    }
+  }
+  return NULL;
+}
+
+unsigned border_select_cost(const border_candidate_t *b) {
+  unsigned cost = b->load;
+  if (b->rssi < BORDER_SELECT_WEAK_RSSI) {
+    cost += (BORDER_SELECT_WEAK_RSSI - b->rssi) * BORDER_SELECT_RSSI_COST;
+  }
+  return cost;
+}
+
+const border_candidate_t *border_select_best(clock_time_t since) {
+  const border_candidate_t *best = NULL;
+  for (int i = 0; i < count; i++) {
+    const border_candidate_t *b = &borders[i];
+    if ((int32_t)(b->heard - since) < 0 || b->load == BORDER_SELECT_FULL) {
+      continue;
+    }
+    if (best == NULL || border_select_cost(b) < border_select_cost(best)) {
+      best = b;
+    }
+  }
+  return best;
+}
+
+uint8_t border_select_free(clock_time_t since) {
+  unsigned fewest = 0;
+  uint8_t channel = channels[0];
+  for (unsigned c = 0; c < BORDER_SELECT_CHANNELS; c++) {
+    unsigned heard = 0;
+    for (int i = 0; i < count; i++) {
+      if (borders[i].channel == channels[c] && (int32_t)(borders[i].heard - since) >= 0) {
+        heard++;
+      }
+    }
+    if (c == 0 || heard < fewest) {
+      fewest = heard;
+      channel = channels[c];
+    }
+  }
+  return channel;
+}
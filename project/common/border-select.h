@@ -0,0 +1,93 @@
+#ifndef BORDER_SELECT_H_
+#define BORDER_SELECT_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+
+/*
+ * Several borders in one area, each with its own coordinators. Every
+ * border takes a channel of its own when it starts, the one the fewest
+ * borders are heard on, and of two borders that end up on the same
+ * channel the one with the highest address looks for another: the
+ * borders do not share the air, capacity grows with their number.
+ *
+ * A coordinator listens on every channel for a period (a beacon comes
+ * every period) and joins the border that costs least: the load its
+ * beacon carries, the share of its slot window its coordinators need in
+ * percent, plus a penalty for a weak link. Now and then, a coordinator
+ * of a busy border listens on another channel for a period, and moves if
+ * that border costs less by more than what it would bring to it and
+ * BORDER_SELECT_HYSTERESIS: one coordinator at a time, each sees the
+ * loads the others' moves changed. Its sensors follow it, the death
+ * notice it broadcasts gives them the channel.
+ *
+ * A coordinator that hears another border on its channel while its own
+ * is silent joins it after BORDER_SELECT_MISSED periods, without a scan.
+ *
+ * With one channel, the default, nothing is scanned: the borders share
+ * it, and the coordinators hear all of them to choose.
+ */
+
+#ifdef BORDER_SELECT_CONF_CHANNELS
+#define BORDER_SELECT_CHANNELS BORDER_SELECT_CONF_CHANNELS
+#else
+#define BORDER_SELECT_CHANNELS 1
+#endif
+
+#if BORDER_SELECT_CHANNELS < 1 || BORDER_SELECT_CHANNELS > 16
+#error "BORDER_SELECT_CHANNELS is between 1 and 16"
+#endif
+#if MAC_CONF_WITH_TSCH && BORDER_SELECT_CHANNELS > 1
+#error "TSCH hops over the channels itself"
+#endif
+
+#define BORDER_SELECT_MAX 8 // borders remembered
+// Load of a border that takes no more coordinators
+#define BORDER_SELECT_FULL 255
+// Cost from which a coordinator looks for another border
+#define BORDER_SELECT_BUSY 90
+#define BORDER_SELECT_HYSTERESIS 10
+// Links weaker than this cost BORDER_SELECT_RSSI_COST per dBm, in load
+// points: at the edge of the range a border must be a lot less loaded
+#define BORDER_SELECT_WEAK_RSSI -80
+#define BORDER_SELECT_RSSI_COST 4
+// Periods between the checks of a coordinator, up to as many again
+// depending on its address; doubled after each survey that found nothing
+// better, at most BORDER_SELECT_CHECK_BACKOFF times
+#define BORDER_SELECT_CHECK 16
+#define BORDER_SELECT_CHECK_BACKOFF 3
+// Periods without its beacon after which a coordinator leaves its border,
+// if another border is heard on its channel meanwhile
+#define BORDER_SELECT_MISSED 2
+// Long enough on a channel to hear the beacon of a border on it
+#define BORDER_SELECT_DWELL(period) ((period) + CLOCK_SECOND / 4)
+
+typedef struct border_candidate {
+  linkaddr_t addr;
+  uint8_t channel;
+  uint8_t load;
+  int16_t rssi; // moving average, the last beacon weighs 1/4
+  clock_time_t heard;
+} border_candidate_t;
+
+// The i-th channel of the borders, 802.15.4 numbering
+uint8_t border_select_channel(unsigned i);
+// The one after channel in the list, back to the first after the last
+uint8_t border_select_next(uint8_t channel);
+void border_select_tune(uint8_t channel);
+uint8_t border_select_tuned(void);
+
+// Forgets the borders heard
+void border_select_init(void);
+// The beacon of addr being received, on the channel we are tuned to
+void border_select_heard(const linkaddr_t *addr, uint8_t load);
+const border_candidate_t *border_select_lookup(const linkaddr_t *addr);
+unsigned border_select_cost(const border_candidate_t *b);
+// The cheapest border heard since "since" that still takes coordinators,
+// NULL if none
+const border_candidate_t *border_select_best(clock_time_t since);
+// For a new border: the first channel with the fewest borders heard since
+// "since"
+uint8_t border_select_free(clock_time_t since);
+
+#endif /* BORDER_SELECT_H_ */
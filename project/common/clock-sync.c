@@ -0,0 +1,61 @@
+#include "clock-sync.h"
+
+void clock_sync_init(clock_sync_t *s) {
+  s->count = 0;
+  s->next = 0;
+  s->offset_max = 0;
+  s->error = CLOCK_SYNC_UNKNOWN_ERROR;
+}
+
+/*
+ * A sample is late by the time its frame spent in the MAC queue and in the
+ * air, which only makes its offset smaller: the estimate takes the highest
+ * offset, and CLOCK_SYNC_MIN_POINTS samples are within the error of it, the
+ * tick itself included.
+ */
+static void update(clock_sync_t *s) {
+  uint8_t above;
+
+  s->offset_max = INT32_MIN;
+  for (int i = 0; i < s->count; i++) {
+    if (s->offset[i] > s->offset_max) {
+      s->offset_max = s->offset[i];
+    }
+  }
+  if (s->count < CLOCK_SYNC_MIN_POINTS) {
+    s->error = CLOCK_SYNC_UNKNOWN_ERROR;
+    return;
+  }
+  for (s->error = 1; ; s->error++) {
+    above = 0;
+    for (int i = 0; i < s->count; i++) {
+      above += s->offset_max - s->offset[i] < (int32_t)s->error;
+    }
+    if (above >= CLOCK_SYNC_MIN_POINTS) {
+      break;
+    }
+  }
+}
+
+void clock_sync_add(clock_sync_t *s, clock_time_t local, clock_time_t reference) {
+  if (s->count >= CLOCK_SYNC_MIN_POINTS) {
+    int32_t diff = (int32_t)(reference - clock_sync_estimate(s, local));
+    // CLOCK_SECOND may be unsigned
+    if (diff > (int32_t)CLOCK_SYNC_JUMP || diff < -(int32_t)CLOCK_SYNC_LATE) {
+      clock_sync_init(s); // the reference changed, start over
+    }
+  }
+  s->offset[s->next] = (int32_t)(reference - local);
+  s->next = (s->next + 1) % CLOCK_SYNC_POINTS;
+  if (s->count < CLOCK_SYNC_POINTS) {
+    s->count++;
+  }
+  update(s);
+}
+
+clock_time_t clock_sync_estimate(const clock_sync_t *s, clock_time_t local) {
+  if (s->count == 0) {
+    return local;
+  }
+  return local + s->offset_max;
+}
@@ -0,0 +1,41 @@
+#ifndef CLOCK_SYNC_H_
+#define CLOCK_SYNC_H_
+
+#include "contiki.h"
+
+/*
+ * Estimate of a reference clock from timestamped samples. The samples are
+ * clock ticks about a period apart: the drift of a Z1's crystal, tens of
+ * ppm, moves the reference less than a tick over the last
+ * CLOCK_SYNC_POINTS of them, and a tick of quantization is already
+ * hundreds of ppm over that time, so none is estimated. The offset is the
+ * one of the least delayed of the last samples, and their spread under it
+ * bounds the error of the estimate. A sample far ahead of it, or very late,
+ * means the reference changed (a new border), the table starts over from
+ * it.
+ */
+
+#define CLOCK_SYNC_POINTS 8
+// Samples before the error bound is estimated
+#define CLOCK_SYNC_MIN_POINTS 3
+// Error bound until then, in clock ticks
+#define CLOCK_SYNC_UNKNOWN_ERROR (CLOCK_SECOND / 16)
+// Distance from the estimate beyond which the reference changed: a sample
+// is never early, but the MAC queue can hold it for a while
+#define CLOCK_SYNC_JUMP (CLOCK_SECOND / 8)
+#define CLOCK_SYNC_LATE CLOCK_SECOND
+
+typedef struct clock_sync {
+  int32_t offset[CLOCK_SYNC_POINTS]; // reference - local
+  uint8_t count;
+  uint8_t next;
+  int32_t offset_max; // reference = local + offset_max
+  clock_time_t error; // bound on |estimate - reference|, in ticks
+} clock_sync_t;
+
+void clock_sync_init(clock_sync_t *s);
+void clock_sync_add(clock_sync_t *s, clock_time_t local, clock_time_t reference);
+// Reference time at the given local time, the local time without samples
+clock_time_t clock_sync_estimate(const clock_sync_t *s, clock_time_t local);
+
+#endif /* CLOCK_SYNC_H_ */
@@ -0,0 +1,136 @@
+#include "duty-cycle.h"
+#include "net/netstack.h"
+#include <stdint.h>
+
+typedef struct window {
+  uint8_t active;
+  clock_time_t start; // of the current or next opening
+  clock_time_t length;
+  clock_time_t period;
+} window_t;
+
+static window_t windows[DUTY_CYCLE_WINDOWS];
+static uint8_t holds;
+static clock_time_t tail_end;
+static uint8_t radio_is_on;
+static clock_time_t on_since;
+static clock_time_t on_total;
+
+PROCESS(duty_cycle_process, "Duty cycle");
+
+// Moves the window to its first opening that has not ended yet
+static void advance(window_t *w, clock_time_t now) {
+  while ((int32_t)(now - (w->start + w->length)) >= 0) {
+    w->start += w->period;
+  }
+}
+
+static void set_radio(uint8_t on) {
+  if (on == radio_is_on) {
+    return;
+  }
+  if (on) {
+    NETSTACK_RADIO.on();
+    on_since = clock_time();
+  } else {
+    NETSTACK_RADIO.off();
+    on_total += clock_time() - on_since;
+  }
+  radio_is_on = on;
+}
+
+void duty_cycle_init(void) {
+  radio_is_on = 1;
+  on_since = clock_time();
+  on_total = 0;
+  holds = DUTY_CYCLE_SEARCH;
+#if DUTY_CYCLE
+  process_start(&duty_cycle_process, NULL);
+#endif
+}
+
+void duty_cycle_window(uint8_t w, clock_time_t start, clock_time_t length, clock_time_t period) {
+  windows[w].active = 1;
+  windows[w].start = start;
+  windows[w].length = length < period ? length : period;
+  windows[w].period = period;
+  process_poll(&duty_cycle_process);
+}
+
+void duty_cycle_done(uint8_t w) {
+  if (windows[w].active && (int32_t)(clock_time() - windows[w].start) >= 0) {
+    windows[w].start += windows[w].period;
+    process_poll(&duty_cycle_process);
+  }
+}
+
+void duty_cycle_cancel(uint8_t w) {
+  windows[w].active = 0;
+  process_poll(&duty_cycle_process);
+}
+
+void duty_cycle_hold(uint8_t hold, int on) {
+  if (on) {
+    holds |= hold;
+  } else {
+    holds &= ~hold;
+  }
+  process_poll(&duty_cycle_process);
+}
+
+void duty_cycle_sent(void) {
+  // frames queued behind each other are sent one after the other
+  if ((int32_t)(tail_end - clock_time()) < 0) {
+    tail_end = clock_time();
+  }
+  tail_end += DUTY_CYCLE_TAIL;
+  process_poll(&duty_cycle_process);
+}
+
+clock_time_t duty_cycle_on_time(void) {
+  return on_total + (radio_is_on ? clock_time() - on_since : 0);
+}
+
+PROCESS_THREAD(duty_cycle_process, ev, data) {
+  static struct etimer timer;
+  clock_time_t now;
+  int32_t next;
+  uint8_t on;
+
+  PROCESS_BEGIN();
+
+  while (1) {
+    now = clock_time();
+    on = holds != 0;
+    next = INT32_MAX;
+    if ((int32_t)(tail_end - now) > 0) {
+      on = 1;
+      next = (int32_t)(tail_end - now);
+    }
+    for (int i = 0; i < DUTY_CYCLE_WINDOWS; i++) {
+      window_t *w = &windows[i];
+      int32_t until;
+      if (!w->active) {
+        continue;
+      }
+      advance(w, now);
+      if ((int32_t)(now - w->start) >= 0) {
+        on = 1;
+        until = (int32_t)(w->start + w->length - now);
+      } else {
+        until = (int32_t)(w->start - now);
+      }
+      next = until < next ? until : next;
+    }
+    set_radio(on);
+    if (next != INT32_MAX) {
+      etimer_set(&timer, next);
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer) || ev == PROCESS_EVENT_POLL);
+      etimer_stop(&timer);
+    } else {
+      PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    }
+  }
+
+  PROCESS_END();
+}
@@ -0,0 +1,51 @@
+#ifndef DUTY_CYCLE_H_
+#define DUTY_CYCLE_H_
+
+#include "contiki.h"
+
+/*
+ * Radio duty cycling aligned with the schedule: the radio is only on in
+ * the windows where the node expects frames, the border's beacon, its own
+ * slot or its parent's POLL and its children's answers, each one coming
+ * back every period, while a hold keeps it on, searching a parent for
+ * instance, and for a short tail after each frame sent, so that it gets its
+ * ack. Without DUTY_CYCLE the radio is never turned off.
+ *
+ * The time the radio is on is counted either way.
+ */
+
+// Needs PROTOCOL_POLL: a sensor cannot tell when a request would come
+#ifdef DUTY_CYCLE_CONF
+#define DUTY_CYCLE DUTY_CYCLE_CONF
+#else
+#define DUTY_CYCLE 0
+#endif
+
+#if DUTY_CYCLE && MAC_CONF_WITH_TSCH
+#error "TSCH turns the radio off outside its cells on its own"
+#endif
+
+#define DUTY_CYCLE_WINDOWS 2
+
+// Time the radio stays on after a frame is handed to the MAC: CSMA may hold
+// it behind other frames and send it again until it gets its ack
+#define DUTY_CYCLE_TAIL (CLOCK_SECOND / 8)
+
+// Holds, one bit each
+#define DUTY_CYCLE_SEARCH 0x01 // no parent, or no window from it yet
+#define DUTY_CYCLE_ANSWER 0x02 // an answer waiting to be sent or acked
+
+void duty_cycle_init(void);
+// Opens window w at start (local clock) for at most length ticks, then
+// every period
+void duty_cycle_window(uint8_t w, clock_time_t start, clock_time_t length, clock_time_t period);
+// Closes window w until its next period
+void duty_cycle_done(uint8_t w);
+void duty_cycle_cancel(uint8_t w);
+void duty_cycle_hold(uint8_t hold, int on);
+// Called for each frame sent, keeps the radio on DUTY_CYCLE_TAIL longer
+void duty_cycle_sent(void);
+// Ticks the radio was on since boot
+clock_time_t duty_cycle_on_time(void);
+
+#endif /* DUTY_CYCLE_H_ */
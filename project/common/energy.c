@@ -0,0 +1,80 @@
+#include "energy.h"
+#include "protocol.h"
+#include "net/linkaddr.h"
+
+static uint64_t last_cpu, last_lpm, last_tx, last_rx;
+static energy_t last; // shares of the last interval long enough
+
+static uint16_t share(uint64_t part, uint64_t total) {
+  if (total == 0) {
+    return 0;
+  }
+  part = part * ENERGY_SCALE / total;
+  return part < ENERGY_SCALE ? part : ENERGY_SCALE;
+}
+
+void energy_init(energy_t *e) {
+  e->cpu = 0;
+  e->lpm = 0;
+  e->tx = 0;
+  e->rx = 0;
+  e->peak_node = 0;
+  e->peak_current = 0;
+}
+
+void energy_sample(energy_t *e) {
+  uint64_t cpu, lpm, tx, rx, total;
+  energest_flush();
+  cpu = energest_type_time(ENERGEST_TYPE_CPU);
+  lpm = energest_type_time(ENERGEST_TYPE_LPM) + energest_type_time(ENERGEST_TYPE_DEEP_LPM);
+  tx = energest_type_time(ENERGEST_TYPE_TRANSMIT);
+  rx = energest_type_time(ENERGEST_TYPE_LISTEN);
+  // the CPU is always in one of its states, the radio is not
+  total = (cpu - last_cpu) + (lpm - last_lpm);
+  if (total >= ENERGY_MIN_INTERVAL) {
+    last.cpu = share(cpu - last_cpu, total);
+    last.lpm = share(lpm - last_lpm, total);
+    last.tx = share(tx - last_tx, total);
+    last.rx = share(rx - last_rx, total);
+    last_cpu = cpu;
+    last_lpm = lpm;
+    last_tx = tx;
+    last_rx = rx;
+  }
+  *e = last;
+  e->peak_node = linkaddr_node_addr.u8[0] | (linkaddr_node_addr.u8[1] << 8);
+  e->peak_current = energy_current(e);
+}
+
+uint16_t energy_current(const energy_t *e) {
+  return ((uint32_t)e->cpu * ENERGY_CPU_UA + (uint32_t)e->lpm * ENERGY_LPM_UA
+          + (uint32_t)e->tx * ENERGY_TX_UA + (uint32_t)e->rx * ENERGY_RX_UA) / ENERGY_SCALE;
+}
+
+void energy_merge(energy_t *e, const energy_t *other) {
+  if (other->peak_current > e->peak_current) {
+    e->peak_node = other->peak_node;
+    e->peak_current = other->peak_current;
+  }
+}
+
+unsigned energy_encode(const energy_t *e, uint8_t *buf) {
+  unsigned pos = 0;
+  pos = put_u16(buf, pos, e->cpu);
+  pos = put_u16(buf, pos, e->lpm);
+  pos = put_u16(buf, pos, e->tx);
+  pos = put_u16(buf, pos, e->rx);
+  pos = put_u16(buf, pos, e->peak_node);
+  pos = put_u16(buf, pos, e->peak_current);
+  return pos;
+}
+
+unsigned energy_decode(energy_t *e, const uint8_t *buf) {
+  e->cpu = get_u16(buf);
+  e->lpm = get_u16(buf + 2);
+  e->tx = get_u16(buf + 4);
+  e->rx = get_u16(buf + 6);
+  e->peak_node = get_u16(buf + 8);
+  e->peak_current = get_u16(buf + 10);
+  return ENERGY_LEN;
+}
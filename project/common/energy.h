@@ -0,0 +1,56 @@
+#ifndef ENERGY_H_
+#define ENERGY_H_
+
+#include "contiki.h"
+#include "sys/energest.h"
+
+/*
+ * Energy accounting from Contiki's energest counters (ENERGEST_CONF_ON,
+ * set by the node Makefiles). Every node samples them once per period,
+ * when it answers its parent, and sends the share of the period its CPU
+ * was active or in LPM and its radio transmitting or listening with its
+ * AGGREGATE. The same answer names the node of its subtree, itself
+ * included, that drew the most current, so the border can tell for each
+ * coordinator how much it burns and which of its sensors burns the most.
+ */
+
+#define ENERGY_SCALE 10000 // shares are in ENERGY_SCALE ths of the period
+// A node answering twice in a row sends the shares of the longer interval
+// before, a few ms would be all radio
+#define ENERGY_MIN_INTERVAL ENERGEST_SECOND
+
+// Average current of each state in uA, Tmote Sky figures at 3 V (same
+// CC2420, an MSP430 of the same family), enough to rank the nodes
+#define ENERGY_CPU_UA 1800
+#define ENERGY_LPM_UA 55
+#define ENERGY_TX_UA 17700
+#define ENERGY_RX_UA 20000
+
+typedef struct energy {
+  // of the sender, since its previous sample
+  uint16_t cpu;
+  uint16_t lpm;
+  uint16_t tx;
+  uint16_t rx;
+  // node of the sender's subtree drawing the most, and its current in uA
+  uint16_t peak_node;
+  uint16_t peak_current;
+} energy_t;
+
+// Encoded size: cpu, lpm, tx, rx, peak_node, peak_current (2 each), LSB first
+#define ENERGY_LEN 12
+
+// No samples and no peak
+void energy_init(energy_t *e);
+// Shares since the previous call, with this node as the peak
+void energy_sample(energy_t *e);
+// Average current in uA of the shares of e
+uint16_t energy_current(const energy_t *e);
+// Takes the peak of other if it draws more
+void energy_merge(energy_t *e, const energy_t *other);
+
+// Both return the number of bytes written or read
+unsigned energy_encode(const energy_t *e, uint8_t *buf);
+unsigned energy_decode(energy_t *e, const uint8_t *buf);
+
+#endif /* ENERGY_H_ */
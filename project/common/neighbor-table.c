@@ -0,0 +1,92 @@
+#include "neighbor-table.h"
+#include "net/netstack.h"
+#include <string.h>
+
+static unsigned hash(const neighbor_table_t *t, const linkaddr_t *addr) {
+  uint16_t h = 0;
+  for (int i = 0; i < LINKADDR_SIZE; i++) {
+    h = h * 31 + addr->u8[i];
+  }
+  return h % t->size;
+}
+
+void neighbor_table_init(neighbor_table_t *t) {
+  t->count = 0;
+  t->free = NULL;
+  for (int i = t->size - 1; i >= 0; i--) {
+    t->pool[i].next = t->free;
+    t->free = &t->pool[i];
+    t->buckets[i] = NULL;
+  }
+}
+
+void neighbor_table_clear(neighbor_table_t *t) {
+  neighbor_table_init(t);
+}
+
+neighbor_t *neighbor_table_lookup(neighbor_table_t *t, const linkaddr_t *addr) {
+  neighbor_t *n;
+  for (n = t->buckets[hash(t, addr)]; n != NULL; n = n->next) {
+    if (linkaddr_cmp(&n->addr, addr)) {
+      return n;
+    }
+  }
+  return NULL;
+}
+
+neighbor_t *neighbor_table_add(neighbor_table_t *t, const linkaddr_t *addr) {
+  neighbor_t *n = t->free;
+  unsigned b;
+  if (n == NULL) {
+    return NULL;
+  }
+  t->free = n->next;
+
+  memset(n, 0, sizeof(*n));
+  linkaddr_copy(&n->addr, addr);
+  n->last_seen = clock_time();
+  b = hash(t, addr);
+  n->next = t->buckets[b];
+  t->buckets[b] = n;
+  n->pos = t->count;
+  t->used[t->count++] = n;
+  return n;
+}
+
+void neighbor_table_remove(neighbor_table_t *t, neighbor_t *n) {
+  neighbor_t **p = &t->buckets[hash(t, &n->addr)];
+  while (*p != n) {
+    p = &(*p)->next;
+  }
+  *p = n->next;
+
+  // the last used entry takes its place
+  t->count--;
+  t->used[n->pos] = t->used[t->count];
+  t->used[n->pos]->pos = n->pos;
+
+  n->next = t->free;
+  t->free = n;
+}
+
+unsigned neighbor_table_expire(neighbor_table_t *t, clock_time_t timeout) {
+  unsigned removed = 0;
+  // Backwards, removing moves the last entry (already checked) here
+  for (int i = t->count - 1; i >= 0; i--) {
+    if (clock_time() > t->used[i]->last_seen + timeout) {
+      neighbor_table_remove(t, t->used[i]);
+      removed++;
+    }
+  }
+  return removed;
+}
+
+void neighbor_table_heard(neighbor_t *n) {
+  radio_value_t rssi;
+  n->last_seen = clock_time();
+  n->rx_count++;
+  if (NETSTACK_RADIO.get_value(RADIO_PARAM_LAST_RSSI, &rssi) == RADIO_RESULT_OK) {
+    n->avg_rssi = n->rx_count == 1 ? rssi : (3 * n->avg_rssi + rssi) / 4;
+    n->last_rssi = rssi;
+  }
+}
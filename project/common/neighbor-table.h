@@ -0,0 +1,59 @@
+#ifndef NEIGHBOR_TABLE_H_
+#define NEIGHBOR_TABLE_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+
+/*
+ * Table of neighbors (children of a node) over a static pool.
+ * Lookup by link address goes through a hash table, removal swaps the
+ * last used entry into the hole, so both cost the same whatever the size.
+ * Entries keep their place in the pool while they are used: data that a
+ * role keeps per neighbor goes in an array indexed by neighbor_table_index().
+ */
+
+typedef struct neighbor {
+  struct neighbor *next; // in its hash bucket, or in the free list
+  linkaddr_t addr;
+  uint8_t pos; // in the list of used entries
+  /* Link statistics */
+  clock_time_t last_seen;
+  uint16_t rx_count;
+  int16_t last_rssi;
+  int16_t avg_rssi; // moving average, the last frame weighs 1/4
+} neighbor_t;
+
+typedef struct neighbor_table {
+  uint8_t size;
+  uint8_t count;
+  neighbor_t *pool;
+  neighbor_t **used; // count entries, in no particular order
+  neighbor_t **buckets; // size buckets
+  neighbor_t *free;
+} neighbor_table_t;
+
+// Declares a table of at most "size" (< 256) neighbors, like MEMB() does
+#define NEIGHBOR_TABLE(name, size) \
+  static neighbor_t name##_pool[size]; \
+  static neighbor_t *name##_used[size]; \
+  static neighbor_t *name##_buckets[size]; \
+  static neighbor_table_t name = { size, 0, name##_pool, name##_used, name##_buckets, NULL }
+
+void neighbor_table_init(neighbor_table_t *t);
+void neighbor_table_clear(neighbor_table_t *t);
+
+neighbor_t *neighbor_table_lookup(neighbor_table_t *t, const linkaddr_t *addr);
+// NULL if the table is full, the address must not be in the table yet
+neighbor_t *neighbor_table_add(neighbor_table_t *t, const linkaddr_t *addr);
+void neighbor_table_remove(neighbor_table_t *t, neighbor_t *n);
+// Removes the neighbors not heard for "timeout", returns how many
+unsigned neighbor_table_expire(neighbor_table_t *t, clock_time_t timeout);
+
+// Updates the link statistics with the frame being received
+void neighbor_table_heard(neighbor_t *n);
+
+#define neighbor_table_count(t) ((t)->count)
+#define neighbor_table_get(t, i) ((t)->used[i])
+#define neighbor_table_index(t, n) ((unsigned)((n) - (t)->pool))
+
+#endif /* NEIGHBOR_TABLE_H_ */
@@ -0,0 +1,170 @@
+#include "net-config.h"
+#include "protocol.h"
+#include "trickle.h"
+#include <stdlib.h>
+#include <string.h>
+
+net_config_t net_config = { 0, NET_CONFIG_PERIOD, NET_CONFIG_TIMEOUT, NET_CONFIG_SHORT_TIMEOUT };
+static clock_time_t epoch; // a period boundary of the timing in force
+static uint32_t epoch_periods; // periods before it
+static net_config_t next;
+static clock_time_t next_at;
+static uint8_t pending;
+static uint8_t announced; // for the next net_config_due
+static uint16_t periods; // calls to net_config_due, the refresh counts them
+static trickle_t refresh;
+
+// Intervals of 1 to NET_CONFIG_REPEAT periods
+static void refresh_reset(void) {
+  uint8_t doublings = 0;
+  while ((1 << doublings) < NET_CONFIG_REPEAT) {
+    doublings++;
+  }
+  if (refresh.imin == 0) {
+    trickle_init(&refresh, 1, doublings, 0, periods);
+  } else {
+    trickle_reset(&refresh, periods);
+  }
+}
+
+void net_config_init(void) {
+  if (net_config.version != 0 || pending) {
+    announced = 1;
+  }
+  net_config.version = 0;
+  net_config.period = NET_CONFIG_PERIOD;
+  net_config.timeout = NET_CONFIG_TIMEOUT;
+  net_config.short_timeout = NET_CONFIG_SHORT_TIMEOUT;
+  epoch = 0;
+  epoch_periods = 0;
+  pending = 0;
+}
+
+int net_config_receive(const net_config_t *c, clock_time_t at) {
+  if (c->version == net_config.version || (pending && c->version == next.version)) {
+    return 0;
+  }
+  next = *c;
+  next_at = at;
+  pending = 1;
+  return 1;
+}
+
+// t - epoch in periods, rounded to the nearest: the boundary of a sensor
+// comes from a relayed delay, a little off
+static int32_t periods_to(clock_time_t t) {
+  int32_t d = (int32_t)(t - epoch);
+  int32_t half = net_config.period / 2;
+  return d >= 0 ? (d + half) / (int32_t)net_config.period : -((-d + half) / (int32_t)net_config.period);
+}
+
+int net_config_update(clock_time_t now) {
+  if (!pending || (int32_t)(next_at - now) > (int32_t)NET_CONFIG_LEAD) {
+    return 0;
+  }
+  epoch_periods += periods_to(next_at);
+  epoch = next_at;
+  net_config = next;
+  pending = 0;
+  refresh_reset();
+  return 1;
+}
+
+int net_config_pending(net_config_t *c, clock_time_t *at) {
+  if (pending) {
+    if (c != NULL) {
+      *c = next;
+    }
+    if (at != NULL) {
+      *at = next_at;
+    }
+  }
+  return pending;
+}
+
+// The network clock only goes before the epoch by NET_CONFIG_LEAD, right
+// after a switch
+clock_time_t net_config_offset(clock_time_t t) {
+  if (epoch - t <= NET_CONFIG_LEAD && t != epoch) {
+    return net_config.period - (epoch - t) % net_config.period;
+  }
+  return (t - epoch) % net_config.period;
+}
+
+uint32_t net_config_periods(clock_time_t t) {
+  if (epoch - t <= NET_CONFIG_LEAD && t != epoch) {
+    return epoch_periods - 1;
+  }
+  return epoch_periods + (t - epoch) / net_config.period;
+}
+
+int net_config_due(void) {
+  uint8_t step;
+  if (refresh.imin == 0) {
+    refresh_reset();
+  }
+  step = trickle_run(&refresh, ++periods);
+  if (pending || announced) {
+    announced = 0;
+    return 1;
+  }
+  // the defaults need no refresh
+  return net_config.version != 0 && (step & TRICKLE_SEND);
+}
+
+void net_config_announce(void) {
+  if (net_config.version != 0 || pending) {
+    announced = 1;
+  }
+}
+
+void net_config_send(uint8_t node, clock_time_t now, int absolute, const linkaddr_t *dest) {
+  message_t m;
+  clock_time_t at = pending ? next_at : now - net_config_offset(now);
+  m.node = node;
+  m.type = CONFIG_TYPE;
+  m.config = pending ? next : net_config;
+  m.clock = absolute ? at : at - now;
+  protocol_send(&m, dest);
+}
+
+int net_config_parse(net_config_t *c, const char *line) {
+  net_config_t n = *c;
+  while (*line != '\0') {
+    const char *value;
+    char *end;
+    unsigned long v;
+    if (*line == ' ') {
+      line++;
+      continue;
+    }
+    value = strchr(line, '=');
+    if (value == NULL) {
+      return 0;
+    }
+    v = strtoul(value + 1, &end, 10);
+    if (end == value + 1 || (*end != ' ' && *end != '\0')) {
+      return 0;
+    }
+    if (value - line == 6 && strncmp(line, "period", 6) == 0) {
+      if (v > NET_CONFIG_PERIOD_MAX * 1000UL / CLOCK_SECOND) {
+        return 0;
+      }
+      n.period = v * CLOCK_SECOND / 1000;
+    } else if (value - line == 7 && strncmp(line, "timeout", 7) == 0 && v <= 255) {
+      n.timeout = v;
+    } else if (value - line == 13 && strncmp(line, "short_timeout", 13) == 0 && v <= 255) {
+      n.short_timeout = v;
+    } else {
+      return 0;
+    }
+    line = end;
+  }
+  // a sensor must get a SCHEDULE before it gives up on its parent
+  if (n.period < NET_CONFIG_PERIOD_MIN || n.period > NET_CONFIG_PERIOD_MAX
+      || n.timeout < SCHEDULE_REFRESH + 2 || n.short_timeout < 2) {
+    return 0;
+  }
+  *c = n;
+  return 1;
+}
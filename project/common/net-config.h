@@ -0,0 +1,89 @@
+#ifndef NET_CONFIG_H_
+#define NET_CONFIG_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+
+/*
+ * Timing of the network, set at run time: the border takes a new one from
+ * its serial line and announces it in a CONFIG frame before its beacon for
+ * NET_CONFIG_NOTICE periods, every parent passing it on to its children
+ * before its POLL or SCHEDULE. The new timing takes over at a period
+ * boundary of the network clock, the same for all: every node switches a
+ * little before it (NET_CONFIG_LEAD), at the last beacon of the old
+ * timing, so that the schedule that follows is computed with the new one.
+ * The timing in force is sent again to the children that join, and on a
+ * Trickle timer (see trickle.h) for the nodes that missed the switch: a
+ * period after it, then two, four... up to NET_CONFIG_REPEAT periods
+ * apart while nothing changes.
+ *
+ * The version tells the timings apart: 0 for the defaults below, the
+ * border counts its changes from there. Its beacon carries the version in
+ * force, a border that restarted sends 0 and the coordinators go back to
+ * the defaults.
+ */
+
+#ifdef NET_CONFIG_CONF_PERIOD
+#define NET_CONFIG_PERIOD NET_CONFIG_CONF_PERIOD
+#else
+#define NET_CONFIG_PERIOD (5 * CLOCK_SECOND)
+#endif
+// Periods without hearing from a node before it is dead: a silent child of
+// the border or of a coordinator, a sensor's parent
+#define NET_CONFIG_TIMEOUT 10
+// Same, for nodes heard every period: a coordinator's border, the children
+// a sensor polls
+#define NET_CONFIG_SHORT_TIMEOUT 5
+
+// The beacon comes half a second before the end of a period, the slots
+// need the rest; on 16 bits on the air
+#define NET_CONFIG_PERIOD_MIN (2 * CLOCK_SECOND)
+#define NET_CONFIG_PERIOD_MAX (120 * CLOCK_SECOND)
+#define NET_CONFIG_NOTICE 3
+#define NET_CONFIG_LEAD CLOCK_SECOND
+#define NET_CONFIG_REPEAT 16 // a power of 2
+
+typedef struct net_config {
+  uint8_t version;
+  clock_time_t period;
+  uint8_t timeout; // in periods
+  uint8_t short_timeout;
+} net_config_t;
+
+// In force
+extern net_config_t net_config;
+
+// Back to the defaults, announced to the children if they changed
+void net_config_init(void);
+// Takes next over at the period boundary at, on the clock of the caller:
+// the network clock for the border and the coordinators, their own for the
+// sensors. Returns 1 if it is new to us.
+int net_config_receive(const net_config_t *next, clock_time_t at);
+// Switches to the pending timing when its boundary is NET_CONFIG_LEAD
+// away or less, returns 1 if it did
+int net_config_update(clock_time_t now);
+// Returns 1 if a switch is pending, with the timing and its boundary
+int net_config_pending(net_config_t *next, clock_time_t *at);
+
+// Offset of t, on the network clock, from the start of its period
+clock_time_t net_config_offset(clock_time_t t);
+// Periods from the start of the network clock to the one of t, across
+// switches
+uint32_t net_config_periods(clock_time_t t);
+
+// Once per period: returns 1 if the children should get a CONFIG, a
+// switch being pending, a child new or the timing in force due again
+int net_config_due(void);
+// The next call to net_config_due returns 1, for a child that joined
+void net_config_announce(void);
+// Sends the pending timing, else the one in force, at gives the boundary:
+// the network clock of the border, or else ticks from now (negative once
+// in force)
+void net_config_send(uint8_t node, clock_time_t now, int absolute, const linkaddr_t *dest);
+
+// Parses "period=<ms> timeout=<periods> short_timeout=<periods>" (any of
+// them, in any order) over c, returns 0 if a field is unknown or out of
+// range
+int net_config_parse(net_config_t *c, const char *line);
+
+#endif /* NET_CONFIG_H_ */
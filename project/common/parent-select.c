@@ -0,0 +1,182 @@
+#include "parent-select.h"
+#include "net/netstack.h"
+#include "lib/random.h"
+#include "trickle.h"
+#include <string.h>
+
+PROCESS(offer_process, "Parent offers");
+
+static parent_candidate_t candidates[PARENT_SELECT_MAX];
+static uint8_t count;
+
+// Our figures, for the OFFER to send
+static node_type offer_node;
+static uint8_t offer_depth;
+static uint8_t offer_load;
+// An answer to a DISCOVERY, after a backoff
+static uint8_t pending;
+static uint8_t redundant; // offers heard meanwhile, cheaper than ours
+// Our OFFER unasked, in periods
+static uint16_t advert_periods;
+static trickle_t advert;
+
+static unsigned offer_cost(uint8_t depth, uint8_t load) {
+  return load + depth * PARENT_SELECT_HOP_COST;
+}
+
+void parent_select_init(void) {
+  count = 0;
+  pending = 0;
+  if (!process_is_running(&offer_process)) {
+    process_start(&offer_process, NULL);
+  }
+}
+
+void parent_select_solicited(node_type node, uint8_t depth, uint8_t load) {
+  // the latest figures, a pending OFFER answers this one too
+  offer_node = node;
+  offer_depth = depth;
+  offer_load = load;
+  if (!pending) {
+    pending = 1;
+    redundant = 0;
+    process_poll(&offer_process);
+  }
+}
+
+void parent_select_advertise(node_type node, uint8_t depth, uint8_t load, int restart) {
+  // room made: the sensors around may want to move to us
+  if (load + PARENT_SELECT_HYSTERESIS <= offer_load ||
+      (offer_load == PARENT_SELECT_FULL && load != PARENT_SELECT_FULL)) {
+    restart = 1;
+  }
+  offer_node = node;
+  offer_depth = depth;
+  offer_load = load;
+  advert_periods++;
+  if (restart || advert.imin == 0) {
+    trickle_init(&advert, 1, PARENT_SELECT_ADVERT_DOUBLINGS, PARENT_SELECT_REDUNDANCY, advert_periods);
+  }
+  if (trickle_run(&advert, advert_periods) & TRICKLE_SEND) {
+    send_offer(node, depth, load);
+  }
+}
+
+void parent_select_offered(uint8_t depth, uint8_t load) {
+  if (offer_cost(depth, load) >= offer_cost(offer_depth, offer_load)) {
+    return;
+  }
+  if (pending && redundant < 255) {
+    redundant++;
+  }
+  trickle_heard(&advert);
+}
+
+void parent_select_heard(const linkaddr_t *addr, uint8_t depth, uint8_t load) {
+  parent_candidate_t *p = (parent_candidate_t *)parent_select_lookup(addr);
+  radio_value_t rssi = 0;
+  radio_value_t lqi = PARENT_SELECT_NO_LQI;
+  NETSTACK_RADIO.get_value(RADIO_PARAM_LAST_RSSI, &rssi);
+  if (NETSTACK_RADIO.get_value(RADIO_PARAM_LAST_LINK_QUALITY, &lqi) != RADIO_RESULT_OK) {
+    lqi = PARENT_SELECT_NO_LQI;
+  }
+  if (p == NULL) {
+    if (count < PARENT_SELECT_MAX) {
+      p = &candidates[count++];
+    } else {
+      // replaces the one heard the longest ago
+      p = &candidates[0];
+      for (int i = 1; i < count; i++) {
+        if ((int32_t)(candidates[i].heard - p->heard) < 0) {
+          p = &candidates[i];
+        }
+      }
+    }
+    linkaddr_copy(&p->addr, addr);
+    p->etx = PARENT_SELECT_ETX_ONE;
+    p->rssi = rssi;
+    p->lqi = lqi;
+  } else {
+    p->rssi = (3 * p->rssi + rssi) / 4;
+    p->lqi = lqi == PARENT_SELECT_NO_LQI || p->lqi == PARENT_SELECT_NO_LQI ? lqi : (3 * p->lqi + lqi) / 4;
+  }
+  p->depth = depth;
+  p->load = load;
+  p->heard = clock_time();
+}
+
+const parent_candidate_t *parent_select_lookup(const linkaddr_t *addr) {
+  for (int i = 0; i < count; i++) {
+    if (linkaddr_cmp(&candidates[i].addr, addr)) {
+      return &candidates[i];
+    }
+  }
+  return NULL;
+}
+
+void parent_select_forget(const linkaddr_t *addr) {
+  parent_candidate_t *p = (parent_candidate_t *)parent_select_lookup(addr);
+  if (p != NULL) {
+    *p = candidates[--count];
+  }
+}
+
+void parent_select_round(const linkaddr_t *addr, int asked) {
+  parent_candidate_t *p = (parent_candidate_t *)parent_select_lookup(addr);
+  if (p != NULL) {
+    p->etx = (7 * p->etx + (asked ? 1 : PARENT_SELECT_ETX_MISS) * PARENT_SELECT_ETX_ONE) / 8;
+  }
+}
+
+unsigned parent_select_cost(const parent_candidate_t *p) {
+  unsigned cost = p->load + p->depth * PARENT_SELECT_HOP_COST;
+  if (p->rssi < PARENT_SELECT_WEAK_RSSI) {
+    cost += (PARENT_SELECT_WEAK_RSSI - p->rssi) * PARENT_SELECT_RSSI_COST;
+  }
+  if (p->lqi != PARENT_SELECT_NO_LQI && p->lqi < PARENT_SELECT_WEAK_LQI) {
+    cost += (PARENT_SELECT_WEAK_LQI - p->lqi) * PARENT_SELECT_LQI_COST;
+  }
+  if (p->etx > PARENT_SELECT_ETX_ONE) {
+    cost += (p->etx - PARENT_SELECT_ETX_ONE) * PARENT_SELECT_ETX_COST / PARENT_SELECT_ETX_ONE;
+  }
+  return cost;
+}
+
+const parent_candidate_t *parent_select_best(clock_time_t since, uint8_t max_depth) {
+  const parent_candidate_t *best = NULL;
+  for (int i = 0; i < count; i++) {
+    const parent_candidate_t *p = &candidates[i];
+    if ((int32_t)(p->heard - since) < 0 || p->load == PARENT_SELECT_FULL || p->depth > max_depth) {
+      continue;
+    }
+    // the strongest link of those that cost the same
+    if (best == NULL || parent_select_cost(p) < parent_select_cost(best) ||
+        (parent_select_cost(p) == parent_select_cost(best) && p->rssi > best->rssi)) {
+      best = p;
+    }
+  }
+  return best;
+}
+
+uint8_t parent_select_load(unsigned readings, unsigned children, unsigned max_children) {
+  unsigned load = readings * 100 / PARENT_SELECT_CAPACITY;
+  if (children >= max_children) {
+    return PARENT_SELECT_FULL;
+  }
+  return load < PARENT_SELECT_FULL ? load : PARENT_SELECT_FULL - 1;
+}
+
+PROCESS_THREAD(offer_process, ev, data) {
+  static struct etimer backoff;
+  PROCESS_BEGIN();
+  while (1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL && pending);
+    etimer_set(&backoff, 1 + random_rand() % PARENT_SELECT_BACKOFF);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&backoff));
+    if (pending && redundant < PARENT_SELECT_REDUNDANCY) {
+      send_offer(offer_node, offer_depth, offer_load);
+    }
+    pending = 0;
+  }
+  PROCESS_END();
+}
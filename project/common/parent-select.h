@@ -0,0 +1,132 @@
+#ifndef PARENT_SELECT_H_
+#define PARENT_SELECT_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+#include "protocol.h"
+
+/*
+ * Parent selection of the sensors. Every node that takes children answers
+ * a sensor's broadcast DISCOVERY with a broadcast OFFER of its depth
+ * (sensors between it and its coordinator, 0 for a coordinator) and its
+ * load: the readings its subtree brings to the slot of its coordinator, in
+ * percent of PARENT_SELECT_CAPACITY, and at least the load of its own
+ * parent for a sensor, since the readings go through that slot too. A
+ * coordinator's SCHEDULE, or its POLL when it lists all its children,
+ * tells the same load to whoever hears it.
+ *
+ * An answer goes out after a random backoff of up to PARENT_SELECT_BACKOFF,
+ * the nodes around do not all answer at once, and each OFFER serves all
+ * the sensors searching around. A node drops its own once it heard
+ * PARENT_SELECT_REDUNDANCY cheaper ones meanwhile, on load and depth: the
+ * sensors have better ones. The coordinators also send theirs unasked at
+ * the start of their slot, on a Trickle timer (see trickle.h) counted in
+ * periods, from one up to PARENT_SELECT_ADVERT_DOUBLINGS doublings, quiet
+ * as long as cheaper ones are heard: anew once they join a border, or have
+ * room again, for the sensors to find them. The sensors solicit on a
+ * Trickle timer too, from PARENT_SELECT_SEARCH on, sooner again once they
+ * hear a coordinator.
+ *
+ * A sensor keeps the offers it hears with a smoothed RSSI and LQI, and the
+ * ETX of its parent from the rounds it was not asked in, and joins the one
+ * that costs least: load, a penalty per hop, for a weak link and for
+ * missed rounds. Now and then, under a busy or lossy parent, it moves if a
+ * coordinator it heard costs less than its parent by more than what it
+ * would bring and PARENT_SELECT_HYSTERESIS, only to a node no deeper than
+ * its parent, which cannot be in its own subtree. Its children come along.
+ *
+ * The offers double as backups: a parent that stops asking us for
+ * PARENT_SELECT_MISSED periods, or never does after we joined, is
+ * forgotten, and the sensor joins the cheapest offer heard lately at once,
+ * with its children, instead of searching anew. Without children, any
+ * depth will do.
+ */
+
+#define PARENT_SELECT_MAX 8 // offers remembered
+// Readings in a slot for a load of 100
+#define PARENT_SELECT_CAPACITY 16
+// Load of a node that takes no more children
+#define PARENT_SELECT_FULL 255
+// Deepest offer a sensor without a parent takes, its own depth must fit in
+// a byte
+#define PARENT_SELECT_MAX_DEPTH 254
+// Per sensor between the candidate and its coordinator, in load points: a
+// sensor is only worth it next to a much busier coordinator, or a weak one
+#define PARENT_SELECT_HOP_COST 50
+// Links weaker than this cost PARENT_SELECT_RSSI_COST per dBm
+#define PARENT_SELECT_WEAK_RSSI -80
+#define PARENT_SELECT_RSSI_COST 4
+// Same for the LQI, on radios that give one (the CC2420's goes from about
+// 50 to 110)
+#define PARENT_SELECT_WEAK_LQI 90
+#define PARENT_SELECT_LQI_COST 2
+#define PARENT_SELECT_NO_LQI -1
+// ETX in eighths: a round we were not asked in counts as that many
+// transmissions, and costs PARENT_SELECT_ETX_COST per transmission above one
+#define PARENT_SELECT_ETX_ONE 8
+#define PARENT_SELECT_ETX_MISS 4
+#define PARENT_SELECT_ETX_COST 20
+// From which a parent is surveyed at once
+#define PARENT_SELECT_ETX_BAD (2 * PARENT_SELECT_ETX_ONE)
+// Cost from which a sensor looks for another parent
+#define PARENT_SELECT_BUSY 60
+#define PARENT_SELECT_HYSTERESIS 20
+// Periods between the checks of a sensor, up to as many again depending on
+// its address; doubled after each survey that found nothing better, at
+// most PARENT_SELECT_CHECK_BACKOFF times
+#define PARENT_SELECT_CHECK 16
+#define PARENT_SELECT_CHECK_BACKOFF 3
+// Periods without a round after which a parent is lost: a lossy link
+// easily drops two in a row
+#define PARENT_SELECT_MISSED 3
+// Within the shortest window of the nodes that could answer, a POLL's
+// micro-slots
+#define PARENT_SELECT_BACKOFF POLL_GUARD
+#define PARENT_SELECT_REDUNDANCY 2
+#define PARENT_SELECT_ADVERT_DOUBLINGS 4
+// First interval of the DISCOVERY of a sensor without a parent, doubled up
+// to PARENT_SELECT_SEARCH << PARENT_SELECT_SEARCH_DOUBLINGS while no offer
+// comes. Suppressed by PARENT_SELECT_SEARCH_REDUNDANCY others heard, 0 for
+// never: a sensor that keeps quiet joins on the offers another one got,
+// older than the joins they bring, and they all pile onto the same parent.
+#define PARENT_SELECT_SEARCH(period) ((period) / 2)
+#define PARENT_SELECT_SEARCH_DOUBLINGS 4
+#define PARENT_SELECT_SEARCH_REDUNDANCY 0
+
+typedef struct parent_candidate {
+  linkaddr_t addr;
+  uint8_t depth;
+  uint8_t load;
+  uint8_t etx; // in eighths, from the rounds it was our parent
+  int16_t rssi; // moving average, the last offer weighs 1/4
+  int16_t lqi; // same, PARENT_SELECT_NO_LQI without one
+  clock_time_t heard;
+} parent_candidate_t;
+
+// Forgets the offers heard
+void parent_select_init(void);
+// A sensor's DISCOVERY, heard by a node of type node that takes children
+// at depth with load: its OFFER goes out after the backoff
+void parent_select_solicited(node_type node, uint8_t depth, uint8_t load);
+// Once per period, when the sensors listen to us: sends our OFFER unasked
+// if its Trickle timer says so, from a period on again if restart (a
+// parent of our own found)
+void parent_select_advertise(node_type node, uint8_t depth, uint8_t load, int restart);
+// Someone's OFFER heard, ours may be redundant
+void parent_select_offered(uint8_t depth, uint8_t load);
+// The offer of addr being received
+void parent_select_heard(const linkaddr_t *addr, uint8_t depth, uint8_t load);
+const parent_candidate_t *parent_select_lookup(const linkaddr_t *addr);
+// The offer of addr is no backup: it is lost
+void parent_select_forget(const linkaddr_t *addr);
+// A round of our parent addr, in which it asked us or not
+void parent_select_round(const linkaddr_t *addr, int asked);
+unsigned parent_select_cost(const parent_candidate_t *p);
+// The cheapest offer heard since "since", at most max_depth deep, that
+// still takes children, NULL if none
+const parent_candidate_t *parent_select_best(clock_time_t since, uint8_t max_depth);
+// What a node with "children" children among at most max_children, and
+// "readings" in its subtree, advertises
+uint8_t parent_select_load(unsigned readings, unsigned children, unsigned max_children);
+
+#endif /* PARENT_SELECT_H_ */
@@ -0,0 +1,337 @@
+#include "protocol.h"
+#include "duty-cycle.h"
+#include "net/netstack.h"
+#include "net/nullnet/nullnet.h"
+#include <string.h>
+
+static uint8_t frame[PROTOCOL_MAX_LEN];
+
+unsigned put_u16(uint8_t *buf, unsigned pos, uint16_t value) {
+  buf[pos] = value & 0xff;
+  buf[pos+1] = value >> 8;
+  return pos + 2;
+}
+
+unsigned put_u32(uint8_t *buf, unsigned pos, uint32_t value) {
+  pos = put_u16(buf, pos, value & 0xffff);
+  return put_u16(buf, pos, value >> 16);
+}
+
+uint16_t get_u16(const uint8_t *buf) {
+  return buf[0] | (buf[1] << 8);
+}
+
+uint32_t get_u32(const uint8_t *buf) {
+  return get_u16(buf) | ((uint32_t)get_u16(buf + 2) << 16);
+}
+
+static unsigned message_len(packet_type type) {
+  switch (type) {
+  case DISCOVERY_TYPE: return DISCOVERY_LEN;
+  case MESSAGE_TYPE: return MESSAGE_LEN;
+  case SYNCHRO_TYPE: return SYNCHRO_LEN;
+  case SLOT_TYPE: return SLOT_LEN;
+  case AGGREGATE_TYPE: return AGGREGATE_MSG_LEN;
+  case CONFIG_TYPE: return CONFIG_LEN;
+  case OFFER_TYPE: return OFFER_LEN;
+  case RELAY_TYPE: return RELAY_LEN;
+  default: return 0; // POLL and SCHEDULE depend on their count
+
+  }
+}
+
+unsigned protocol_encode(const message_t *m, uint8_t *buf) {
+  unsigned pos = 1;
+  buf[0] = (PROTOCOL_VERSION << 6) | ((m->node & 0x3) << 4) | (m->type & 0xf);
+  switch (m->type) {
+  case DISCOVERY_TYPE:
+  case OFFER_TYPE:
+  case RELAY_TYPE:
+    buf[pos++] = m->payload;
+    buf[pos++] = m->load;
+    break;
+  case MESSAGE_TYPE:
+    // a request never gives more than a period to answer
+    pos = put_u16(buf, pos, m->clock);
+    buf[pos++] = m->round;
+    break;
+  case SYNCHRO_TYPE:
+    buf[pos++] = m->payload;
+    pos = put_u32(buf, pos, m->clock);
+    buf[pos++] = m->sync_error;
+    break;
+  case SLOT_TYPE:
+    pos = put_u16(buf, pos, m->slot_start);
+    pos = put_u16(buf, pos, m->slot_duration);
+    pos = put_u32(buf, pos, m->clock);
+    break;
+  case AGGREGATE_TYPE:
+    buf[pos++] = m->round;
+    pos += aggregate_encode(&m->aggregate, buf + pos);
+    pos += energy_encode(&m->energy, buf + pos);
+    break;
+  case SCHEDULE_TYPE:
+  case POLL_TYPE:
+    if (m->poll_count > POLL_MAX) {
+      return 0;
+    }
+    buf[pos++] = m->micro_slot;
+    buf[pos++] = m->poll_count;
+    buf[pos++] = m->round;
+    memcpy(buf + pos, m->poll, m->poll_count * POLL_ENTRY_LEN);
+    pos += m->poll_count * POLL_ENTRY_LEN;
+    break;
+  case CONFIG_TYPE:
+    buf[pos++] = m->config.version;
+    pos = put_u16(buf, pos, m->config.period);
+    buf[pos++] = m->config.timeout;
+    buf[pos++] = m->config.short_timeout;
+    pos = put_u32(buf, pos, m->clock);
+    break;
+  default:
+    return 0;
+  }
+  return pos;
+}
+
+int protocol_decode(message_t *m, const void *data, uint16_t len) {
+  const uint8_t *buf = data;
+  if (len < 1 || (buf[0] >> 6) != PROTOCOL_VERSION) {
+    return 0;
+  }
+  m->node = (buf[0] >> 4) & 0x3;
+  m->type = buf[0] & 0xf;
+  if (m->type == POLL_TYPE || m->type == SCHEDULE_TYPE) {
+    if (len < POLL_LEN(0) || len != POLL_LEN(buf[2]) || buf[2] > POLL_MAX) {
+      return 0;
+    }
+  } else if (len != message_len(m->type)) {
+    return 0;
+  }
+  m->payload = 0;
+  m->load = 0;
+  m->clock = 0;
+  m->round = 0;
+  switch (m->type) {
+  case DISCOVERY_TYPE:
+  case OFFER_TYPE:
+  case RELAY_TYPE:
+    m->payload = buf[1];
+    m->load = buf[2];
+    break;
+  case MESSAGE_TYPE:
+    m->clock = get_u16(buf + 1);
+    m->round = buf[3];
+    break;
+  case SYNCHRO_TYPE:
+    m->payload = buf[1];
+    m->clock = get_u32(buf + 2);
+    m->sync_error = buf[6];
+    break;
+  case SLOT_TYPE:
+    m->slot_start = get_u16(buf + 1);
+    m->slot_duration = get_u16(buf + 3);
+    m->clock = get_u32(buf + 5);
+    break;
+  case AGGREGATE_TYPE:
+    m->round = buf[1];
+    energy_decode(&m->energy, buf + 2 + aggregate_decode(&m->aggregate, buf + 2));
+    break;
+  case POLL_TYPE:
+  case SCHEDULE_TYPE:
+    m->micro_slot = buf[1];
+    m->poll_count = buf[2];
+    m->round = buf[3];
+    m->poll = buf + 4;
+    break;
+  case CONFIG_TYPE:
+    m->config.version = buf[1];
+    m->config.period = get_u16(buf + 2);
+    m->config.timeout = buf[4];
+    m->config.short_timeout = buf[5];
+    m->clock = get_u32(buf + 6);
+    if (m->config.period < NET_CONFIG_PERIOD_MIN || m->config.period > NET_CONFIG_PERIOD_MAX) {
+      return 0; // would break every node's timing
+    }
+    break;
+  default:
+    return 0;
+  }
+  return 1;
+}
+
+void protocol_send(const message_t *m, const linkaddr_t *dest) {
+  nullnet_buf = frame;
+  nullnet_len = protocol_encode(m, frame);
+  if (nullnet_len > 0) {
+    NETSTACK_NETWORK.output(dest);
+#if DUTY_CYCLE
+    duty_cycle_sent();
+#endif
+  }
+}
+
+void send_pkt(node_type node, packet_type type, uint8_t payload, clock_time_t clock_v, const linkaddr_t *dest) {
+  message_t m;
+  m.node = node;
+  m.type = type;
+  m.payload = payload;
+  m.load = 0;
+  m.clock = clock_v;
+  m.sync_error = 0;
+  protocol_send(&m, dest);
+}
+
+void send_discovery(node_type node, uint8_t payload, uint8_t load, const linkaddr_t *dest) {
+  message_t m;
+  m.node = node;
+  m.type = DISCOVERY_TYPE;
+  m.payload = payload;
+  m.load = load;
+  protocol_send(&m, dest);
+}
+
+void send_offer(node_type node, uint8_t depth, uint8_t load) {
+  message_t m;
+  m.node = node;
+  m.type = OFFER_TYPE;
+  m.payload = depth;
+  m.load = load;
+  protocol_send(&m, NULL);
+}
+
+void send_synchro(node_type node, uint8_t payload, clock_time_t clock_v, uint8_t sync_error, const linkaddr_t *dest) {
+  message_t m;
+  m.node = node;
+  m.type = SYNCHRO_TYPE;
+  m.payload = payload;
+  m.clock = clock_v;
+  m.sync_error = sync_error;
+  protocol_send(&m, dest);
+}
+
+void send_slot(node_type node, clock_time_t start, clock_time_t duration_v, clock_time_t clock_v, const linkaddr_t *dest) {
+  message_t m;
+  m.node = node;
+  m.type = SLOT_TYPE;
+  m.slot_start = start;
+  m.slot_duration = duration_v;
+  m.clock = clock_v;
+  protocol_send(&m, dest);
+}
+
+void send_request(node_type node, clock_time_t time_left, uint8_t round, const linkaddr_t *dest) {
+  message_t m;
+  m.node = node;
+  m.type = MESSAGE_TYPE;
+  m.clock = time_left;
+  m.round = round;
+  protocol_send(&m, dest);
+}
+
+void send_aggregate(node_type node, const aggregate_t *a, uint8_t round, const energy_t *e, const linkaddr_t *dest) {
+  message_t m;
+  m.node = node;
+  m.type = AGGREGATE_TYPE;
+  m.round = round;
+  memcpy(&m.aggregate, a, sizeof(aggregate_t));
+  memcpy(&m.energy, e, sizeof(energy_t));
+#if AGGREGATE_TRACE_HOPS > 0
+  if (m.aggregate.count > 0) {
+    aggregate_trace_hop(&m.aggregate.trace); // how long we held it
+  }
+#endif
+  protocol_send(&m, dest);
+}
+
+// Lists the children of the table that have not answered yet, returns the
+// micro-slot length that fits them in window
+static clock_time_t fill_poll(message_t *m, neighbor_table_t *t, const uint8_t *slots, const uint8_t *answered, clock_time_t window) {
+  static uint8_t entries[POLL_MAX * POLL_ENTRY_LEN];
+  unsigned total = 0;
+  clock_time_t micro = POLL_MICRO_SLOT;
+
+  m->poll_count = 0;
+  m->poll = entries;
+  for (int i = 0; i < neighbor_table_count(t) && m->poll_count < POLL_MAX; i++) {
+    neighbor_t *n = neighbor_table_get(t, i);
+    uint8_t s = slots[neighbor_table_index(t, n)];
+    if (answered != NULL && answered[neighbor_table_index(t, n)]) {
+      continue;
+    }
+    if (s == 0) {
+      s = 1;
+    }
+    entries[m->poll_count*POLL_ENTRY_LEN] = n->addr.u8[0];
+    entries[m->poll_count*POLL_ENTRY_LEN+1] = n->addr.u8[1];
+    entries[m->poll_count*POLL_ENTRY_LEN+2] = s;
+    m->poll_count++;
+    total += s;
+  }
+  if (total * micro > window) {
+    micro = total > 0 ? window / total : 0;
+    if (micro == 0) {
+      micro = 1; // late answers are still merged
+    }
+  }
+  m->micro_slot = micro;
+  return total * micro;
+}
+
+clock_time_t send_poll(node_type node, neighbor_table_t *t, const uint8_t *slots, const uint8_t *answered, clock_time_t window, uint8_t round) {
+  message_t m;
+  clock_time_t answers;
+  m.node = node;
+  m.type = POLL_TYPE;
+  m.round = round;
+  answers = fill_poll(&m, t, slots, answered, window);
+  protocol_send(&m, NULL);
+  return answers;
+}
+
+clock_time_t send_schedule(node_type node, neighbor_table_t *t, const uint8_t *slots, clock_time_t window, uint8_t round) {
+  message_t m;
+  clock_time_t answers;
+  m.node = node;
+  m.type = SCHEDULE_TYPE;
+  m.round = round;
+  answers = fill_poll(&m, t, slots, NULL, window);
+  protocol_send(&m, NULL);
+  return answers;
+}
+
+int poll_lookup(const message_t *m, const linkaddr_t *addr, clock_time_t *start, clock_time_t *length) {
+  unsigned before = 0;
+  for (int i = 0; i < m->poll_count; i++) {
+    const uint8_t *e = m->poll + i*POLL_ENTRY_LEN;
+    if (e[0] == addr->u8[0] && e[1] == addr->u8[1]) {
+      *start = before * m->micro_slot;
+      *length = e[2] * m->micro_slot;
+      return 1;
+    }
+    before += e[2];
+  }
+  return 0;
+}
+
+int poll_position(const message_t *m, const linkaddr_t *addr) {
+  for (int i = 0; i < m->poll_count; i++) {
+    const uint8_t *e = m->poll + i*POLL_ENTRY_LEN;
+    if (e[0] == addr->u8[0] && e[1] == addr->u8[1]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+unsigned poll_slots(const message_t *m) {
+  unsigned total = 0;
+  for (int i = 0; i < m->poll_count; i++) {
+    total += m->poll[i*POLL_ENTRY_LEN+2];
+  }
+  return total;
+}
+
+clock_time_t poll_end(const message_t *m) {
+  return poll_slots(m) * m->micro_slot;
+}
@@ -0,0 +1,181 @@
+#ifndef PROTOCOL_H_
+#define PROTOCOL_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+#include "aggregate.h"
+#include "energy.h"
+#include "neighbor-table.h"
+#include "net-config.h"
+
+/*
+ * Frames exchanged by the border, the coordinators and the sensors.
+ * Each frame starts with one header byte:
+ *   version (2 bits) | node type of the sender (2 bits) | message type (4 bits)
+ * followed by the fields of its message type, multi-byte fields LSB first.
+ * A frame is only accepted if its version matches and its length is the one
+ * of its type, so nodes never depend on how the compiler lays out a struct.
+ */
+
+#define PROTOCOL_VERSION 0 // on 2 bits, after 3
+
+// Parents collect their children's answers with one broadcast POLL, each
+// child answering in its own micro-slots, instead of one MESSAGE request
+// per child. Sensors answer both.
+#ifdef PROTOCOL_CONF_POLL
+#define PROTOCOL_POLL PROTOCOL_CONF_POLL
+#else
+#define PROTOCOL_POLL 1
+#endif
+
+// Long enough for one answer and its ack, CSMA backoff included
+#ifdef POLL_CONF_MICRO_SLOT
+#define POLL_MICRO_SLOT POLL_CONF_MICRO_SLOT
+#else
+#define POLL_MICRO_SLOT (CLOCK_SECOND / 64)
+#endif
+
+// CSMA draws up to 2^3 - 1 backoff periods (one tick on a Z1) before the
+// first attempt, an answer can land that late after its micro-slot
+#ifdef POLL_CONF_GUARD
+#define POLL_GUARD POLL_CONF_GUARD
+#else
+#define POLL_GUARD (CLOCK_SECOND / 16)
+#endif
+
+#define POLL_MAX 16 // children listed in one POLL
+
+// The border sizes the slot of a coordinator from the number of sensors it
+// reports: SLOT_BASE plus SLOT_PER_SENSOR per sensor
+#define SLOT_BASE (CLOCK_SECOND / 8) // coordinator alone, reply to the border
+#if PROTOCOL_POLL
+#define SLOT_PER_SENSOR POLL_MICRO_SLOT // one answer to the coordinator's POLL
+#else
+#define SLOT_PER_SENSOR (CLOCK_SECOND / 16) // one request/response with a sensor
+#endif
+
+// Coordinators hand their sensors a SCHEDULE, a POLL that also holds for
+// the next periods: the sensors then push their answer in the same window
+// every period, unasked, and a POLL only recovers the missing ones.
+// Needs PROTOCOL_POLL.
+#ifdef PROTOCOL_CONF_PUSH
+#define PROTOCOL_PUSH PROTOCOL_CONF_PUSH
+#else
+#define PROTOCOL_PUSH PROTOCOL_POLL
+#endif
+
+// Periods after which an unchanged SCHEDULE is sent again: the sensors
+// count periods on their own clock, the coordinator on the network clock.
+// It is also all they hear from their parent, so it must stay well under
+// the 10 periods after which they give up on it.
+#define SCHEDULE_REFRESH 4
+
+typedef enum {
+  SENSOR_NODE = 0,
+  COORDINATOR_NODE = 1,
+  BORDER_NODE = 2,
+  UNDEFINED_NODE = 3
+} node_type;
+
+typedef enum {
+  DISCOVERY_TYPE = 0, // payload, load
+  MESSAGE_TYPE = 1, // clock: time left to answer the request, round
+  SYNCHRO_TYPE = 2, // payload, clock, sync_error
+  SLOT_TYPE = 3, // slot_start, slot_duration, clock
+  AGGREGATE_TYPE = 4, // round, aggregate, energy: answer to a MESSAGE request or a POLL
+  POLL_TYPE = 5, // micro_slot, poll_count, round, poll
+  SCHEDULE_TYPE = 6, // as POLL
+  // config, clock: the boundary it takes over at, on the network clock
+  // from the border, in ticks from the frame from the others (see
+  // net-config.h)
+  CONFIG_TYPE = 7,
+  // payload (depth), load: broadcast answer to a sensor's DISCOVERY, see
+  // parent-select.h
+  OFFER_TYPE = 8,
+  // payload (hops to the border): unicast answer to the DISCOVERY of a
+  // coordinator out of range of the borders, an offer to relay for it
+  RELAY_TYPE = 9
+} packet_type;
+
+// SYNCHRO payload of the broadcast sent by a node that lost its parent,
+// its clock the channel its children should look on first (0 for any),
+// and of a coordinator leaving its border, to it
+#define DEAD 42
+
+typedef struct message {
+  node_type node;
+  packet_type type;
+  uint8_t payload; // number of children, or DEAD
+  uint8_t load; // of the sender of a DISCOVERY or an OFFER, see border-select.h
+  clock_time_t clock;
+  uint8_t sync_error; // bound on the error of the clock, in ticks
+  uint16_t slot_start; // offset from the start of the period
+  uint16_t slot_duration;
+  aggregate_t aggregate;
+  energy_t energy; // of the sender and the peak of its subtree
+  // Period the readings were taken in, counted by the coordinators from the
+  // network clock. Requests carry the round being collected, an AGGREGATE
+  // the round of its readings, older for a node with children.
+  uint8_t round;
+  uint8_t micro_slot; // in clock ticks
+  uint8_t poll_count;
+  // poll_count entries of POLL_ENTRY_LEN bytes in answer order: child
+  // address (2) then its number of micro-slots (1). Points into the frame.
+  const uint8_t *poll;
+  net_config_t config;
+} message_t;
+
+// Size of each message type on the air, header included
+#define DISCOVERY_LEN 3
+#define OFFER_LEN DISCOVERY_LEN
+#define RELAY_LEN DISCOVERY_LEN
+#define MESSAGE_LEN 4
+#define SYNCHRO_LEN 7
+#define SLOT_LEN 9
+#define CONFIG_LEN 10
+#define AGGREGATE_MSG_LEN (2 + AGGREGATE_LEN + ENERGY_LEN)
+#define POLL_ENTRY_LEN 3
+#define POLL_LEN(count) (4 + (count) * POLL_ENTRY_LEN)
+#define PROTOCOL_MAX_LEN (POLL_LEN(POLL_MAX) > AGGREGATE_MSG_LEN ? POLL_LEN(POLL_MAX) : AGGREGATE_MSG_LEN)
+
+// Little-endian fields of the frames and of the border's report: put
+// returns the position after the field
+unsigned put_u16(uint8_t *buf, unsigned pos, uint16_t value);
+unsigned put_u32(uint8_t *buf, unsigned pos, uint32_t value);
+uint16_t get_u16(const uint8_t *buf);
+uint32_t get_u32(const uint8_t *buf);
+
+// Returns the number of bytes written, 0 for an unknown type
+unsigned protocol_encode(const message_t *m, uint8_t *buf);
+// Returns 1 if the frame is a valid message
+int protocol_decode(message_t *m, const void *data, uint16_t len);
+
+// Encode and hand to NullNet, dest NULL broadcasts
+void protocol_send(const message_t *m, const linkaddr_t *dest);
+void send_pkt(node_type node, packet_type type, uint8_t payload, clock_time_t clock_v, const linkaddr_t *dest);
+void send_discovery(node_type node, uint8_t payload, uint8_t load, const linkaddr_t *dest);
+void send_offer(node_type node, uint8_t depth, uint8_t load);
+void send_synchro(node_type node, uint8_t payload, clock_time_t clock_v, uint8_t sync_error, const linkaddr_t *dest);
+void send_slot(node_type node, clock_time_t start, clock_time_t duration_v, clock_time_t clock_v, const linkaddr_t *dest);
+void send_request(node_type node, clock_time_t time_left, uint8_t round, const linkaddr_t *dest);
+void send_aggregate(node_type node, const aggregate_t *a, uint8_t round, const energy_t *e, const linkaddr_t *dest);
+
+// Broadcasts a POLL of the children of the table, in table order, leaving
+// out those with answered[neighbor_table_index(t, n)] set (answered may be
+// NULL). Child n gets slots[neighbor_table_index(t, n)] micro-slots (its
+// subtree, at least 1), shrunk if needed to fit in window. Returns when the
+// last answer is due.
+clock_time_t send_poll(node_type node, neighbor_table_t *t, const uint8_t *slots, const uint8_t *answered, clock_time_t window, uint8_t round);
+// Same as a POLL of all the children, as a SCHEDULE
+clock_time_t send_schedule(node_type node, neighbor_table_t *t, const uint8_t *slots, clock_time_t window, uint8_t round);
+// Where the window of addr starts after the POLL or SCHEDULE and how long
+// it is, returns 0 if addr is not listed
+int poll_lookup(const message_t *m, const linkaddr_t *addr, clock_time_t *start, clock_time_t *length);
+// Position of addr in the POLL or SCHEDULE, -1 if it is not listed
+int poll_position(const message_t *m, const linkaddr_t *addr);
+// Micro-slots of all the children listed: the readings of their subtrees
+unsigned poll_slots(const message_t *m);
+// When the last answer to the POLL or SCHEDULE is due, after it
+clock_time_t poll_end(const message_t *m);
+
+#endif /* PROTOCOL_H_ */
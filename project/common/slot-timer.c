@@ -0,0 +1,98 @@
+#include "slot-timer.h"
+
+#define SLOT_TIMER_OFF 0
+#define SLOT_TIMER_ETIMER 1 // up to the tick before
+#define SLOT_TIMER_RTIMER 2
+#define SLOT_TIMER_FIRED 3 // its process polled, jitter not measured yet
+
+static struct rtimer rtimer;
+static slot_timer_t *armed; // the one the rtimer is for, NULL if none
+
+// Rtimer time at which the local clock turns "at"
+static rtimer_clock_t rtimer_time(clock_time_t at) {
+  return (rtimer_clock_t)(at * SLOT_TIMER_TICK);
+}
+
+static void expire(struct rtimer *rt, void *ptr) {
+  slot_timer_t *t = armed;
+  if (t == NULL || t->state != SLOT_TIMER_RTIMER) {
+    return; // stopped meanwhile
+  }
+  // set while an older one was pending, the rtimer kept the older time
+  if (RTIMER_CLOCK_LT(RTIMER_NOW(), rtimer_time(t->at))) {
+    rtimer_set(&rtimer, rtimer_time(t->at), 0, expire, NULL);
+    return;
+  }
+  armed = NULL;
+  t->state = SLOT_TIMER_FIRED;
+  process_poll(t->p);
+}
+
+// Within the tick before its time: the rtimer for the rest, unless the
+// time came already (it would only come back when the rtimer wraps)
+static void arm(slot_timer_t *t) {
+#if MAC_CONF_WITH_TSCH
+  t->state = SLOT_TIMER_FIRED;
+#else
+  if (!RTIMER_CLOCK_LT(RTIMER_NOW(), rtimer_time(t->at))) {
+    t->state = SLOT_TIMER_FIRED;
+    return;
+  }
+  t->state = SLOT_TIMER_RTIMER;
+  armed = t;
+  rtimer_set(&rtimer, rtimer_time(t->at), 0, expire, NULL);
+#endif /* MAC_CONF_WITH_TSCH */
+}
+
+void slot_timer_init(slot_timer_t *t) {
+  t->state = SLOT_TIMER_OFF;
+  t->late = 0;
+  t->max_late = 0;
+}
+
+void slot_timer_set(slot_timer_t *t, clock_time_t at) {
+  clock_time_t now = clock_time();
+#if MAC_CONF_WITH_TSCH
+  clock_time_t lead = 0; // the etimer all the way
+#else
+  clock_time_t lead = 1;
+#endif /* MAC_CONF_WITH_TSCH */
+  slot_timer_stop(t);
+  t->p = PROCESS_CURRENT();
+  t->at = at;
+  if ((int32_t)(at - now) > (int32_t)lead) {
+    etimer_set(&t->etimer, at - lead - now);
+    t->state = SLOT_TIMER_ETIMER;
+  } else {
+    arm(t);
+    if (t->state == SLOT_TIMER_FIRED) {
+      process_poll(t->p); // the process waits for an event
+    }
+  }
+}
+
+int slot_timer_expired(slot_timer_t *t) {
+  if (t->state == SLOT_TIMER_ETIMER && etimer_expired(&t->etimer)) {
+    arm(t);
+  }
+  if (t->state == SLOT_TIMER_FIRED) {
+    int16_t late = RTIMER_CLOCK_DIFF(RTIMER_NOW(), rtimer_time(t->at));
+    int32_t us = late > 0 ? RTIMERTICKS_TO_US(late) : 0;
+    t->late = us < 0xffff ? us : 0xffff;
+    if (t->late > t->max_late) {
+      t->max_late = t->late;
+    }
+    t->state = SLOT_TIMER_OFF;
+  }
+  return t->state == SLOT_TIMER_OFF;
+}
+
+void slot_timer_stop(slot_timer_t *t) {
+  if (t->state == SLOT_TIMER_ETIMER) {
+    etimer_stop(&t->etimer);
+  }
+  if (armed == t) {
+    armed = NULL;
+  }
+  t->state = SLOT_TIMER_OFF;
+}
@@ -0,0 +1,52 @@
+#ifndef SLOT_TIMER_H_
+#define SLOT_TIMER_H_
+
+#include "contiki.h"
+#include "sys/rtimer.h"
+
+/*
+ * Precise wake-ups of a process for the slot boundaries, the micro-slots
+ * and the beacons. An etimer fires on a tick of the clock at best (1/128 s
+ * on a Z1), and its process only runs once the etimer process and the
+ * events queued before have. A slot timer waits on an etimer up to the
+ * tick before its time, then on the rtimer (1/32768 s), whose callback, in
+ * interrupt context, only polls the process: the frame still goes through
+ * NullNet from the process, the poll comes before any queued event.
+ *
+ * Times are on the local clock. The Z1 counts the clock and the rtimer on
+ * the same crystal from the same start, a clock tick every
+ * SLOT_TIMER_TICK rtimer ticks, which gives the rtimer time of any tick.
+ * There is one rtimer: one slot timer of the node runs at a time, the one
+ * set last. TSCH drives the rtimer for its own slots, the etimer alone
+ * does it there.
+ *
+ * Each wake-up measures how late the process runs after its time, in
+ * microseconds: the jitter of the slot starts.
+ *
+ * The times stay on clock ticks: what the rtimer takes off is the latency
+ * of the process behind the etimer, not the tick. Finer slot starts and
+ * micro-slots would not let them shrink, the CSMA of the Z1 draws its
+ * backoff in whole ticks (up to 7 before a first attempt) and the guards
+ * follow the clock sync error, in ticks too.
+ */
+
+#define SLOT_TIMER_TICK (RTIMER_SECOND / CLOCK_SECOND)
+
+typedef struct slot_timer {
+  struct etimer etimer; // up to the tick before
+  struct process *p;
+  clock_time_t at;
+  uint8_t state;
+  uint16_t late; // us, of the last wake-up
+  uint16_t max_late; // us, since slot_timer_init
+} slot_timer_t;
+
+void slot_timer_init(slot_timer_t *t);
+// Wakes the current process at "at" (local clock), with PROCESS_EVENT_POLL
+void slot_timer_set(slot_timer_t *t, clock_time_t at);
+// Whether its time came, for PROCESS_WAIT_EVENT_UNTIL: called on each
+// event, it also takes the etimer over to the rtimer
+int slot_timer_expired(slot_timer_t *t);
+void slot_timer_stop(slot_timer_t *t);
+
+#endif /* SLOT_TIMER_H_ */
@@ -0,0 +1,49 @@
+#include "trickle.h"
+#include "lib/random.h"
+
+static void begin(trickle_t *t, clock_time_t start, clock_time_t i) {
+  t->start = start;
+  t->i = i;
+  t->t = i / 2 + random_rand() % (i - i / 2);
+  t->c = 0;
+  t->done = 0;
+}
+
+void trickle_init(trickle_t *t, clock_time_t imin, uint8_t doublings, uint8_t k, clock_time_t now) {
+  t->imin = imin > 0 ? imin : 1;
+  t->doublings = doublings;
+  t->k = k;
+  begin(t, now, t->imin);
+}
+
+void trickle_reset(trickle_t *t, clock_time_t now) {
+  if (t->i != t->imin) {
+    begin(t, now, t->imin);
+  }
+}
+
+void trickle_heard(trickle_t *t) {
+  if (t->c < 255) {
+    t->c++;
+  }
+}
+
+clock_time_t trickle_next(const trickle_t *t) {
+  return t->start + (t->done ? t->i : t->t);
+}
+
+uint8_t trickle_run(trickle_t *t, clock_time_t now) {
+  uint8_t r = 0;
+  if (!t->done && (int32_t)(now - (t->start + t->t)) >= 0) {
+    t->done = 1;
+    if (t->k == 0 || t->c < t->k) {
+      r |= TRICKLE_SEND;
+    }
+  }
+  if (t->done && (int32_t)(now - (t->start + t->i)) >= 0) {
+    // from the end of the last one, however late we are
+    begin(t, t->start + t->i, t->i < (t->imin << t->doublings) ? 2 * t->i : t->i);
+    r |= TRICKLE_END;
+  }
+  return r;
+}
@@ -0,0 +1,48 @@
+#ifndef TRICKLE_H_
+#define TRICKLE_H_
+
+#include "contiki.h"
+
+/*
+ * Trickle timers (RFC 6206) for the control traffic that only matters when
+ * something changes: the DISCOVERY of a sensor looking for a parent, the
+ * CONFIG a parent sends again to its children. An interval starts at imin
+ * and doubles after each one, up to imin << doublings. Its transmission is
+ * due at a random time of its second half, and suppressed if k consistent
+ * transmissions were heard in the interval by then (k 0: never). Something
+ * new, inconsistent, starts over at imin: quiet when nothing changes, fast
+ * when something does.
+ *
+ * The owner drives it from its own process, in the unit of its choice
+ * (clock ticks, periods): it waits until trickle_next() and calls
+ * trickle_run() with the time.
+ */
+
+// Returned by trickle_run, or'ed
+#define TRICKLE_SEND 0x01 // the transmission of the interval is due now
+#define TRICKLE_END 0x02 // the interval ended, the next one started
+
+typedef struct trickle {
+  clock_time_t imin;
+  uint8_t doublings;
+  uint8_t k;
+  uint8_t c; // consistent transmissions heard in the interval
+  uint8_t done; // the transmission of the interval is behind
+  clock_time_t start; // of the interval
+  clock_time_t i; // its length
+  clock_time_t t; // its transmission, from start
+} trickle_t;
+
+// A first interval at imin from now
+void trickle_init(trickle_t *t, clock_time_t imin, uint8_t doublings, uint8_t k, clock_time_t now);
+// Inconsistent: a new interval at imin from now, unless the interval is
+// at imin already (RFC 6206)
+void trickle_reset(trickle_t *t, clock_time_t now);
+// Consistent
+void trickle_heard(trickle_t *t);
+// When trickle_run has something to do
+clock_time_t trickle_next(const trickle_t *t);
+// At trickle_next() or later: what it did, 0 for nothing
+uint8_t trickle_run(trickle_t *t, clock_time_t now);
+
+#endif /* TRICKLE_H_ */
@@ -0,0 +1,59 @@
+#include "tsch-cells.h"
+
+#if MAC_CONF_WITH_TSCH
+#include "net/mac/tsch/tsch.h"
+
+static struct tsch_slotframe *slotframe;
+static struct tsch_link *up;
+static struct tsch_link *down[TSCH_CELLS_PER_TIER];
+static uint8_t down_tier;
+
+static uint16_t timeslot_of(uint8_t tier, uint8_t cell) {
+  uint16_t d = tier * TSCH_CELLS_PER_TIER + cell % TSCH_CELLS_PER_TIER;
+  return d + d / 3 + 1; // skip the shared timeslots
+}
+
+static uint16_t channel_of(const linkaddr_t *receiver) {
+  return receiver->u8[0] % TSCH_CELLS_CHANNELS;
+}
+
+void tsch_cells_init(void) {
+  slotframe = tsch_schedule_add_slotframe(0, TSCH_CELLS_LENGTH);
+  for (uint16_t t = 0; t < TSCH_CELLS_LENGTH; t += 4) {
+    tsch_schedule_add_link(slotframe, LINK_OPTION_TX | LINK_OPTION_RX | LINK_OPTION_SHARED | LINK_OPTION_TIME_KEEPING,
+                           LINK_TYPE_ADVERTISING, &tsch_broadcast_address, t, 0, 1);
+  }
+}
+
+void tsch_cells_parent(uint8_t tier, uint8_t cell, const linkaddr_t *parent) {
+  if (up != NULL) {
+    if (parent != NULL && up->timeslot == timeslot_of(tier, cell) && linkaddr_cmp(&up->addr, parent)) {
+      return;
+    }
+    tsch_schedule_remove_link(slotframe, up);
+    up = NULL;
+  }
+  if (parent != NULL) {
+    up = tsch_schedule_add_link(slotframe, LINK_OPTION_TX | LINK_OPTION_TIME_KEEPING, LINK_TYPE_NORMAL,
+                                parent, timeslot_of(tier, cell), channel_of(parent), 1);
+    tsch_queue_update_time_source(parent);
+  }
+}
+
+void tsch_cells_children(uint8_t tier, uint16_t cells) {
+  for (uint8_t i = 0; i < TSCH_CELLS_PER_TIER; i++) {
+    uint8_t listen = (cells >> i) & 1;
+    if (down[i] != NULL && (!listen || tier != down_tier)) {
+      tsch_schedule_remove_link(slotframe, down[i]);
+      down[i] = NULL;
+    }
+    if (listen && down[i] == NULL) {
+      // frames to us are received whoever the link names
+      down[i] = tsch_schedule_add_link(slotframe, LINK_OPTION_RX, LINK_TYPE_NORMAL, &tsch_broadcast_address,
+                                       timeslot_of(tier, i), channel_of(&linkaddr_node_addr), 1);
+    }
+  }
+  down_tier = tier;
+}
+
+#endif /* MAC_CONF_WITH_TSCH */
@@ -0,0 +1,48 @@
+#ifndef TSCH_CELLS_H_
+#define TSCH_CELLS_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+
+/*
+ * TSCH schedule of the TSCH build (make MAKE_MAC=MAKE_MAC_TSCH), installed
+ * from the application's own one instead of 6TiSCH minimal. One slotframe:
+ * every fourth timeslot is a shared cell that carries the EBs and every
+ * broadcast (beacons, POLLs, DISCOVERY), the others are dedicated cells in
+ * which a child sends up to its parent, one per child:
+ *   - a coordinator in the cell of its slot: the slot's start scaled from
+ *     the period to the TSCH_CELLS_PER_TIER cells of the tier,
+ *   - a sensor in the cell of its position in its parent's SCHEDULE, or
+ *     POLL without PROTOCOL_PUSH, which lists the children in table order.
+ * Each tier of parents has its own cells, so that a coordinator never has
+ * to send up and listen to a child in the same timeslot, and the children
+ * of one parent send on the channel offset of its address, so that
+ * neighboring parents mostly collect on different channels.
+ */
+
+#define TSCH_CELLS_BORDER 0 // coordinators to the border
+#define TSCH_CELLS_COORDINATOR 1 // sensors to their coordinator
+#define TSCH_CELLS_SENSOR 2 // sensors to their parent sensor
+#define TSCH_CELLS_TIERS 3
+#define TSCH_CELLS_PER_TIER 16 // POLL_MAX
+
+#define TSCH_CELLS_CHANNELS 4 // TSCH's default hopping sequence
+// A shared timeslot then three dedicated ones
+#define TSCH_CELLS_LENGTH (TSCH_CELLS_TIERS * TSCH_CELLS_PER_TIER * 4 / 3)
+
+// Cell of the slot starting at start in the period
+#define TSCH_CELLS_OF_SLOT(start, period) ((unsigned long)(start) * TSCH_CELLS_PER_TIER / (period))
+// Coordinators relayed by a coordinator send to it in the last cell of the
+// tier of its sensors, one after the other in their shares of its slot
+#define TSCH_CELLS_RELAY (TSCH_CELLS_PER_TIER - 1)
+// Cells of the first n positions of a SCHEDULE or POLL
+#define TSCH_CELLS_FIRST(n) (uint16_t)((1UL << ((n) < TSCH_CELLS_PER_TIER ? (n) : TSCH_CELLS_PER_TIER)) - 1)
+
+void tsch_cells_init(void);
+// Sends up to parent in cell of tier, and keeps time from it. parent NULL
+// drops the cell.
+void tsch_cells_parent(uint8_t tier, uint8_t cell, const linkaddr_t *parent);
+// Listens in the cells of tier set in the mask (bit i: cell i)
+void tsch_cells_children(uint8_t tier, uint16_t cells);
+
+#endif /* TSCH_CELLS_H_ */
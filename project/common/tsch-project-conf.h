@@ -0,0 +1,18 @@
+#ifndef TSCH_PROJECT_CONF_H_
+#define TSCH_PROJECT_CONF_H_
+
+/*
+ * Configuration of the TSCH build (make MAKE_MAC=MAKE_MAC_TSCH), the
+ * Makefiles make it the project-conf.h of the three firmwares.
+ */
+
+// tsch-cells.c installs the whole schedule, shared cells included
+#define TSCH_SCHEDULE_CONF_WITH_6TISCH_MINIMAL 0
+// the shared cells, a cell per child at the border and the cell up
+#define TSCH_SCHEDULE_CONF_MAX_LINKS 40
+
+// An answer handed to TSCH waits for its cell, up to a slotframe
+// (TSCH_CELLS_LENGTH timeslots of 10 ms) instead of CSMA's backoff
+#define POLL_CONF_GUARD (CLOCK_SECOND * 3 / 4)
+
+#endif /* TSCH_PROJECT_CONF_H_ */
@@ -3,6 +3,14 @@
 #include "net/nullnet/nullnet.h"
 #include "dev/serial-line.h"
 #include "cpu/msp430/dev/uart0.h"
+#include "lib/crc16.h"
+#include "neighbor-table.h"
+#include "aggregate.h"
+#include "protocol.h"
+#include "clock-sync.h"
+#include "net-config.h"
+#include "border-select.h"
+#include "slot-timer.h"
 #include <string.h>
 #include <stdio.h> /* For printf() */
 
@@ -11,250 +19,445 @@
 #define LOG_MODULE "App"
 #define LOG_LEVEL LOG_LEVEL_INFO
 
-/* Configuration */
-#define SEND_INTERVAL (8 * CLOCK_SECOND)
-#define PERIOD (5 * CLOCK_SECOND)
+/* Configuration, from the serial line (see net-config.h) */
+#define PERIOD (net_config.period)
 
 #if MAC_CONF_WITH_TSCH
 #include "net/mac/tsch/tsch.h"
-static linkaddr_t coordinator_addr =  {{ 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }};
+#include "tsch-cells.h"
 #endif /* MAC_CONF_WITH_TSCH */
 
 //static linkaddr_t dest_addr =  {{ 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }};
 
-typedef enum {
-  SENSOR_NODE = 0,
-  COORDINATOR_NODE = 1,
-  BORDER_NODE = 2,
-  UNDEFINED_NODE = 3
-} node_type;
-
-typedef enum {
-  DISCOVERY_TYPE = 0,
-  MESSAGE_TYPE = 1,
-  SYNCHRO_TYPE = 2
-} packet_type;
-
-typedef struct packet {
-  node_type node : 2;
-  packet_type msg : 2;
-  unsigned payload : 12;
-  uint32_t clock : 32;
-} packet_t;
-
-typedef struct slot_packet {
-  node_type node : 2;
-  packet_type msg : 2;
-  unsigned payload : 12;
-  uint32_t duration : 32;
-  uint32_t clock : 32;
-} slot_packet_t;
-
-static uint8_t count = 0;
-
-static packet_t my_pkt;
-static slot_packet_t my_slot_pkt;
-
-
-static linkaddr_t children[5]; // TODO resize if necessary
-static clock_time_t children_clocks[5];
-static clock_time_t children_last_update[5];
-static unsigned next_index = 0;
-
-static clock_time_t network_clock = 0;
-static clock_time_t clock_at_bc = 0;
+static aggregate_t total; // whole network, current period
+
+/* Slot scheduling */
+#define MAX_COORDINATORS 32
+#define BEACON_OFFSET (PERIOD - (CLOCK_SECOND/2))
+// the last answers must reach us before the beacon
+#define SLOT_TAIL (CLOCK_SECOND / 8)
+#define SLOT_WINDOW (BEACON_OFFSET - SLOT_TAIL)
+#define SLOT_PKT_INTERVAL (CLOCK_SECOND / 32) // pacing, keeps the MAC queue short
+
+// What the border keeps per coordinator, next to its neighbor table entry
+typedef struct coordinator {
+  unsigned sensors; // reported by the coordinator, sizes its slot
+  uint8_t sync_error; // reported with its clock, guards its slot
+  // reported during the current period
+  uint16_t readings;
+  uint16_t filled; // of the readings, stand-ins for lost answers (see aggregate.h)
+  uint32_t sum;
+  uint16_t round; // of the last aggregate, AGGREGATE_NO_ROUND before the first
+  energy_t energy; // sent with the last aggregate
+#if AGGREGATE_TRACE_HOPS > 0
+  aggregate_trace_t trace; // oldest reading of the period, if any
+#endif
+  clock_time_t slot_start; // offset from the start of the period
+  clock_time_t slot_duration;
+} coordinator_t;
+
+NEIGHBOR_TABLE(children, MAX_COORDINATORS);
+static coordinator_t coordinators[MAX_COORDINATORS];
+
+
+// Share of the slot window the coordinators need, in the beacon for those
+// choosing a border (see border-select.h)
+static uint8_t load = 0;
+// Looking for a channel of our own, at the start and when another border
+// with a lower address is on ours
+static uint8_t scan = BORDER_SELECT_CHANNELS > 1;
+
+/*
+ * Report frame written on the serial line once per period, multi-byte
+ * fields LSB first:
+ *   magic (2) | version | n | buckets | trace hops | seq (2) |
+ *   network clock (4) | joins refused (2) | aggregate of the network
+ *   (AGGREGATE_LEN, see aggregate.h) |
+ *   n x (coordinator id (2), readings (2), stand-ins among them (2),
+ *        sum (4), sync error (1), energy (ENERGY_LEN, see energy.h), its
+ *        current in uA (2), trace of its oldest reading
+ *        (AGGREGATE_TRACE_LEN), our own delay included) | crc (2)
+ * The crc (Contiki's crc16) covers everything between the magic and itself,
+ * the sequence number lets the server notice lost periods.
+ */
+#define REPORT_MAGIC_0 0xA5
+#define REPORT_MAGIC_1 0x5A
+#define REPORT_VERSION 7
+#define REPORT_HEADER_LEN 14
+#define REPORT_ENTRY_LEN (13 + ENERGY_LEN + AGGREGATE_TRACE_LEN)
+#define REPORT_MAX_LEN (REPORT_HEADER_LEN + AGGREGATE_LEN + MAX_COORDINATORS * REPORT_ENTRY_LEN + 2)
+
+static uint8_t report[REPORT_MAX_LEN];
+static uint16_t report_seq = 0;
+// DISCOVERY answers turned away since the last report, the table full
+static uint16_t refused = 0;
 
 /*---------------------------------------------------------------------------*/
 PROCESS(nullnet_example_process, "NullNet broadcast example");
-AUTOSTART_PROCESSES(&nullnet_example_process);
-
-static clock_time_t duration = CLOCK_SECOND;
-
-void send_pkt(node_type node, packet_type type, unsigned payload, clock_time_t clock_v, linkaddr_t *dest) {
-  my_pkt.node = node;
-  my_pkt.msg = type;
-  my_pkt.payload = payload;
-  my_pkt.clock = clock_v;
-  memcpy(nullnet_buf, &my_pkt, sizeof(my_pkt));
-  nullnet_len = sizeof(my_pkt);        
-  NETSTACK_NETWORK.output(dest); 
-}
+PROCESS(serial_process, "Border commands");
+AUTOSTART_PROCESSES(&nullnet_example_process, &serial_process);
 
-void send_slot_pkt(node_type node, packet_type type, unsigned payload, clock_time_t duration_v, clock_time_t clock_v, linkaddr_t *dest) {
-  my_slot_pkt.node = node;
-  my_slot_pkt.msg = type;
-  my_slot_pkt.payload = payload;
-  my_slot_pkt.duration = duration_v;
-  my_slot_pkt.clock = clock_v;
-  memcpy(nullnet_buf, &my_slot_pkt, sizeof(my_slot_pkt));
-  nullnet_len = sizeof(my_slot_pkt);        
-  NETSTACK_NETWORK.output(dest); 
+coordinator_t *get_coordinator(neighbor_t *n) {
+  return &coordinators[neighbor_table_index(&children, n)];
 }
 
-void register_clock(linkaddr_t child, clock_time_t clock_child) {
-  for (int i = 0; i<next_index; i++) {
-    if (linkaddr_cmp(&child, &children[i])) {
-      children_clocks[i] = clock_child;
-    }
+void register_synchro(neighbor_t *child, unsigned sensors, uint8_t sync_error) {
+  if (child != NULL) {
+    get_coordinator(child)->sensors = sensors;
+    get_coordinator(child)->sync_error = sync_error;
   }
 }
 
-void handle_synchro() {
-  long signed avg_delta = 0;
-  unsigned cnt_clocks = 1; // count the diff of border with itself
-  for (int i=0; i<next_index; i++) {
-    if (children_clocks[i]>0) {
-      avg_delta += children_clocks[i] - network_clock;      
-      cnt_clocks++;
-      children_clocks[i]=0; // reset
-    }
-  }  
-  // include border in the computation
-  clock_time_t clock_at_recomp = clock_time();
-  
-  avg_delta = avg_delta / cnt_clocks;
-  network_clock = network_clock + avg_delta + (clock_at_recomp-clock_at_bc); 
-  //LOG_INFO("BORDER - SYNCH - NEW NEW CLOCK :%lu\n", network_clock);
+/*
+ * Our clock is the network clock: each coordinator estimates its offset
+ * from the SLOT frames (see clock-sync.h) and tells how far off it can be
+ * in its answer to the beacon.
+ */
+clock_time_t get_network_clock() {
+  return clock_time();
 }
 
-unsigned get_slot() {
-  return next_index-1;
+// Time to wait until the given offset in the next period of the network clock
+clock_time_t wait_until_offset(clock_time_t offset) {
+  return (offset + PERIOD - net_config_offset(get_network_clock())) % PERIOD;
 }
 
-int get_child_id(const linkaddr_t *addr) {
-  for (int i = 0; i < next_index; i++) {
-    if (linkaddr_cmp(&children[i], addr)) return i;
+void add_child(const linkaddr_t *addr, unsigned sensors) {
+  neighbor_t *n;
+  if (neighbor_table_lookup(&children, addr) != NULL) {
+    return;
   }
-  return -1;
-}
-
-void dead_child(int child_id) {
-  // Shift all elements from "current_child" to the left
-  for (int i = child_id; i < next_index; i++){
-    children[i]=children[i+1];
+  n = neighbor_table_add(&children, addr);
+  if (n == NULL) {
+    // no room: told we are full, it looks for another border
+    LOG_WARN("BORDER - full, refuses coordinator %u\n", addr->u8[0] | (addr->u8[1] << 8));
+    refused++;
+    send_discovery(BORDER_NODE, net_config.version, BORDER_SELECT_FULL, addr);
+    return;
   }
-  next_index--;
+  neighbor_table_heard(n);
+  memset(get_coordinator(n), 0, sizeof(coordinator_t));
+  get_coordinator(n)->sensors = sensors;
+  get_coordinator(n)->round = AGGREGATE_NO_ROUND;
+  net_config_announce(); // it may have missed the last switch
 }
 
 void check_dead_children() {
-  for (int i = 0; i < next_index; i++) {
-    if (clock_time() > (children_last_update[i] + (10*PERIOD))) {
-      dead_child(i);
-      //LOG_INFO("BORDER - DEAD OF CHILDREN %d\n", i);
+  neighbor_table_expire(&children, net_config.timeout * PERIOD);
+  //LOG_INFO("BORDER - DEAD OF CHILDREN\n");
+}
+
+void send_report() {
+  unsigned pos = 0;
+  clock_time_t now = get_network_clock();
+  report[pos++] = REPORT_MAGIC_0;
+  report[pos++] = REPORT_MAGIC_1;
+  report[pos++] = REPORT_VERSION;
+  report[pos++] = neighbor_table_count(&children);
+  report[pos++] = AGGREGATE_BUCKETS;
+  report[pos++] = AGGREGATE_TRACE_HOPS;
+  pos = put_u16(report, pos, report_seq++);
+  pos = put_u32(report, pos, now);
+  pos = put_u16(report, pos, refused);
+  refused = 0;
+  pos += aggregate_encode(&total, report + pos);
+  for (int i = 0; i < neighbor_table_count(&children); i++) {
+    neighbor_t *n = neighbor_table_get(&children, i);
+    coordinator_t *c = get_coordinator(n);
+    pos = put_u16(report, pos, n->addr.u8[0] | (n->addr.u8[1] << 8));
+    pos = put_u16(report, pos, c->readings);
+    pos = put_u16(report, pos, c->filled);
+    pos = put_u32(report, pos, c->sum);
+    report[pos++] = c->sync_error;
+    pos += energy_encode(&c->energy, report + pos);
+    pos = put_u16(report, pos, energy_current(&c->energy));
+#if AGGREGATE_TRACE_HOPS > 0
+    if (c->readings == 0) {
+      c->trace.hops = 0;
+    } else {
+      aggregate_trace_hop(&c->trace);
     }
+    pos += aggregate_trace_encode(&c->trace, report + pos);
+#endif
+    c->readings = 0;
+    c->filled = 0;
+    c->sum = 0;
+  }
+  pos = put_u16(report, pos, crc16_data(report + 2, pos - 2, 0));
+  for (int i = 0; i < pos; i++) {
+    putchar(report[i]);
   }
 }
 
+// Guard after a slot. A coordinator's clock is behind ours by the delay
+// of its SLOT frames at least, up to the sync error it reported: its slot
+// never starts early but can end that late. One far off catches up within
+// a few periods, its neighbours' slots should not pay for it meanwhile.
+static clock_time_t slot_guard(const coordinator_t *c) {
+  if (c->sync_error == 0 || c->sync_error > CLOCK_SYNC_UNKNOWN_ERROR) {
+    return CLOCK_SYNC_UNKNOWN_ERROR;
+  }
+  return c->sync_error;
+}
+
+/*
+ * Split SLOT_WINDOW between the coordinators, one slot after the other.
+ * Each slot is followed by its guard, the rest of the window is shared in
+ * proportion to what each coordinator needs (SLOT_BASE plus
+ * SLOT_PER_SENSOR per sensor), so spare time is spread out when the window
+ * is large and every slot shrinks by the same factor when it is not.
+ */
+void compute_schedule() {
+  unsigned long demand = 0;
+  clock_time_t guards = 0;
+  clock_time_t window;
+  clock_time_t start = 0;
+  for (int i = 0; i < neighbor_table_count(&children); i++) {
+    coordinator_t *c = get_coordinator(neighbor_table_get(&children, i));
+    demand += SLOT_BASE + c->sensors * SLOT_PER_SENSOR;
+    guards += slot_guard(c);
+  }
+  window = guards < SLOT_WINDOW ? SLOT_WINDOW - guards : 0;
+  if (neighbor_table_count(&children) >= MAX_COORDINATORS) {
+    load = BORDER_SELECT_FULL;
+  } else {
+    unsigned long l = (demand + guards) * 100 / SLOT_WINDOW;
+    load = l < BORDER_SELECT_FULL ? l : BORDER_SELECT_FULL - 1;
+  }
+  for (int i = 0; i < neighbor_table_count(&children); i++) {
+    coordinator_t *c = get_coordinator(neighbor_table_get(&children, i));
+    unsigned long need = SLOT_BASE + c->sensors * SLOT_PER_SENSOR;
+    c->slot_start = start;
+    c->slot_duration = (need * window) / demand;
+    if (c->slot_duration == 0) {
+      c->slot_duration = 1;
+    }
+    start += c->slot_duration + slot_guard(c);
+  }
+#if MAC_CONF_WITH_TSCH
+  // each coordinator sends up in the cell of its slot
+  uint16_t cells = 0;
+  for (int i = 0; i < neighbor_table_count(&children); i++) {
+    coordinator_t *c = get_coordinator(neighbor_table_get(&children, i));
+    cells |= (uint16_t)(1U << (TSCH_CELLS_OF_SLOT(c->slot_start, PERIOD) % TSCH_CELLS_PER_TIER));
+  }
+  tsch_cells_children(TSCH_CELLS_BORDER, cells);
+#endif /* MAC_CONF_WITH_TSCH */
+  if (demand > window) {
+    LOG_INFO("BORDER - %u coordinators need %lu ticks, slots shrunk to fit %lu\n", neighbor_table_count(&children), demand, (unsigned long)window);
+  }
+}
 
 
+/*
+ * "config period=<ms> timeout=<periods> short_timeout=<periods>" from the
+ * server, any of the fields: the timing takes over NET_CONFIG_NOTICE
+ * periods after the current one, or replaces the one still pending.
+ */
+void handle_command(const char *line) {
+  static net_config_t c;
+  clock_time_t now = get_network_clock();
+  clock_time_t at;
+  if (strncmp(line, "config", 6) != 0 || (line[6] != ' ' && line[6] != '\0')) {
+    printf("BORDER - unknown command: %s\n", line);
+    return;
+  }
+  if (!net_config_pending(&c, NULL)) {
+    c = net_config;
+  }
+  if (!net_config_parse(&c, line + 6)) {
+    printf("BORDER - bad config: %s\n", line);
+    return;
+  }
+  c.version = c.version == 255 ? 1 : c.version + 1; // 0 is the defaults
+  at = now - net_config_offset(now) + (NET_CONFIG_NOTICE + 1) * PERIOD;
+  net_config_receive(&c, at);
+  printf("BORDER - config %u: period %lu ms, timeouts %u and %u periods, from clock %lu\n", c.version, (unsigned long)c.period * 1000 / CLOCK_SECOND, c.timeout, c.short_timeout, (unsigned long)at);
+}
 
 /*---------------------------------------------------------------------------*/
 void input_callback(const void *data, uint16_t len,
   const linkaddr_t *src, const linkaddr_t *dest)
 {
-  if(len == sizeof(packet_t)) {    
-    //LOG_INFO("BORDER - Received from ");
-    //LOG_INFO_LLADDR(src);
-    //LOG_INFO("\n");
-
-    int id = get_child_id(src);
-    if (id >= 0) {
-      children_last_update[id] = clock_time();
+  neighbor_t *child = neighbor_table_lookup(&children, src);
+  if (child != NULL) {
+    neighbor_table_heard(child);
+  }
+
+  static message_t msg;
+  if (!protocol_decode(&msg, data, len)) {
+    //LOG_INFO_("unknown frame\n");
+    return;
+  }
+  if (msg.node == BORDER_NODE && msg.type == DISCOVERY_TYPE) {
+    // another border's beacon: of two on a channel, the highest address moves
+    border_select_heard(src, msg.load);
+    if (!scan && BORDER_SELECT_CHANNELS > 1 && (src->u8[0] | (src->u8[1] << 8)) < (linkaddr_node_addr.u8[0] | (linkaddr_node_addr.u8[1] << 8))) {
+      scan = 1;
     }
+    return;
+  }
+  if (msg.node != COORDINATOR_NODE) {
+    //LOG_INFO("Msg from node that ain't coordinator\n");
+    return;
+  }
 
-    packet_t pkt;
-    memcpy(&pkt, data, sizeof(pkt));
-
-    switch (pkt.node)
-    {
-    case COORDINATOR_NODE:
-      switch (pkt.msg)
-      {
-      case DISCOVERY_TYPE:
-        if ((next_index+1)*duration>PERIOD-((3*CLOCK_SECOND)/2)) {
-          //LOG_INFO("HALVING DURATION AS NEW COORDINATOR JOINS");
-          duration = duration / 2;
-          // 1) add change_dur, 2) postpone sending slot to next turn
-        }
-        children[next_index++] = *src;
-        break;      
-      case MESSAGE_TYPE:
-        //LOG_INFO("RECEIVED COUNT FROM COORD %u\n", pkt.payload);
-        count += pkt.payload;
-        break;
-      case SYNCHRO_TYPE:
-        //LOG_INFO("RECEIVED CLOCK \n");
-        register_clock(*src, pkt.clock);
-      default:
+  switch (msg.type)
+  {
+  case AGGREGATE_TYPE:
+    //LOG_INFO("RECEIVED COUNT FROM COORD %lu\n", (unsigned long)msg.aggregate.sum);
+    if (child != NULL) {
+      // sent again after a lost ack, which a duty cycled coordinator misses
+      // more often
+      if (get_coordinator(child)->round == msg.round) {
         break;
       }
-      break;    
-    default:
-      //LOG_INFO("Msg from node that ain't coordinator\n");
+      get_coordinator(child)->round = msg.round;
+      get_coordinator(child)->energy = msg.energy;
+    }
+    aggregate_merge(&total, &msg.aggregate);
+    if (child != NULL) {
+#if AGGREGATE_TRACE_HOPS > 0
+      if (get_coordinator(child)->readings == 0) {
+        get_coordinator(child)->trace = msg.aggregate.trace;
+      } else if (msg.aggregate.count > 0) {
+        aggregate_trace_merge(&get_coordinator(child)->trace, &msg.aggregate.trace);
+      }
+#endif
+      get_coordinator(child)->readings += msg.aggregate.count;
+      get_coordinator(child)->filled += msg.aggregate.filled;
+      get_coordinator(child)->sum += msg.aggregate.sum;
+    }
+    break;
+  case DISCOVERY_TYPE:
+    if (!linkaddr_cmp(dest, &linkaddr_node_addr)) {
+      break; // a coordinator out of range looking for a relay
+    }
+    // gets its slot with the next schedule
+    add_child(src, msg.payload);
+    break;
+  case SYNCHRO_TYPE:
+    //LOG_INFO("RECEIVED CLOCK \n");
+    if (!linkaddr_cmp(dest, &linkaddr_node_addr)) {
+      break; // a broadcast death notice
+    }
+    if (msg.payload == DEAD) {
+      // it moves to another border
+      if (child != NULL) {
+        LOG_INFO("BORDER - coordinator %u leaves\n", src->u8[0] | (src->u8[1] << 8));
+        neighbor_table_remove(&children, child);
+      }
       break;
-    }   
-  } else {
-    //LOG_INFO_("data of unadequate size\n");
+    }
+    register_synchro(child, msg.payload, msg.sync_error);
+    break;
+  default:
+    break;
   }
-
 }
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(nullnet_example_process, ev, data)
 {
   static struct etimer periodic_timer;  
-  
-  my_pkt.node = BORDER_NODE;
-  my_pkt.msg = DISCOVERY_TYPE;
+  static slot_timer_t beacon_timer;
+  static int i;
+  static int scheduled;
 
   PROCESS_BEGIN();
 
 #if MAC_CONF_WITH_TSCH
-  tsch_set_coordinator(linkaddr_cmp(&coordinator_addr, &linkaddr_node_addr));
+  // the root of the TSCH network as of ours
+  tsch_set_coordinator(1);
+  tsch_cells_init();
 #endif /* MAC_CONF_WITH_TSCH */
 
   /* Initialize NullNet */
-  nullnet_buf = (void *)&my_pkt;
-  nullnet_len = sizeof(my_pkt);
   nullnet_set_input_callback(input_callback);
+  neighbor_table_init(&children);
+  aggregate_init(&total);
+  border_select_init();
+  slot_timer_init(&beacon_timer);
 
-  etimer_set(&periodic_timer, PERIOD-(CLOCK_SECOND/2));
+  slot_timer_set(&beacon_timer, clock_time() + BEACON_OFFSET);
   while(1) {
+#if BORDER_SELECT_CHANNELS > 1
+    if (scan) {
+      // a beacon on every channel with a border: take the one with the fewest
+      static unsigned c;
+      static clock_time_t since;
+      since = clock_time();
+      neighbor_table_clear(&children);
+      for (c = 0; c < BORDER_SELECT_CHANNELS; c++) {
+        border_select_tune(border_select_channel(c));
+        etimer_set(&periodic_timer, BORDER_SELECT_DWELL(PERIOD));
+        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
+      }
+      border_select_tune(border_select_free(since));
+      printf("BORDER - on channel %u\n", border_select_tuned());
+      scan = 0;
+      slot_timer_set(&beacon_timer, clock_time() + wait_until_offset(BEACON_OFFSET));
+    }
+#endif /* BORDER_SELECT_CHANNELS > 1 */
     /* 1) SEND SIGNALING MSG "I AM THE BORDER" */
     
-    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer)); // take time into account
+    PROCESS_WAIT_EVENT_UNTIL(slot_timer_expired(&beacon_timer));
+    LOG_INFO("BORDER - beacon %u us late, %u at most\n", beacon_timer.late, beacon_timer.max_late);
     ////LOG_INFO("Border signalling its existence \n");
     ////LOG_INFO_LLADDR(NULL);
-    send_pkt(BORDER_NODE, DISCOVERY_TYPE, 0, duration, NULL);       
-    clock_at_bc = clock_time();
-    etimer_reset(&periodic_timer);
+    // the last beacon before a switch is the first one of the new timing,
+    // the schedule that follows is computed with it
+    if (net_config_update(get_network_clock())) {
+      printf("BORDER - config %u in force\n", net_config.version);
+    }
+    // just before the beacon: the coordinators answer that one at once
+    if (net_config_due()) {
+      net_config_send(BORDER_NODE, get_network_clock(), 1, NULL);
+    }
+    send_discovery(BORDER_NODE, net_config.version, load, NULL);
 
-    /* 2) wait for coordinator to respond, then compute the new clock*/
+    /* 2) wait for the coordinators to answer with their sensors */
     etimer_set(&periodic_timer, (CLOCK_SECOND/3)); 
     PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));        
-    handle_synchro();    
-    //send_pkt(BORDER_NODE, SYNCHRO_TYPE, 0, network_clock, NULL);        
-    for (int i=0; i<next_index; i++) {
-      send_slot_pkt(BORDER_NODE, SYNCHRO_TYPE, i, duration, network_clock, &children[i]);
-    }
-    ////LOG_INFO("Current time: %lu ticks\n", (unsigned long)network_clock);
 
-    /* 3) SEND DATA TO SERVER */
-    printf("%u\n", count); 
-    count = 0;
+    /* 3) SEND DATA TO SERVER, before next period's slots start */
+    send_report();
+    aggregate_init(&total);
 
     /* 4) DETECT FAILURES */
     check_dead_children();
 
-    /* RESET TIMER */
-    etimer_reset(&periodic_timer);
+    /* 5) SEND THE SLOTS, in slot order so that the first ones arrive first */
+    compute_schedule();
+    //send_pkt(BORDER_NODE, SYNCHRO_TYPE, 0, network_clock, NULL);        
+    // coordinators joining meanwhile wait for the next schedule
+    scheduled = neighbor_table_count(&children);
+    for (i=0; i<scheduled; i++) {
+      static neighbor_t *n;
+      n = neighbor_table_get(&children, i);
+      send_slot(BORDER_NODE, get_coordinator(n)->slot_start, get_coordinator(n)->slot_duration, get_network_clock(), &n->addr);
+      etimer_set(&periodic_timer, SLOT_PKT_INTERVAL);
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
+    }
+    ////LOG_INFO("Current time: %lu ticks\n", (unsigned long)network_clock);
 
-    clock_time_t remaining_clock =  PERIOD - (network_clock % PERIOD);
-    ////LOG_INFO("REMAIN time %lu, #coord %u\n", remaining_clock, next_index);
-    etimer_set(&periodic_timer, PERIOD-(CLOCK_SECOND/2) + remaining_clock); // wait an additional time to not go too fast
+    ////LOG_INFO("REMAIN time %lu, #coord %u\n", wait_until_offset(BEACON_OFFSET), neighbor_table_count(&children));
+    slot_timer_set(&beacon_timer, clock_time() + wait_until_offset(BEACON_OFFSET));
   }
 
   PROCESS_END();
 }
 /*---------------------------------------------------------------------------*/
+PROCESS_THREAD(serial_process, ev, data)
+{
+  PROCESS_BEGIN();
+  serial_line_init();
+  uart0_set_input(serial_line_input_byte);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == serial_line_event_message);
+    handle_command((const char *)data);
+  }
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
 
 
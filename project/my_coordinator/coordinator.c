@@ -4,6 +4,15 @@
 #include "dev/serial-line.h"
 #include "cpu/msp430/dev/uart0.h"
 #include "sys/process.h"
+#include "neighbor-table.h"
+#include "aggregate.h"
+#include "protocol.h"
+#include "clock-sync.h"
+#include "duty-cycle.h"
+#include "net-config.h"
+#include "border-select.h"
+#include "parent-select.h"
+#include "slot-timer.h"
 #include <string.h>
 #include <stdio.h> /* For printf() */
 
@@ -12,48 +21,46 @@
 #define LOG_MODULE "App"
 #define LOG_LEVEL LOG_LEVEL_INFO
 
-/* Configuration */
-#define SEND_INTERVAL (8 * CLOCK_SECOND)
-#define PERIOD (5 * CLOCK_SECOND)
+/* Configuration, from the border (see net-config.h) */
+#define PERIOD (net_config.period)
 
 #if MAC_CONF_WITH_TSCH
-#include "net/mac/tsch/tsch.h"
-static linkaddr_t coordinator_addr =  {{ 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }};
+#include "tsch-cells.h"
 #endif /* MAC_CONF_WITH_TSCH */
 
 //static linkaddr_t dest_addr =  {{ 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }};
 
-typedef enum {
-  SENSOR_NODE = 0,
-  COORDINATOR_NODE = 1,
-  BORDER_NODE = 2,
-  UNDEFINED_NODE = 3
-} node_type;
-
-typedef enum {
-  DISCOVERY_TYPE = 0,
-  MESSAGE_TYPE = 1,
-  SYNCHRO_TYPE = 2
-} packet_type;
-
-typedef struct packet {
-  node_type node : 2;
-  packet_type msg : 2;
-  unsigned payload : 12;
-  clock_time_t clock : 32;
-} packet_t;
-
-typedef struct slot_packet {
-  node_type node : 2;
-  packet_type msg : 2;
-  unsigned payload : 12;
-  uint32_t duration : 32;
-  uint32_t clock : 32;
-} slot_packet_t;
-
-unsigned DEAD = 42;
 #define BROADCAST NULL
 
+#if DUTY_CYCLE && !PROTOCOL_POLL
+#error "DUTY_CYCLE needs PROTOCOL_POLL"
+#endif
+// Duty cycling: the border's beacon, until our SLOT frame, and our slot
+#define WINDOW_BEACON 0
+#define WINDOW_SLOT 1
+#define BEACON_WINDOW (PERIOD / 3) // the border sends the SLOT frames by then
+
+// A coordinator out of range of every border joins one that has a parent,
+// up to RELAY_MAX_HOPS from the border (1 for none). The relay asks its
+// parent for a slot that also fits the coordinators it relays for, each
+// as RELAY_SENSORS sensors more than what it asks for, and hands them the
+// front of its slot before it collects its own sensors. Not without
+// PROTOCOL_POLL by default: the requests one by one leave them no time.
+#ifdef RELAY_CONF_MAX_HOPS
+#define RELAY_MAX_HOPS RELAY_CONF_MAX_HOPS
+#elif PROTOCOL_POLL
+#define RELAY_MAX_HOPS 4
+#else
+#define RELAY_MAX_HOPS 1
+#endif
+#define MAX_RELAYED 4
+// its reply to us and a guard for its clock, which comes from ours
+#define RELAY_SENSORS ((SLOT_BASE + POLL_GUARD + SLOT_PER_SENSOR - 1) / SLOT_PER_SENSOR)
+#define RELAY_OFFERS (CLOCK_SECOND / 2) // after asking, on each channel
+// With DUTY_CYCLE, asking is repeated over a whole period, closer than the
+// shortest window of the coordinators that could answer
+#define RELAY_SPACING (3 * POLL_GUARD)
+
 #define OWN_TYPE COORDINATOR_NODE
 
 // static unsigned count = 0;
@@ -62,208 +69,676 @@ static clock_time_t parent_last_update;
 
 static unsigned has_parent = 0;
 
-static clock_time_t network_clock = 0;
-static clock_time_t clock_at_bc = 0;
+// network clock, the border's, learned from the SLOT frames
+static clock_sync_t network_clock;
 static clock_time_t duration;
+#if !PROTOCOL_POLL
 static clock_time_t child_duration;
+#endif
 static clock_time_t wait_slot;
 static clock_time_t must_respond_before;
-static packet_t my_pkt;
-static unsigned slot;
+static clock_time_t slot_start; // offset of the slot in the period
 
 static unsigned received_clock = 0;
 
 #define MAX_CHILDREN 16
-static linkaddr_t children[MAX_CHILDREN]; // TODO resize if necessary
-static clock_time_t children_last_update[MAX_CHILDREN];
+#if MAX_CHILDREN > AGGREGATE_MAX_CHILDREN
+#error "MAX_CHILDREN exceeds the children an aggregate_rounds_t tells apart"
+#endif
+NEIGHBOR_TABLE(children, MAX_CHILDREN);
 
-static uint8_t total_count = 0;
+static aggregate_rounds_t rounds; // merged from the sensors' answers
+static uint8_t round; // being collected
+static uint16_t sent_round = AGGREGATE_NO_ROUND; // last one sent to the border
+static uint8_t child_lag[MAX_CHILDREN]; // rounds each child's answers are behind
+static uint16_t child_round[MAX_CHILDREN]; // of each child's last answer
+#if AGGREGATE_FILL_AGE > 0
+static aggregate_t child_last[MAX_CHILDREN]; // stands in for the lost ones
+#endif
+static uint8_t child_slots[MAX_CHILDREN]; // readings in each child's last answer
+static clock_time_t poll_answers; // after the POLL, when the last answer is due
+static uint8_t answered[MAX_CHILDREN]; // in the current slot
+static energy_t children_peak; // of the answers since ours
+#if PROTOCOL_PUSH
+static uint8_t schedule_sent = 0; // the children push on their own
+static uint8_t schedule_dirty = 0; // children or their windows changed
+static uint8_t schedule_age = 0; // periods since the SCHEDULE was sent
+static clock_time_t schedule_pushes; // after the slot start, when the last push is due
+#endif
 static uint8_t received_values = 0;
-static uint8_t number_of_children = 0;
+#if !PROTOCOL_POLL
 static uint8_t current_child = 0;
 static uint8_t starting_child = 0;
+#endif
+
+// Choice of the border (see border-select.h)
+static uint8_t scanning = BORDER_SELECT_CHANNELS > 1; // on every channel in turn, joining none
+static uint8_t surveying = 0; // on another channel for a period
+static uint8_t new_parent = 0; // our offers to the sensors start over
+#if BORDER_SELECT_CHANNELS > 1
+static uint8_t survey_channel = 0; // the last one
+#endif
+static clock_time_t search_since; // borders heard since are candidates
+static linkaddr_t joining; // the border we sent our DISCOVERY to
+static linkaddr_t target; // the border we move to, until target_until
+static uint8_t target_channel;
+static clock_time_t target_until;
+static uint8_t checks = 0; // periods since the last check of our border
+static uint8_t check_in = BORDER_SELECT_CHECK;
+// Surveys that found no better border double the periods between them:
+// our border misses our acks while we are away
+static uint8_t check_backoff = 0;
+
+// Relaying
+static uint8_t hops = 0; // from the border, 1 for one of its coordinators
+NEIGHBOR_TABLE(relayed, MAX_RELAYED);
+static uint8_t relayed_sensors[MAX_RELAYED]; // as they ask for their slot
+static uint8_t relayed_lag[MAX_RELAYED];
+static uint16_t relayed_round[MAX_RELAYED];
+static uint8_t relayed_answers = 0; // in the current slot
+static clock_time_t relay_time; // front of our slot, theirs
+static uint8_t asking_relay = 0; // offers are taken
+static linkaddr_t relay; // the best offer, fewest hops first
+static uint8_t relay_hops = 0; // of it, 0 for none
+static uint8_t relay_channel;
+static clock_time_t relay_offer_at; // it listens then, every period
 /*---------------------------------------------------------------------------*/
 PROCESS(nullnet_example_process, "NullNet broadcast example");
 PROCESS(check_parent_process, "Coord check parent");
-AUTOSTART_PROCESSES(&nullnet_example_process, &check_parent_process);
-
-void send_pkt(node_type node, packet_type type, unsigned payload, clock_time_t clock_v, linkaddr_t *dest) {
-  my_pkt.node = node;
-  my_pkt.msg = type;
-  my_pkt.payload = payload;
-  my_pkt.clock = clock_v;    
-  memcpy(nullnet_buf, &my_pkt, sizeof(my_pkt));
-  nullnet_len = sizeof(my_pkt);        
-  NETSTACK_NETWORK.output(dest); 
-}
+PROCESS(select_process, "Coord border selection");
+AUTOSTART_PROCESSES(&nullnet_example_process, &check_parent_process, &select_process);
 
-void dead_parent() {
+// Our children look for a new parent on channel first, 0 for any
+void dead_parent(uint8_t channel) {
   printf("Parent DEAD, RIP\n");
   memset(&parent, 0, sizeof(parent));
   has_parent = 0;
-  number_of_children = 0;
-  total_count = 0;
+  hops = 0;
+  neighbor_table_clear(&children);
+  neighbor_table_clear(&relayed);
+  relay_time = 0;
+  aggregate_rounds_init(&rounds);
+  sent_round = AGGREGATE_NO_ROUND;
+  energy_init(&children_peak);
+  clock_sync_init(&network_clock);
+  duty_cycle_cancel(WINDOW_BEACON);
+  duty_cycle_cancel(WINDOW_SLOT);
+  duty_cycle_hold(DUTY_CYCLE_SEARCH, 1);
+  duty_cycle_hold(DUTY_CYCLE_ANSWER, 0);
+#if MAC_CONF_WITH_TSCH
+  tsch_cells_parent(TSCH_CELLS_BORDER, 0, NULL);
+  tsch_cells_children(TSCH_CELLS_COORDINATOR, 0);
+#endif /* MAC_CONF_WITH_TSCH */
   received_values = 0;
   received_clock = 0;
+#if PROTOCOL_PUSH
+  schedule_sent = 0;
+#endif
+  // the next border counts its timings from its own defaults
+  net_config_init();
+  search_since = clock_time();
   // Broadcast the death
-  send_pkt(OWN_TYPE, SYNCHRO_TYPE, DEAD, 0, BROADCAST);
+  send_pkt(OWN_TYPE, SYNCHRO_TYPE, DEAD, channel, BROADCAST);
   // Activate main thread
   process_poll(&nullnet_example_process);
+  process_poll(&select_process);
 }
 
-void dead_child(int child_id) {
-  printf("Child is DEAD, RIP\n");
-  // Shift all elements from "current_child" to the left
-  for (int i = child_id; i < number_of_children; i++){
-    children[i]=children[i+1];
+// Whether to answer the beacon of this border, without one: the border we
+// move to, else the cheapest heard since the search started
+int join_border(const linkaddr_t *addr) {
+  const border_candidate_t *best;
+  if (scanning) {
+    return 0;
+  }
+  if ((int32_t)(target_until - clock_time()) > 0) {
+    return linkaddr_cmp(addr, &target);
   }
-  number_of_children--;
+  best = border_select_best(search_since);
+  return best != NULL && linkaddr_cmp(&best->addr, addr);
+}
+
+// Moves to the cheapest border heard since "since" if it costs less than
+// ours without us, by more than what we would bring to it; returns whether
+// it moved
+int compare_borders(clock_time_t since) {
+  const border_candidate_t *ours = border_select_lookup(&parent);
+  const border_candidate_t *best = border_select_best(since);
+  unsigned long share;
+  if (ours == NULL || best == NULL || linkaddr_cmp(&best->addr, &parent)) {
+    return 0;
+  }
+  // our slot, in percent of the window as the border counts its load
+  share = (unsigned long)duration * 100 / PERIOD;
+  if (ours->load > 100) {
+    share = share * ours->load / 100;
+  }
+  if (border_select_cost(best) + 2 * share + BORDER_SELECT_HYSTERESIS >= border_select_cost(ours)) {
+    return 0;
+  }
+  LOG_INFO("COORDINATOR - moves to border %u on channel %u, cost %u instead of %u\n", best->addr.u8[0] | (best->addr.u8[1] << 8), best->channel, border_select_cost(best), border_select_cost(ours));
+  linkaddr_copy(&target, &best->addr);
+  target_channel = best->channel;
+  target_until = clock_time() + 3 * PERIOD;
+  send_pkt(OWN_TYPE, SYNCHRO_TYPE, DEAD, 0, &parent); // we leave it
+  dead_parent(target_channel);
+  return 1;
+}
+
+// Now and then after our slot, if our border is busy: compare it with the
+// others, from another channel for a period if they are on others
+void check_border() {
+  const border_candidate_t *ours = border_select_lookup(&parent);
+  // the coordinators we relay for would lose us
+  if (++checks < check_in || ours == NULL || neighbor_table_count(&relayed) > 0) {
+    return;
+  }
+  checks = 0;
+  // not all the coordinators of a border at the same time
+  check_in = (BORDER_SELECT_CHECK << check_backoff) + (linkaddr_node_addr.u8[0] + 7 * round) % (BORDER_SELECT_CHECK << check_backoff);
+  if (border_select_cost(ours) < BORDER_SELECT_BUSY) {
+    return;
+  }
+#if BORDER_SELECT_CHANNELS > 1
+  surveying = 1;
+  process_poll(&select_process);
+#else
+  compare_borders(clock_time() - 2 * PERIOD);
+#endif
 }
 
 void check_dead_children() {
-  for (int i = 0; i < number_of_children; i++) {
-    if (clock_time() > (children_last_update[i] + (10*PERIOD))) {
-      dead_child(i);
+  if (neighbor_table_expire(&children, net_config.timeout * PERIOD) > 0) {
+    printf("Child is DEAD, RIP\n");
+#if PROTOCOL_PUSH
+    schedule_dirty = 1;
+#endif
+  }
+  if (neighbor_table_expire(&relayed, net_config.timeout * PERIOD) > 0) {
+    printf("Relayed coordinator is DEAD, RIP\n");
+  }
+}
+
+// Sensors the slot must make room for: with the POLL, every reading of the
+// subtree of a child gets its micro-slot; and the coordinators we relay for
+unsigned sensor_count() {
+  unsigned sensors = 0;
+#if PROTOCOL_POLL
+  for (int i = 0; i < neighbor_table_count(&children); i++) {
+    sensors += child_slots[neighbor_table_index(&children, neighbor_table_get(&children, i))];
+  }
+#else
+  sensors = neighbor_table_count(&children);
+#endif
+  for (int i = 0; i < neighbor_table_count(&relayed); i++) {
+    sensors += relayed_sensors[neighbor_table_index(&relayed, neighbor_table_get(&relayed, i))] + RELAY_SENSORS;
+  }
+  return sensors;
+}
+
+// As the payload of a DISCOVERY or a SYNCHRO, which must not read as DEAD
+uint8_t sensor_payload() {
+  unsigned sensors = sensor_count();
+  if (sensors > 255) {
+    sensors = 255;
+  }
+  return sensors == DEAD ? DEAD + 1 : sensors;
+}
+
+#if PROTOCOL_POLL
+// Micro-slots a POLL of the children that have not answered in our slot
+// gives them, ticks left in the slot if it still fits, else 0: the border
+// needs our answer in its last micro-slot
+clock_time_t missing_window() {
+  unsigned slots = 0;
+  clock_time_t left = clock_time() < must_respond_before ? must_respond_before - clock_time() : 0;
+  for (int k = 0; k < neighbor_table_count(&children); k++) {
+    int i = neighbor_table_index(&children, neighbor_table_get(&children, k));
+    if (!answered[i]) {
+      slots += child_slots[i] > 0 ? child_slots[i] : 1;
+    }
+  }
+  if (slots * POLL_MICRO_SLOT + POLL_GUARD + 2*POLL_MICRO_SLOT > left) {
+    return 0;
+  }
+  return slots * POLL_MICRO_SLOT;
+}
+#endif
+
+#if MAC_CONF_WITH_TSCH
+// In the cells of the first n sensors, and in the one of the relayed coordinators
+void listen_children(unsigned n) {
+  tsch_cells_children(TSCH_CELLS_COORDINATOR, TSCH_CELLS_FIRST(n) | (neighbor_table_count(&relayed) > 0 ? (uint16_t)(1U << TSCH_CELLS_RELAY) : 0));
+}
+#endif /* MAC_CONF_WITH_TSCH */
+
+// The children whose answer for round r is still missing, lost: their
+// last answer stands in for it, if recent enough
+void fill_round(uint8_t r) {
+#if AGGREGATE_FILL_AGE > 0
+  aggregate_t *a = aggregate_round(&rounds, r, round);
+  unsigned filled = 0;
+  for (int k = 0; a != NULL && k < neighbor_table_count(&children); k++) {
+    int i = neighbor_table_index(&children, neighbor_table_get(&children, k));
+    uint8_t age = r - child_round[i];
+    // after a later answer, it did not miss the round, it skipped it
+    if (child_round[i] == AGGREGATE_NO_ROUND || !aggregate_round_child(&rounds, r, i)
+        || age == 0 || age > AGGREGATE_FILL_AGE) {
+      continue;
     }
+    aggregate_fill(a, &child_last[i], age);
+    filled++;
   }
+  if (filled > 0) {
+    LOG_INFO("COORDINATOR - round %u, %u SENSORS filled in\n", r, filled);
+  }
+#endif
+}
+
+// Sends up the last round all the subtrees have completed, then collects
+// the next one
+void send_round() {
+  static energy_t energy;
+  uint8_t lag = 0;
+  for (int i = 0; i < neighbor_table_count(&children); i++) {
+    uint8_t l = child_lag[neighbor_table_index(&children, neighbor_table_get(&children, i))];
+    lag = l > lag ? l : lag;
+  }
+  for (int i = 0; i < neighbor_table_count(&relayed); i++) {
+    uint8_t l = relayed_lag[neighbor_table_index(&relayed, neighbor_table_get(&relayed, i))];
+    lag = l > lag ? l : lag;
+  }
+  energy_sample(&energy);
+  energy_merge(&energy, &children_peak);
+  energy_init(&children_peak);
+  LOG_INFO("COORDINATOR - energy cpu %u lpm %u tx %u rx %u /%u, %u uA, peak %u uA at %u\n", energy.cpu, energy.lpm, energy.tx, energy.rx, ENERGY_SCALE, energy_current(&energy), energy.peak_current, energy.peak_node);
+  // at or just behind the last one sent: a subtree got deeper, wait one
+  // period for it rather than count a round twice (after periods without a
+  // slot, it is ahead however far)
+  if (sent_round != AGGREGATE_NO_ROUND && (uint8_t)(sent_round - (uint8_t)(round - lag)) < AGGREGATE_ROUNDS) {
+    static aggregate_t empty;
+    aggregate_init(&empty);
+    LOG_INFO("COORDINATOR - round %u already sent\n", (uint8_t)(round - lag));
+    send_aggregate(OWN_TYPE, &empty, round - lag, &energy, &parent);
+  } else {
+    fill_round(round - lag);
+    LOG_INFO("COORDINATOR - send round %u to border\n", (uint8_t)(round - lag));
+    send_aggregate(OWN_TYPE, aggregate_round(&rounds, round - lag, round), round - lag, &energy, &parent);
+    sent_round = (uint8_t)(round - lag);
+  }
+  // answers from now on are for the next round
+  round++;
+  received_values = 0;
+  relayed_answers = 0;
+  memset(answered, 0, sizeof(answered));
+  check_border();
+}
+
+clock_time_t get_network_clock() {
+  return clock_sync_estimate(&network_clock, clock_time());
 }
 
 void set_wait_slot_time() {  
-  wait_slot = SEND_INTERVAL;
-  //slot;
-  //network_clock;
-  //PERIOD;
-  clock_time_t start_clock = slot*duration; // replace by duration
-  clock_time_t current_clock =  network_clock % PERIOD;
-  wait_slot = start_clock + (PERIOD-current_clock);
+  // the border packs the slots, it gives the start directly
+  clock_time_t current_clock = net_config_offset(get_network_clock());
+  wait_slot = (slot_start + PERIOD - current_clock) % PERIOD;
   LOG_INFO("COORDINATOR - wait before taking its slot is : %lu\n", (long unsigned) wait_slot);
   
 }
 
-int is_parent(const linkaddr_t *addr) {
-  return linkaddr_cmp(&parent, addr);
+// Hands the coordinators we relay for their shares of the front of our
+// slot, in proportion to what they ask for; returns how long they last
+clock_time_t send_relayed_slots() {
+  unsigned long total = sensor_count() + RELAY_SENSORS; // ours is one more share
+  clock_time_t start = slot_start;
+  for (int i = 0; i < neighbor_table_count(&relayed); i++) {
+    neighbor_t *n = neighbor_table_get(&relayed, i);
+    clock_time_t share = duration * (relayed_sensors[neighbor_table_index(&relayed, n)] + RELAY_SENSORS) / total;
+    send_slot(OWN_TYPE, start, share > POLL_GUARD ? share - POLL_GUARD : 1, get_network_clock(), &n->addr);
+    start += share;
+  }
+  return start - slot_start;
 }
 
-int get_child_id(const linkaddr_t *addr) {
-  for (int i = 0; i < number_of_children; i++) {
-    if (linkaddr_cmp(&children[i], addr)) return i;
-  }
-  return -1;
+int is_parent(const linkaddr_t *addr) {
+  return linkaddr_cmp(&parent, addr);
 }
 
 /*---------------------------------------------------------------------------*/
 void input_callback(const void *data, uint16_t len, const linkaddr_t *src, const linkaddr_t *dest) {
   if (is_parent(src)) { parent_last_update = clock_time(); }
-  int id = get_child_id(src);
-  if (id >= 0) {
-    children_last_update[id] = clock_time();
+  neighbor_t *child = neighbor_table_lookup(&children, src);
+  if (child != NULL) {
+    neighbor_table_heard(child);
+  }
+  neighbor_t *relayed_child = neighbor_table_lookup(&relayed, src);
+  if (relayed_child != NULL) {
+    neighbor_table_heard(relayed_child);
   }
 
-  if(len == sizeof(packet_t)) {    
-    static packet_t pkt;
-    memcpy(&pkt, data, sizeof(packet_t));
-    LOG_INFO("Received from ");
-    LOG_INFO_LLADDR(src);
-    LOG_INFO_("\n");
-    switch (pkt.msg)
-    {
-    case DISCOVERY_TYPE:
-      //LOG_INFO("Discovery");
-      switch (pkt.node) {
-        case BORDER_NODE: {
-          static linkaddr_t border;
-          border.u8[0] = src->u8[0];
-          border.u8[1] = src->u8[1];
-          duration = pkt.clock;
-          if (!linkaddr_cmp(dest, &linkaddr_node_addr)) { // BC
-            if (!has_parent) {
-              LOG_INFO("COORDINATOR - LEARNS ABOUT BORDER, RESPOND TO IT\n");                
-              send_pkt(COORDINATOR_NODE, DISCOVERY_TYPE, 0, 0, &border);
-            } else {            
-              if (network_clock>0) { 
-                clock_time_t clock_at_recomp = clock_time();
-                LOG_INFO("COORDINATOR - GIVES ITS CLOCK TO BORDER : %lu\n",  network_clock+clock_at_recomp-clock_at_bc);
-                send_pkt(COORDINATOR_NODE, SYNCHRO_TYPE, 0, network_clock+clock_at_recomp-clock_at_bc, &border);
-              }
+  static message_t msg;
+  if (!protocol_decode(&msg, data, len)) {
+    return;
+  }
+  LOG_INFO("Received from ");
+  LOG_INFO_LLADDR(src);
+  LOG_INFO_("\n");
+  switch (msg.type)
+  {
+  case AGGREGATE_TYPE:
+    if (child != NULL) {
+      int i = neighbor_table_index(&children, child);
+      uint8_t slots = msg.aggregate.count < 255 ? msg.aggregate.count : 255;
+      aggregate_t *a = aggregate_round(&rounds, msg.round, round);
+      energy_merge(&children_peak, &msg.energy);
+      if (a == NULL) {
+        break; // a child that does not know the round yet
+      }
+      // a late push and the answer to the POLL that recovers it are the same,
+      // and a subtree that got deeper answers again for rounds it answered
+      if (child_round[i] == AGGREGATE_NO_ROUND || (int8_t)(msg.round - child_round[i]) > 0) {
+        child_round[i] = msg.round;
+#if AGGREGATE_FILL_AGE > 0
+        child_last[i] = msg.aggregate;
+#endif
+        // unless its last answer stood in for it, the round went up already
+        if (aggregate_round_child(&rounds, msg.round, i)) {
+          aggregate_merge(a, &msg.aggregate);
+        }
+        // a child with children answers for an older round, and one answering
+        // after our round went up gets its next ones sent a round later
+        if ((uint8_t)(round - msg.round) > child_lag[i]) {
+          child_lag[i] = round - msg.round;
+        }
+      }
+      if (received_clock && !answered[i]) {
+        answered[i] = 1;
+        received_values++;
+#if PROTOCOL_PUSH
+        if (child_slots[i] != slots) {
+          schedule_dirty = 1;
+        }
+#endif
+        child_slots[i] = slots;
+        process_poll(&nullnet_example_process); // may end the POLL early
+      }
+      LOG_INFO("COORDINATOR - Received value %lu from SENSOR\n", (unsigned long)msg.aggregate.sum);
+    }
+    if (relayed_child != NULL) {
+      // in its share of our slot, for the round we collect or an older one
+      int i = neighbor_table_index(&relayed, relayed_child);
+      aggregate_t *a = aggregate_round(&rounds, msg.round, round);
+      energy_merge(&children_peak, &msg.energy);
+      if (a == NULL) {
+        break;
+      }
+      if (relayed_round[i] == AGGREGATE_NO_ROUND || (int8_t)(msg.round - relayed_round[i]) > 0) {
+        relayed_round[i] = msg.round;
+        aggregate_merge(a, &msg.aggregate);
+        if ((uint8_t)(round - msg.round) > relayed_lag[i]) {
+          relayed_lag[i] = round - msg.round;
+        }
+        if (received_clock) {
+          relayed_answers++;
+          process_poll(&nullnet_example_process); // may end their shares early
+        }
+      }
+      LOG_INFO("COORDINATOR - Received value %lu from relayed COORDINATOR\n", (unsigned long)msg.aggregate.sum);
+    }
+    break;
+  case DISCOVERY_TYPE:
+    //LOG_INFO("Discovery");
+    switch (msg.node) {
+      case BORDER_NODE: {
+        static linkaddr_t border;
+        border.u8[0] = src->u8[0];
+        border.u8[1] = src->u8[1];
+        if (!linkaddr_cmp(dest, &linkaddr_node_addr)) { // BC
+          border_select_heard(src, msg.load);
+          if (has_parent && hops > 1 && border_select_lookup(src)->load < BORDER_SELECT_FULL) {
+            // in range of a border after all: leave our relay, the next
+            // beacon is the one we join
+            LOG_INFO("COORDINATOR - hears border %u, leaves its relay\n", src->u8[0] | (src->u8[1] << 8));
+            send_pkt(OWN_TYPE, SYNCHRO_TYPE, DEAD, 0, &parent);
+            dead_parent(0);
+            break;
+          }
+          if (has_parent ? !is_parent(src) : !join_border(src)) {
+            break; // see check_border()
+          }
+          // the last beacon before a switch is the first one of the new
+          // timing; a border that restarted is back to the defaults
+          net_config_update(get_network_clock());
+          if (msg.payload == 0 && net_config.version != 0 && !net_config_pending(NULL, NULL)) {
+            net_config_init();
+          }
+          // the next beacons come every period, our SLOT frame after them
+          duty_cycle_window(WINDOW_BEACON, clock_time() - POLL_GUARD, BEACON_WINDOW, PERIOD);
+          if (!has_parent) {
+            LOG_INFO("COORDINATOR - LEARNS ABOUT BORDER, RESPOND TO IT\n");                
+            linkaddr_copy(&joining, &border);
+            send_pkt(COORDINATOR_NODE, DISCOVERY_TYPE, sensor_payload(), 0, &border);
+          } else {            
+            if (network_clock.count > 0) { 
+              LOG_INFO("COORDINATOR - GIVES ITS CLOCK TO BORDER : %lu, error %lu\n", get_network_clock(), (unsigned long)network_clock.error);
+              // the number of children sizes the next slot, the error its guards
+              send_synchro(COORDINATOR_NODE, sensor_payload(), get_network_clock(), network_clock.error < 255 ? network_clock.error : 255, &border);
             }
-          } 
-          break;  
-        }                                   
-        case SENSOR_NODE: {
-          if (has_parent) {
-            if(!linkaddr_cmp(dest, &linkaddr_node_addr)) {
-              // broadcast
-              LOG_INFO("COORDINATOR - RECEIVES BROADCAST FROM SENSOR\n");  
-              static linkaddr_t sensor;
-              sensor.u8[0] = src->u8[0];
-              sensor.u8[1] = src->u8[1];   
-              send_pkt(COORDINATOR_NODE, DISCOVERY_TYPE, 0, 0, &sensor);
-            } else {
-              // unicast
-              LOG_INFO("COORDINATOR - A SENSOR JOINED HIM\n");
-              children[number_of_children] = *src;
-              children_last_update[number_of_children] = clock_time();
-              LOG_INFO_LLADDR(children + number_of_children);
-              number_of_children++;
-            }        
           }
-          break;
-        }  
-        case COORDINATOR_NODE: {
-          LOG_INFO("COORDINATOR - RECEIVED SMT From Coordinator\n");      
+        } else if (!has_parent && linkaddr_cmp(src, &joining)) {
+          // it turned us away, full: the next beacon of another one
+          LOG_INFO("COORDINATOR - border %u is full\n", src->u8[0] | (src->u8[1] << 8));
+          border_select_heard(src, msg.load);
+          linkaddr_copy(&joining, &linkaddr_null);
+          target_until = clock_time();
         }
-        default: {
-          break;
+        break;  
+      }                                   
+      case SENSOR_NODE: {
+        if (has_parent && !surveying) {
+          if(!linkaddr_cmp(dest, &linkaddr_node_addr)) {
+            // broadcast
+            LOG_INFO("COORDINATOR - RECEIVES BROADCAST FROM SENSOR\n");  
+            // our load, the sensors choose where it is lowest
+            parent_select_solicited(COORDINATOR_NODE, 0, parent_select_load(sensor_count(), neighbor_table_count(&children), MAX_CHILDREN));
+          } else {
+            // unicast
+            if (child != NULL) {
+              break;
+            }
+            child = neighbor_table_add(&children, src);
+            if (child == NULL) {
+              // full: it fails over at once rather than wait to be polled
+              send_pkt(OWN_TYPE, SYNCHRO_TYPE, DEAD, 0, src);
+              break;
+            }
+            neighbor_table_heard(child);
+            child_slots[neighbor_table_index(&children, child)] = 1;
+            child_lag[neighbor_table_index(&children, child)] = 0;
+            child_round[neighbor_table_index(&children, child)] = AGGREGATE_NO_ROUND;
+            aggregate_rounds_forget(&rounds, neighbor_table_index(&children, child));
+            answered[neighbor_table_index(&children, child)] = 0;
+#if PROTOCOL_PUSH
+            schedule_dirty = 1;
+#endif
+            net_config_announce();
+            LOG_INFO("COORDINATOR - A SENSOR JOINED HIM\n");
+            LOG_INFO_LLADDR(&child->addr);
+          }        
+        }
+        break;
+      }  
+      case COORDINATOR_NODE: {
+        static linkaddr_t coordinator;
+        linkaddr_copy(&coordinator, src);
+        if (!linkaddr_cmp(dest, &linkaddr_node_addr)) {
+          // out of range of the borders, it looks for a relay: offer our hops
+          if (has_parent && !surveying && hops < RELAY_MAX_HOPS && !is_parent(src) &&
+              (relayed_child != NULL || neighbor_table_count(&relayed) < MAX_RELAYED)) {
+            send_pkt(OWN_TYPE, RELAY_TYPE, hops, 0, &coordinator);
+          }
+        } else if (has_parent) {
+          // it takes our offer, with what it needs of our slot
+          if (is_parent(src) || hops >= RELAY_MAX_HOPS) {
+            break;
+          }
+          if (relayed_child == NULL) {
+            relayed_child = neighbor_table_add(&relayed, src);
+            if (relayed_child == NULL) {
+              break; // full
+            }
+            neighbor_table_heard(relayed_child);
+            relayed_lag[neighbor_table_index(&relayed, relayed_child)] = 0;
+            relayed_round[neighbor_table_index(&relayed, relayed_child)] = AGGREGATE_NO_ROUND;
+            net_config_announce();
+            LOG_INFO("COORDINATOR - relays for coordinator %u\n", src->u8[0] | (src->u8[1] << 8));
+          }
+          relayed_sensors[neighbor_table_index(&relayed, relayed_child)] = msg.payload;
         }
+        break;
       }
+      default: {
+        break;
+      }
+    }
+    break;
+  case SLOT_TYPE:
+    // from the border, or from the coordinator that relays for us
+    if ((msg.node != BORDER_NODE && msg.node != COORDINATOR_NODE) || !(has_parent ? is_parent(src) : linkaddr_cmp(src, &joining))) {
       break;
-    case MESSAGE_TYPE:      
-      if ((number_of_children > 0) && get_child_id(src) >= 0) {      
-        total_count += pkt.payload;
-        received_values++;
-        LOG_INFO("COORDINATOR - Received value %u from SENSOR\n", pkt.payload);
-      } 
-      break;
-    default:
-      // Discard
-      LOG_INFO("Type not recognized");
     }
-
-  }  
-  LOG_INFO_("\n");
-  if (len == sizeof(slot_packet_t)) {
+    if (!has_parent) {
+      hops = msg.node == BORDER_NODE ? 1 : relay_hops + 1;
+    }
     memcpy(&parent, src, sizeof(linkaddr_t));    
     parent_last_update = clock_time();
-    static slot_packet_t slot_pkt;
-    memcpy(&slot_pkt, data, sizeof(slot_packet_t));
-    clock_at_bc =  clock_time();   
-    network_clock = slot_pkt.clock;        
-    duration = slot_pkt.duration;
-    slot = slot_pkt.payload;
-    LOG_INFO("COORDINATOR - FROM BORDER \n Received Slot : %u, Duration : %lu, Netclock %lu\n", slot, duration, network_clock);
+    clock_sync_add(&network_clock, clock_time(), msg.clock);
+    net_config_update(get_network_clock()); // in case we missed the beacon
+#if PROTOCOL_PUSH
+    if (slot_start != msg.slot_start || duration != msg.slot_duration) {
+      schedule_sent = 0; // the pushes would miss the slot, POLL until the new SCHEDULE
+    }
+#endif
+    duration = msg.slot_duration;
+    slot_start = msg.slot_start;
+    if (msg.node == BORDER_NODE) {
+      duty_cycle_done(WINDOW_BEACON);
+    } else {
+      // a relay has no beacon, its next SLOT comes about a period later
+      duty_cycle_window(WINDOW_BEACON, clock_time() + PERIOD - BEACON_WINDOW / 2, BEACON_WINDOW, PERIOD);
+    }
+    // the sensors may push a little early
+    duty_cycle_window(WINDOW_SLOT, clock_time() + (slot_start + PERIOD - net_config_offset(get_network_clock())) % PERIOD - POLL_GUARD, duration + 2*POLL_GUARD, PERIOD);
+    duty_cycle_hold(DUTY_CYCLE_SEARCH, 0);
+#if MAC_CONF_WITH_TSCH
+    // the border listens in the cell of our slot, a relay in the one of the
+    // coordinators it relays for
+    if (msg.node == BORDER_NODE) {
+      tsch_cells_parent(TSCH_CELLS_BORDER, TSCH_CELLS_OF_SLOT(slot_start, PERIOD), &parent);
+    } else {
+      tsch_cells_parent(TSCH_CELLS_COORDINATOR, TSCH_CELLS_RELAY, &parent);
+    }
+#endif /* MAC_CONF_WITH_TSCH */
+    LOG_INFO("COORDINATOR - FROM BORDER \n Received Slot start : %lu, Duration : %lu, Netclock %lu\n", slot_start, duration, msg.clock);
+    if (neighbor_table_count(&relayed) > 0) {
+      clock_time_t t = send_relayed_slots();
+#if PROTOCOL_PUSH
+      if (t != relay_time) {
+        schedule_dirty = 1; // our sensors' windows move
+      }
+#endif
+      relay_time = t;
+#if MAC_CONF_WITH_TSCH
+      listen_children(neighbor_table_count(&children));
+#endif /* MAC_CONF_WITH_TSCH */
+      LOG_INFO("COORDINATOR - %u relayed coordinators take %lu of the slot\n", neighbor_table_count(&relayed), (unsigned long)relay_time);
+    } else {
+      relay_time = 0;
+    }
     received_clock = 1;
     if (!has_parent) {
       has_parent = 1;
+      new_parent = 1;
       process_poll(&nullnet_example_process);
       process_poll(&check_parent_process);
+      process_poll(&select_process);
     } else {
       process_poll(&nullnet_example_process);
     }
-
+    break;
+  case SYNCHRO_TYPE:
+    if (msg.payload == DEAD && msg.node == COORDINATOR_NODE && is_parent(src)) {
+      // our relay lost its parent
+      dead_parent(msg.clock);
+    } else if (relayed_child != NULL && linkaddr_cmp(dest, &linkaddr_node_addr)) {
+      if (msg.payload == DEAD) {
+        LOG_INFO("COORDINATOR - relayed coordinator %u leaves\n", src->u8[0] | (src->u8[1] << 8));
+        neighbor_table_remove(&relayed, relayed_child);
+      } else {
+        // what it needs of our next slot
+        relayed_sensors[neighbor_table_index(&relayed, relayed_child)] = msg.payload;
+      }
+    } else if (child != NULL && msg.node == SENSOR_NODE && msg.payload == DEAD && linkaddr_cmp(dest, &linkaddr_node_addr)) {
+      // it moves to another parent
+      neighbor_table_remove(&children, child);
+#if PROTOCOL_PUSH
+      schedule_dirty = 1;
+#endif
+    }
+    break;
+  case CONFIG_TYPE:
+    // the border's, on its clock: ours once we have a SLOT; a relay's in
+    // ticks from the frame
+    if (is_parent(src) && (msg.node == BORDER_NODE || msg.node == COORDINATOR_NODE) &&
+        net_config_receive(&msg.config, msg.node == BORDER_NODE ? msg.clock : get_network_clock() + msg.clock)) {
+      LOG_INFO("COORDINATOR - config %u, period %lu from %lu\n", msg.config.version, (unsigned long)msg.config.period, (unsigned long)msg.clock);
+    }
+    break;
+  case POLL_TYPE:
+  case SCHEDULE_TYPE:
+    // a neighbor collecting its own children
+    break;
+  case OFFER_TYPE:
+    // to a sensor searching around, ours may be redundant
+    parent_select_offered(msg.payload, msg.load);
+    break;
+  case RELAY_TYPE:
+    // an offer, the closest to a border wins
+    if (msg.node == COORDINATOR_NODE && !has_parent && asking_relay && msg.payload > 0 &&
+        msg.payload < RELAY_MAX_HOPS && (relay_hops == 0 || msg.payload < relay_hops)) {
+      linkaddr_copy(&relay, src);
+      relay_hops = msg.payload;
+      relay_channel = border_select_tuned();
+      relay_offer_at = clock_time();
+    }
+    break;
+  default:
+    // Discard
+    LOG_INFO("Type not recognized");
   }
-
+  LOG_INFO_("\n");
 }
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(nullnet_example_process, ev, data) {
-  static struct etimer periodic_timer;    
+  static slot_timer_t slot_timer; // the slot and its micro-slots
   static uint8_t is_in_slot = 0; 
+  static clock_time_t own_time; // of the slot, after the relayed coordinators
   
   PROCESS_BEGIN();
 
   /* Initialize NullNet */
-  nullnet_buf = (void *)&my_pkt;
-  nullnet_len = sizeof(my_pkt);
   nullnet_set_input_callback(input_callback);
+  neighbor_table_init(&children);
+  neighbor_table_init(&relayed);
+  aggregate_rounds_init(&rounds);
+  energy_init(&children_peak);
+  clock_sync_init(&network_clock);
+  duty_cycle_init();
+  parent_select_init();
+  slot_timer_init(&slot_timer);
+#if MAC_CONF_WITH_TSCH
+  tsch_cells_init();
+#endif /* MAC_CONF_WITH_TSCH */
       
   send_pkt(UNDEFINED_NODE, DISCOVERY_TYPE, 0, 0, &linkaddr_node_addr);
   while(1) {
@@ -273,61 +748,172 @@ PROCESS_THREAD(nullnet_example_process, ev, data) {
       if (!is_in_slot) {
         // Not in the slot => WAIT
         set_wait_slot_time();
-        etimer_set(&periodic_timer, wait_slot);
-        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
+        slot_timer_set(&slot_timer, clock_time() + wait_slot);
+        PROCESS_WAIT_EVENT_UNTIL(slot_timer_expired(&slot_timer));
         // In the slot => prepare actions
+        LOG_INFO("COORDINATOR - slot starts %u us late, %u at most\n", slot_timer.late, slot_timer.max_late);
         is_in_slot = 1;
         must_respond_before = clock_time() + duration;
-        child_duration = duration / (number_of_children + 1);
-        if (number_of_children > 0) {
+        // the period the slot falls in, safe from a slot starting a tick early
+        round = net_config_periods(get_network_clock() - slot_start + PERIOD / 2);
+        if ((neighbor_table_count(&children) > 0 || neighbor_table_count(&relayed) > 0) && net_config_due()) {
+          // before the POLL or the SCHEDULE, the sensors listen for it, not
+          // over their pushes
+          net_config_send(OWN_TYPE, get_network_clock(), 0, BROADCAST);
+#if PROTOCOL_PUSH
+          schedule_dirty = 1;
+#endif
+        }
+        // the sensors around that look for a parent listen too
+        parent_select_advertise(COORDINATOR_NODE, 0, parent_select_load(sensor_count(), neighbor_table_count(&children), MAX_CHILDREN), new_parent);
+        new_parent = 0;
+        if (hops > 1 && network_clock.count > 0) {
+          // a relay has no beacon to answer: what we need of its next slot
+          send_synchro(OWN_TYPE, sensor_payload(), get_network_clock(), network_clock.error < 255 ? network_clock.error : 255, &parent);
+        }
+        if (neighbor_table_count(&relayed) > 0) {
+          // the coordinators we relay for first, in their shares of the slot
+          slot_timer_set(&slot_timer, clock_time() + relay_time);
+          PROCESS_WAIT_EVENT_UNTIL(slot_timer_expired(&slot_timer) || relayed_answers >= neighbor_table_count(&relayed));
+          slot_timer_stop(&slot_timer);
+          LOG_INFO("COORDINATOR - %u of %u relayed coordinators answered\n", relayed_answers, neighbor_table_count(&relayed));
+        }
+        own_time = clock_time() < must_respond_before ? must_respond_before - clock_time() : 0;
+#if PROTOCOL_POLL
+        duty_cycle_hold(DUTY_CYCLE_ANSWER, 1); // until the border has our answer
+        if (neighbor_table_count(&children) > 0) {
+          // leave a micro-slot to answer the border
+          clock_time_t window = own_time > POLL_MICRO_SLOT ? own_time - POLL_MICRO_SLOT : 0;
+#if PROTOCOL_PUSH
+          if (!schedule_sent || schedule_dirty || ++schedule_age >= SCHEDULE_REFRESH) {
+            // polls this period, and the next ones the sensors push on their own
+            schedule_pushes = send_schedule(OWN_TYPE, &children, child_slots, window, round);
+#if MAC_CONF_WITH_TSCH
+            listen_children(neighbor_table_count(&children));
+#endif /* MAC_CONF_WITH_TSCH */
+            poll_answers = schedule_pushes;
+            schedule_sent = 1;
+            schedule_dirty = 0;
+            schedule_age = 0;
+            LOG_INFO("COORDINATOR - SCHEDULE %u SENSORS, answers within %lu\n", neighbor_table_count(&children), (unsigned long)poll_answers);
+          } else {
+            poll_answers = schedule_pushes;
+            LOG_INFO("COORDINATOR - WAIT FOR %u SENSORS TO PUSH\n", neighbor_table_count(&children));
+          }
+#else
+          poll_answers = send_poll(OWN_TYPE, &children, child_slots, NULL, window, round);
+#if MAC_CONF_WITH_TSCH
+          listen_children(neighbor_table_count(&children));
+#endif /* MAC_CONF_WITH_TSCH */
+          LOG_INFO("COORDINATOR - POLL %u SENSORS, answers within %lu\n", neighbor_table_count(&children), (unsigned long)poll_answers);
+#endif
+        }
+#else
+        child_duration = own_time / (neighbor_table_count(&children) + 1);
+        if (child_duration == 0) {
+          child_duration = 1; // a shrunk slot must still let the clock move
+        }
+        if (neighbor_table_count(&children) > 0) {
+            // children may have left since the last slot
+            current_child = current_child % neighbor_table_count(&children);
             starting_child = current_child;
             LOG_INFO("COORDINATOR - ask first SENSOR %d\n", starting_child);
-            LOG_INFO_LLADDR(&(children[current_child]));
-            send_pkt(OWN_TYPE, MESSAGE_TYPE, 0, child_duration, &(children[current_child]));
+            LOG_INFO_LLADDR(&neighbor_table_get(&children, current_child)->addr);
+            send_request(OWN_TYPE, child_duration, round, &neighbor_table_get(&children, current_child)->addr);
         }
+#endif
       } else {
         // In the slot
+#if PROTOCOL_POLL
         if (has_parent) {
-          if (number_of_children > 0) {
+          if (neighbor_table_count(&children) > 0) {
+            // every child answers in its micro-slots, but CSMA backoffs can push
+            // answers past them: wait the guard after the last micro-slot, or
+            // until all have answered, and keep the rest of the slot to
+            // recover the missing answers
+            static clock_time_t left;
+            static clock_time_t window;
+            slot_timer_set(&slot_timer, clock_time() + poll_answers + POLL_GUARD);
+            PROCESS_WAIT_EVENT_UNTIL(slot_timer_expired(&slot_timer) || received_values >= neighbor_table_count(&children));
+            slot_timer_stop(&slot_timer);
+#if PROTOCOL_PUSH
+            // the POLL of the missing ones goes out even if none is: the
+            // others know their push came in, and that we are still there
+            left = clock_time() < must_respond_before ? must_respond_before - clock_time() : 0;
+            poll_answers = send_poll(OWN_TYPE, &children, child_slots, answered, left > 2*POLL_MICRO_SLOT ? left - 2*POLL_MICRO_SLOT : 0, round);
+            if (received_values < neighbor_table_count(&children)) {
+              LOG_INFO("COORDINATOR - %u of %u SENSORS answered, POLL the others\n", received_values, neighbor_table_count(&children));
+              schedule_dirty = 1; // they may have missed the SCHEDULE
+              slot_timer_set(&slot_timer, clock_time() + poll_answers + POLL_GUARD);
+              PROCESS_WAIT_EVENT_UNTIL(slot_timer_expired(&slot_timer) || received_values >= neighbor_table_count(&children));
+              slot_timer_stop(&slot_timer);
+            }
+#endif
+            // the ones still missing are polled again as long as their
+            // micro-slots fit in what is left of the slot, never longer
+            while (received_values < neighbor_table_count(&children) && (window = missing_window()) > 0) {
+              LOG_INFO("COORDINATOR - %u of %u SENSORS answered, POLL the others again\n", received_values, neighbor_table_count(&children));
+              poll_answers = send_poll(OWN_TYPE, &children, child_slots, answered, window, round);
+              slot_timer_set(&slot_timer, clock_time() + poll_answers + POLL_GUARD);
+              PROCESS_WAIT_EVENT_UNTIL(slot_timer_expired(&slot_timer) || received_values >= neighbor_table_count(&children));
+              slot_timer_stop(&slot_timer);
+            }
+#if !PROTOCOL_PUSH
+            // late answers may still come in the rest of it
+            left = clock_time() < must_respond_before ? must_respond_before - clock_time() : 0;
+            if (received_values < neighbor_table_count(&children) && left > POLL_MICRO_SLOT) {
+              slot_timer_set(&slot_timer, clock_time() + left - POLL_MICRO_SLOT);
+              PROCESS_WAIT_EVENT_UNTIL(slot_timer_expired(&slot_timer) || received_values >= neighbor_table_count(&children));
+              slot_timer_stop(&slot_timer);
+            }
+#endif
+          }
+          LOG_INFO("COORDINATOR - %u of %u SENSORS answered => respond to border\n", received_values, neighbor_table_count(&children));
+          send_round();
+          is_in_slot = 0;
+          received_clock = 0;
+          // sleep until the beacon
+          duty_cycle_done(WINDOW_SLOT);
+          duty_cycle_hold(DUTY_CYCLE_ANSWER, 0);
+        }
+#else
+        if (has_parent) {
+          if (neighbor_table_count(&children) > 0) {
             if (clock_time() < (must_respond_before - ((5*child_duration/4)))) {
               LOG_INFO("COORDINATOR -  ask SENSOR\n");
 
-              current_child = (current_child + 1) % number_of_children;              
-              if (received_values ==number_of_children) {
-                LOG_INFO("COORDINATOR - All responded => data count at send : %u\n", total_count);
-                send_pkt(OWN_TYPE, MESSAGE_TYPE, total_count, 0, &parent);
+              current_child = (current_child + 1) % neighbor_table_count(&children);              
+              if (received_values >= neighbor_table_count(&children)) {
+                LOG_INFO("COORDINATOR - All responded\n");
+                send_round();
                 received_clock = 0;
-                total_count = 0;
                 is_in_slot = 0;
-                received_values = 0;
               } else {
                 if (current_child != starting_child) {                  
-                  send_pkt(OWN_TYPE, MESSAGE_TYPE, 0, child_duration, &children[current_child]);
+                  send_request(OWN_TYPE, child_duration, round, &neighbor_table_get(&children, current_child)->addr);
                 }
               }
               
             } else {
               printf("COORDINATOR - not enough time remains => respond to border\n");
-              send_pkt(OWN_TYPE, MESSAGE_TYPE, total_count, 0, &parent);
-              total_count = 0;
+              send_round();
               is_in_slot = 0;
               received_clock = 0;
-              received_values = 0;
             }
             printf("COORDINATOR - Waiting %lu time\n", child_duration);
-            etimer_set(&periodic_timer, child_duration);
-            PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
+            slot_timer_set(&slot_timer, clock_time() + child_duration);
+            PROCESS_WAIT_EVENT_UNTIL(slot_timer_expired(&slot_timer));
 
           } else {
             // TODO: send to parent
             printf("COORDINATOR - No child => just send 0\n");
-            send_pkt(OWN_TYPE, MESSAGE_TYPE, 0, 0, &parent);
+            send_round();
             is_in_slot = 0;
             received_clock = 0;
           }
         }
+#endif
       }
-      etimer_reset(&periodic_timer);
     }
   }
 
@@ -338,16 +924,30 @@ PROCESS_THREAD(nullnet_example_process, ev, data) {
 PROCESS_THREAD(check_parent_process, ev, data) {
   PROCESS_BEGIN();
   static struct etimer wait_interval;
+  static clock_time_t radio_on;
+  static clock_time_t silent_since;
+  static const border_candidate_t *backup;
 
   while (1) {
     if (!has_parent) {
       PROCESS_YIELD();
     } else {
       LOG_INFO("COORDINATOR - CHECKING IF BORDER STILL THERE\n");
-      if (clock_time() > (parent_last_update + (5*PERIOD))) {
-        dead_parent();
+      // a border heard on our channel since ours fell silent is alive: its
+      // next beacon is ours, no need to wait as long
+      silent_since = parent_last_update + 1;
+      backup = surveying ? NULL : border_select_best(silent_since);
+      if (backup != NULL && backup->channel == border_select_tuned()
+          && clock_time() > parent_last_update + BORDER_SELECT_MISSED * PERIOD) {
+        LOG_INFO("COORDINATOR - border lost, fails over to border %u\n", backup->addr.u8[0] | (backup->addr.u8[1] << 8));
+        dead_parent(0);
+        search_since = silent_since;
+      } else if (clock_time() > (parent_last_update + (net_config.short_timeout * PERIOD))) {
+        dead_parent(0);
       }
       check_dead_children();
+      LOG_INFO("COORDINATOR - radio on %lu%% of the last period\n", (unsigned long)(100 * (duty_cycle_on_time() - radio_on) / PERIOD));
+      radio_on = duty_cycle_on_time();
       etimer_set(&wait_interval, PERIOD);
       PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&wait_interval));
     }
@@ -355,5 +955,118 @@ PROCESS_THREAD(check_parent_process, ev, data) {
   PROCESS_END();
 }
 /*---------------------------------------------------------------------------*/
+PROCESS_THREAD(select_process, ev, data) {
+  PROCESS_BEGIN();
+  static struct etimer timer;
+  static unsigned c;
+#if BORDER_SELECT_CHANNELS > 1
+  static clock_time_t since;
+  static uint8_t own;
+#endif
+#if DUTY_CYCLE
+  static clock_time_t asked;
+#endif
 
-
+  border_select_init();
+  while (1) {
+    if (has_parent && !surveying) {
+      PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+#if BORDER_SELECT_CHANNELS > 1
+    } else if (surveying) {
+      // right after our slot: our border's next beacon and SLOT are missed
+      own = border_select_tuned();
+      survey_channel = border_select_next(survey_channel ? survey_channel : own);
+      if (survey_channel == own) {
+        survey_channel = border_select_next(own);
+      }
+      since = clock_time();
+      LOG_INFO("COORDINATOR - listens on channel %u for other borders\n", survey_channel);
+      duty_cycle_hold(DUTY_CYCLE_SEARCH, 1);
+      border_select_tune(survey_channel);
+      etimer_set(&timer, BORDER_SELECT_DWELL(PERIOD));
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+      border_select_tune(own);
+      duty_cycle_hold(DUTY_CYCLE_SEARCH, 0);
+      surveying = 0;
+      if (has_parent && compare_borders(since)) {
+        check_backoff = 0;
+      } else if (check_backoff < BORDER_SELECT_CHECK_BACKOFF) {
+        check_backoff++;
+      }
+    } else if ((int32_t)(target_until - clock_time()) > 0) {
+      // moving: the death notice leaves on the old channel first
+      etimer_set(&timer, CLOCK_SECOND / 4);
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+      border_select_tune(target_channel);
+      etimer_set(&timer, target_until - clock_time());
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer) || has_parent);
+      etimer_stop(&timer);
+    } else {
+      // a period on every channel, then the cheapest border's for its beacon,
+      // unless one is still heard since ours fell silent
+      if (border_select_best(search_since) == NULL || border_select_best(clock_time() - BORDER_SELECT_DWELL(PERIOD)) == NULL) {
+        scanning = 1;
+        since = clock_time();
+        for (c = 0; c < BORDER_SELECT_CHANNELS; c++) {
+          border_select_tune(border_select_channel(c));
+          etimer_set(&timer, BORDER_SELECT_DWELL(PERIOD));
+          PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+        }
+        scanning = 0;
+        search_since = since;
+      }
+      since = search_since;
+      if (border_select_best(since) != NULL) {
+        border_select_tune(border_select_best(since)->channel);
+        LOG_INFO("COORDINATOR - joins border %u on channel %u\n", border_select_best(since)->addr.u8[0] | (border_select_best(since)->addr.u8[1] << 8), border_select_tuned());
+        etimer_set(&timer, 2 * PERIOD);
+        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer) || has_parent);
+        etimer_stop(&timer);
+      }
+#else
+    } else {
+      // one channel: the beacons of all the borders come in as they are
+      etimer_set(&timer, BORDER_SELECT_DWELL(PERIOD));
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer) || has_parent);
+      etimer_stop(&timer);
+#endif /* BORDER_SELECT_CHANNELS > 1 */
+    }
+    if (RELAY_MAX_HOPS > 1 && !has_parent && !surveying && (int32_t)(target_until - clock_time()) <= 0 && border_select_best(search_since) == NULL) {
+      // no border heard: ask the coordinators around, on every channel, and
+      // join the one with the fewest hops to its border
+      relay_hops = 0;
+      asking_relay = 1;
+      for (c = 0; c < BORDER_SELECT_CHANNELS; c++) {
+        border_select_tune(border_select_channel(c));
+#if DUTY_CYCLE
+        for (asked = 0; asked < PERIOD && relay_hops == 0; asked += RELAY_SPACING) {
+          send_pkt(OWN_TYPE, DISCOVERY_TYPE, 0, 0, BROADCAST);
+          etimer_set(&timer, RELAY_SPACING);
+          PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+        }
+#else
+        send_pkt(OWN_TYPE, DISCOVERY_TYPE, 0, 0, BROADCAST);
+#endif
+        etimer_set(&timer, RELAY_OFFERS);
+        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+      }
+      asking_relay = 0;
+      if (relay_hops > 0 && !has_parent && border_select_best(search_since) == NULL) {
+        border_select_tune(relay_channel);
+#if DUTY_CYCLE
+        // in the window its offer came in
+        etimer_set(&timer, (PERIOD - (clock_time() - relay_offer_at) % PERIOD) % PERIOD);
+        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
+#endif
+        linkaddr_copy(&joining, &relay);
+        LOG_INFO("COORDINATOR - joins coordinator %u on channel %u, %u hops from the border\n", relay.u8[0] | (relay.u8[1] << 8), relay_channel, relay_hops + 1);
+        send_pkt(OWN_TYPE, DISCOVERY_TYPE, sensor_payload(), 0, &relay);
+        etimer_set(&timer, 2 * PERIOD);
+        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer) || has_parent);
+        etimer_stop(&timer);
+      }
+    }
+  }
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -15,6 +15,19 @@
 #include <radio.h>
 #include <arch/dev/radio/cc2420/cc2420.h>
 
+#include "neighbor-table.h"
+#include "aggregate.h"
+#include "protocol.h"
+#include "duty-cycle.h"
+#include "net-config.h"
+#include "border-select.h"
+#include "parent-select.h"
+#include "slot-timer.h"
+#include "trickle.h"
+#if MAC_CONF_WITH_TSCH
+#include "tsch-cells.h"
+#endif /* MAC_CONF_WITH_TSCH */
+
 #include "sys/log.h"
 #define LOG_MODULE "App"
 #define LOG_LEVEL LOG_LEVEL_INFO
@@ -25,68 +38,57 @@ AUTOSTART_PROCESSES(&nullnet_example_process , &check_for_parent);
 /*---------------------------------------------------------------------------*/
 
 #define MAX_PAYLOAD_LENGTH (uint8_t) 42
-#define PERIOD (5 * CLOCK_SECOND)
+#define PERIOD (net_config.period) // from the parent (see net-config.h)
 #define DURATION (1 * CLOCK_SECOND)
-unsigned DEAD = 42;
-
-typedef enum
-{
-  SENSOR_NODE = 0,
-  COORDINATOR_NODE = 1,
-  BORDER_NODE = 2,
-  UNDEFINED_NODE = 3
-} node_type;
-
-typedef enum
-{
-  DISCOVERY_TYPE = 0,
-  MESSAGE_TYPE = 1,
-  SYNCHRO_TYPE = 2
-} packet_type;
-
-typedef struct packet
-{
-  node_type node : 2;
-  packet_type msg : 2;
-  unsigned payload : 12;
-  clock_time_t clock : 32;
-} packet_t;
 
 #define BROADCAST NULL
 #define OWN_TYPE SENSOR_NODE
+
+#if DUTY_CYCLE && !PROTOCOL_POLL
+#error "DUTY_CYCLE needs PROTOCOL_POLL"
+#endif
+// Duty cycling: from the parent's SCHEDULE or POLL to the last answers
+#define WINDOW_PARENT 0
+// Without a POLL to follow, DISCOVERY is repeated over a whole period,
+// closer than the shortest window of the nodes that could answer it
+#define DISCOVERY_SPACING (3 * POLL_GUARD)
+// First interval of the search (see parent-select.h): with the radio off,
+// the POLL a DISCOVERY follows may only come a period later
+#if DUTY_CYCLE
+#define SEARCH_IMIN (2 * PERIOD)
+#else
+#define SEARCH_IMIN PARENT_SELECT_SEARCH(PERIOD)
+#endif
+// The offers to a DISCOVERY are in by then
+#define OFFERS_IN (PARENT_SELECT_BACKOFF + POLL_GUARD)
 static linkaddr_t parent;
 static node_type parent_type = UNDEFINED_NODE;
+static uint8_t depth = 0; // sensors from our coordinator down to us, see parent-select.h
 static uint8_t parent_ok = 0;
 static clock_time_t parent_last_update;
+static uint8_t asked = 0; // by the parent since the last check
+static uint8_t rounds_started = 0; // it asked us once since we joined
+static clock_time_t last_round; // it asked us, or we joined it
+static uint8_t parent_lost = 0; // its death notice came, or it turned us away
+static clock_time_t search_since; // offers heard since are parent candidates
+static trickle_t search; // our DISCOVERY, without a parent
+// Looking for a cheaper parent than ours, now and then: long enough for a
+// SCHEDULE of every coordinator around
+#define SURVEY_LENGTH ((SCHEDULE_REFRESH + 1) * PERIOD)
+#if DUTY_CYCLE
+static uint8_t surveying = 0;
+#endif
+static uint8_t checks = 0;
+static uint8_t check_in = PARENT_SELECT_CHECK;
+static uint8_t check_backoff = 0;
 static uint8_t recovery_period = 0;
+// Where to look for a parent after the recovery, from the death notice of
+// the parent: 0 to stay on the channel (see border-select.h)
+static uint8_t search_channel = 0;
 // static linkaddr_t* child_nodes;
-radio_value_t  parent_strength;
-static packet_t to_send;
 
 // static unsigned received_clock = 0;
 
-void send_pkt(node_type node, packet_type type, uint8_t payload, clock_time_t clock_v, linkaddr_t *dest) {
-  to_send.node = node;
-  to_send.msg = type;
-  to_send.payload = payload;
-  to_send.clock = clock_v;    
-  memcpy(nullnet_buf, &to_send, sizeof(to_send));
-  nullnet_len = sizeof(to_send);        
-  NETSTACK_NETWORK.output(dest); 
-}
-
-static const struct radio_driver *radio = &cc2420_driver;
-
-radio_value_t get_strength() {
-  radio_value_t strength = 0;
-  radio_result_t res = radio->get_value(RADIO_PARAM_LAST_RSSI, &strength);
-  if (res != RADIO_RESULT_OK) {
-    return INT_MIN;
-  } else {
-    return strength;
-  }
-}
-
 int is_unicast(const linkaddr_t *dest) {
   return linkaddr_cmp(dest, &linkaddr_node_addr);
 }
@@ -101,13 +103,42 @@ uint8_t get_sensor_count() {
   return r;
 }
 
-static uint8_t must_respond = 0;
+static uint8_t collecting = 0; // asking the children one after the other
+// Answer to the parent's POLL: its window, from the reception of the POLL
+static uint8_t poll_pending = 0;
+static uint8_t polling = 0; // collecting the children's answers to our POLL
+static clock_time_t poll_start;
+static clock_time_t poll_length;
+static clock_time_t poll_micro;
+// Of the parent's last POLL: one for the same round recovers the missing
+// answers, the windows and cells stay those of the first
+static uint16_t polled_round = AGGREGATE_NO_ROUND;
+// Push mode: the parent's SCHEDULE gives the window of every period
+static uint8_t scheduled = 0;
+static clock_time_t next_push; // start of the next window, on our clock
+static clock_time_t pushed_at;
+static clock_time_t push_length;
+static clock_time_t push_micro;
+#if DUTY_CYCLE
+static uint8_t heard_poll = 0; // someone's slot started, its nodes listen
+#endif
 
 #define MAX_CHILDREN 16
-static linkaddr_t children[MAX_CHILDREN]; // TODO resize if necessary
-static clock_time_t children_last_update[MAX_CHILDREN];
-static uint8_t total_count = 0;
-static uint8_t number_of_children = 0;
+#if MAX_CHILDREN > AGGREGATE_MAX_CHILDREN
+#error "MAX_CHILDREN exceeds the children an aggregate_rounds_t tells apart"
+#endif
+NEIGHBOR_TABLE(children, MAX_CHILDREN);
+static aggregate_rounds_t rounds; // own readings and the children's aggregates
+static uint8_t round; // being collected, from the parent
+static uint16_t read_round = AGGREGATE_NO_ROUND; // of the last own reading
+static uint8_t child_slots[MAX_CHILDREN]; // readings in each child's last answer
+static uint8_t child_lag[MAX_CHILDREN]; // rounds each child's answers are behind
+static uint16_t child_round[MAX_CHILDREN]; // of each child's last answer
+#if AGGREGATE_FILL_AGE > 0
+static aggregate_t child_last[MAX_CHILDREN]; // stands in for the lost ones
+#endif
+static uint8_t answered[MAX_CHILDREN]; // since our request or POLL
+static energy_t children_peak; // of the answers since ours
 
 // Variable for 
 uint8_t current_child = 0;
@@ -116,18 +147,38 @@ uint8_t received_values = 0;
 clock_time_t child_interval;
 clock_time_t must_repond_before;
 
-void dead_parent() {
+// Our children look for a new parent on channel first, 0 for any
+void dead_parent(uint8_t channel) {
   LOG_INFO("SENSOR - Parent is DEAD; RIP\n");
   memset(&parent, 0, sizeof(parent));
   parent_type = UNDEFINED_NODE;
   parent_ok = 0;
-  number_of_children = 0;
-  total_count = 0;
+  neighbor_table_clear(&children);
+  aggregate_rounds_init(&rounds);
+  read_round = AGGREGATE_NO_ROUND;
+  polled_round = AGGREGATE_NO_ROUND;
+  energy_init(&children_peak);
   received_values = 0;
-  must_respond = 0;
-  parent_strength = INT_MIN;
+  collecting = 0;
+  poll_pending = 0;
+  polling = 0;
+  scheduled = 0;
+  depth = 0;
+  parent_lost = 0;
+#if DUTY_CYCLE
+  surveying = 0;
+#endif
+  duty_cycle_cancel(WINDOW_PARENT);
+  duty_cycle_hold(DUTY_CYCLE_SEARCH, 1);
+#if MAC_CONF_WITH_TSCH
+  tsch_cells_parent(TSCH_CELLS_SENSOR, 0, NULL);
+  tsch_cells_children(TSCH_CELLS_SENSOR, 0);
+#endif /* MAC_CONF_WITH_TSCH */
+  // the next parent may be under another border, with other timings
+  net_config_init();
   // Broadcast the death
-  send_pkt(OWN_TYPE, SYNCHRO_TYPE, DEAD, 0, BROADCAST);
+  send_pkt(OWN_TYPE, SYNCHRO_TYPE, DEAD, channel, BROADCAST);
+  search_channel = channel;
   // Activate main thread
   recovery_period = 1;
   process_poll(&nullnet_example_process);
@@ -137,37 +188,266 @@ void dead_parent() {
 // ------------------------------------------------- //
 
 
-void dead_child(int child_id) {
-  LOG_INFO("SENSOR - Child ");
-  LOG_INFO_LLADDR(&children[child_id]);
-  LOG_INFO(" is DEAD, RIP\n");
-  // Shift all elements from "current_child" to the left
-  for (int i = child_id; i < number_of_children; i++){
-    children[i]=children[i+1];
+void check_dead_children() {
+  unsigned dead = neighbor_table_expire(&children, net_config.short_timeout * PERIOD);
+  if (dead > 0) {
+    LOG_INFO("SENSOR - %u children are DEAD, RIP\n", dead);
   }
-  number_of_children--;
 }
 
+// Readings of our subtree in the last answers, ours included
+unsigned subtree_readings() {
+  unsigned readings = 1;
+  for (int i = 0; i < neighbor_table_count(&children); i++) {
+    readings += child_slots[neighbor_table_index(&children, neighbor_table_get(&children, i))];
+  }
+  return readings;
+}
 
-void check_dead_children() {
-  for (int i = 0; i < number_of_children; i++) {
-    if (clock_time() > (children_last_update[i] + (5*PERIOD))) {
-      dead_child(i);
+// The load we offer: ours, or our parent's if it is higher, its slot
+// takes our readings too
+uint8_t offer_load() {
+  const parent_candidate_t *ours = parent_select_lookup(&parent);
+  uint8_t load = parent_select_load(subtree_readings(), neighbor_table_count(&children), MAX_CHILDREN);
+  if (ours != NULL && ours->load > load && load != PARENT_SELECT_FULL) {
+    load = ours->load < PARENT_SELECT_FULL ? ours->load : PARENT_SELECT_FULL - 1;
+  }
+  return load;
+}
+
+void take_parent(const parent_candidate_t *p) {
+  linkaddr_copy(&parent, &p->addr);
+  parent_type = p->depth == 0 ? COORDINATOR_NODE : SENSOR_NODE;
+  depth = p->depth + 1;
+  LOG_INFO("SENSOR - New parent : %s, cost %u => ", parent_type == COORDINATOR_NODE ? "coordinator" : "sensor", parent_select_cost(p));
+  LOG_INFO_LLADDR(&parent);
+  LOG_INFO_("\n");
+}
+
+// Leaves our parent for p, with our children: the rounds start over from
+// the new parent's, and so do our windows. Our readings of the rounds we
+// answered went up through the old one already.
+void change_parent(const parent_candidate_t *p) {
+  send_pkt(OWN_TYPE, SYNCHRO_TYPE, DEAD, 0, &parent); // we leave it
+  take_parent(p);
+  aggregate_rounds_init(&rounds);
+  for (int i = 0; i < neighbor_table_count(&children); i++) {
+    unsigned c = neighbor_table_index(&children, neighbor_table_get(&children, i));
+    child_lag[c] = 0;
+    child_round[c] = AGGREGATE_NO_ROUND;
+  }
+  poll_pending = 0;
+  polled_round = AGGREGATE_NO_ROUND;
+  scheduled = 0;
+  duty_cycle_cancel(WINDOW_PARENT);
+  duty_cycle_hold(DUTY_CYCLE_SEARCH, 1);
+#if MAC_CONF_WITH_TSCH
+  tsch_cells_parent(TSCH_CELLS_SENSOR, 0, NULL);
+#endif /* MAC_CONF_WITH_TSCH */
+}
+
+// The offer heard since "since" that costs less than our parent without us
+// by more than what we would bring to it, NULL if none. No deeper than our
+// parent, our subtree is deeper.
+const parent_candidate_t *better_parent(clock_time_t since) {
+  const parent_candidate_t *ours = parent_select_lookup(&parent);
+  const parent_candidate_t *best;
+  if (ours == NULL) {
+    return NULL;
+  }
+  best = parent_select_best(since, ours->depth);
+  if (best == NULL || linkaddr_cmp(&best->addr, &parent) || neighbor_table_lookup(&children, &best->addr) != NULL) {
+    return NULL;
+  }
+  if (parent_select_cost(best) + parent_select_load(subtree_readings(), 0, MAX_CHILDREN) + PARENT_SELECT_HYSTERESIS >= parent_select_cost(ours)) {
+    return NULL;
+  }
+  return best;
+}
+
+// Not all the sensors of a parent at the same time
+void next_check() {
+  checks = 0;
+  check_in = (PARENT_SELECT_CHECK << check_backoff) + (linkaddr_node_addr.u8[0] + 7 * round) % (PARENT_SELECT_CHECK << check_backoff);
+}
+
+// The cheaper parent heard since "since", NULL if none: the checks back off
+const parent_candidate_t *end_survey(clock_time_t since) {
+  const parent_candidate_t *best = better_parent(since);
+  if (best != NULL) {
+    check_backoff = 0;
+  } else if (check_backoff < PARENT_SELECT_CHECK_BACKOFF) {
+    check_backoff++;
+  }
+  return best;
+}
+
+// Every period: the round of the parent, and now and then, if it is busy
+// or lossy, a survey of the coordinators around in their lists. Sooner when
+// it misses rounds. Returns the parent to move to, NULL to stay.
+const parent_candidate_t *check_parent() {
+  const parent_candidate_t *ours = parent_select_lookup(&parent);
+  // from the first round it asks us in, not before its slot starts
+  rounds_started |= asked;
+  if (rounds_started) {
+    parent_select_round(&parent, asked || scheduled);
+  }
+  asked = 0;
+  if (ours == NULL) {
+    return NULL;
+  }
+#if DUTY_CYCLE
+  if (surveying) {
+    if (clock_time() - search_since < SURVEY_LENGTH) {
+      return NULL;
+    }
+    surveying = 0;
+    duty_cycle_hold(DUTY_CYCLE_SEARCH, 0);
+    return end_survey(search_since);
+  }
+#endif
+  checks += ours->etx >= PARENT_SELECT_ETX_BAD ? 4 : 1;
+  if (checks < check_in) {
+    return NULL;
+  }
+  next_check();
+  if (parent_select_cost(ours) < PARENT_SELECT_BUSY && ours->etx < PARENT_SELECT_ETX_BAD) {
+    return NULL;
+  }
+  LOG_INFO("SENSOR - parent costs %u, looks for another\n", parent_select_cost(ours));
+#if DUTY_CYCLE
+  // the lists come in the others' windows: with the radio on
+  surveying = 1;
+  search_since = clock_time();
+  duty_cycle_hold(DUTY_CYCLE_SEARCH, 1);
+  return NULL;
+#else
+  // heard all along
+  return end_survey(clock_time() - SURVEY_LENGTH);
+#endif
+}
+
+// Whether our parent stopped asking us, or acknowledging our pushes with
+// its POLL of the missing ones: for PARENT_SELECT_MISSED periods, or for
+// longer since we joined, its slot may not fit us yet
+int missed_rounds() {
+  clock_time_t limit = (rounds_started || asked ? PARENT_SELECT_MISSED : net_config.short_timeout) * PERIOD;
+#if !PROTOCOL_POLL
+  // the requests go round the children as far as the slot allows
+  limit = net_config.timeout * PERIOD;
+#endif
+#if DUTY_CYCLE
+  limit += PERIOD; // our window may have to find its slot again first
+#endif
+  return clock_time() - last_round > limit;
+}
+
+// The parent to fail over to, our lost one forgotten: the cheapest offer
+// heard lately, no deeper than the lost one if our children come along
+// (they are deeper), NULL if none
+const parent_candidate_t *backup_parent() {
+  parent_select_forget(&parent);
+  return parent_select_best(clock_time() - net_config.timeout * PERIOD,
+                            neighbor_table_count(&children) > 0 ? depth - 1 : PARENT_SELECT_MAX_DEPTH);
+}
+
+// A POLL or SCHEDULE heard: a coordinator that lists all its children
+// tells the load it would offer, for free. Our parent's keeps its offer
+// fresh.
+void heard_list(const message_t *pkt, const linkaddr_t *src) {
+  const parent_candidate_t *p = parent_select_lookup(src);
+  if (pkt->node == COORDINATOR_NODE && (pkt->type == SCHEDULE_TYPE || !PROTOCOL_PUSH)) {
+    parent_select_heard(src, 0, parent_select_load(poll_slots(pkt), pkt->poll_count, MAX_CHILDREN));
+  } else if (p != NULL && is_parent(src)) {
+    parent_select_heard(src, p->depth, p->load);
+  }
+}
+
+// The children whose answer for round r never came, lost: their last
+// answer stands in for it, if recent enough
+void fill_round(uint8_t r) {
+#if AGGREGATE_FILL_AGE > 0
+  aggregate_t *a = aggregate_round(&rounds, r, round);
+  for (int k = 0; a != NULL && k < neighbor_table_count(&children); k++) {
+    int i = neighbor_table_index(&children, neighbor_table_get(&children, k));
+    uint8_t age = r - child_round[i];
+    // none yet, or it answered a later round: nothing to stand in
+    if (child_round[i] == AGGREGATE_NO_ROUND || !aggregate_round_child(&rounds, r, i)
+        || age == 0 || age > AGGREGATE_FILL_AGE) {
+      continue;
     }
+    aggregate_fill(a, &child_last[i], age);
+  }
+#endif
+}
+
+// Answers the parent at once, for the last round the subtree completed:
+// the current one without children, else one round behind the slowest
+// child. The children are collected afterwards, for the next answers.
+void answer_parent() {
+  static energy_t energy;
+  uint8_t lag = 0;
+  // once per round, not again for a round a new parent is still behind on
+  if (read_round == AGGREGATE_NO_ROUND || (uint8_t)(read_round - round) >= AGGREGATE_ROUNDS) {
+    read_round = round;
+    aggregate_add(aggregate_round(&rounds, round, round), get_sensor_count());
+  }
+  for (int i = 0; i < neighbor_table_count(&children); i++) {
+    uint8_t l = child_lag[neighbor_table_index(&children, neighbor_table_get(&children, i))] + 1;
+    lag = l > lag ? l : lag;
+  }
+  if (lag >= AGGREGATE_ROUNDS) {
+    lag = AGGREGATE_ROUNDS - 1; // too deep, the rest comes in late
   }
+  energy_sample(&energy);
+  energy_merge(&energy, &children_peak);
+  energy_init(&children_peak);
+  fill_round(round - lag);
+  LOG_INFO("SENSOR - answer round %u, %u uA\n", (uint8_t)(round - lag), energy_current(&energy));
+  send_aggregate(OWN_TYPE, aggregate_round(&rounds, round - lag, round), round - lag, &energy, &parent);
 }
 
-int8_t get_child_id(const linkaddr_t *addr) {
-  for (uint8_t i = 0; i < number_of_children; i++) {
-    if (linkaddr_cmp(&children[i], addr)) return i;
+// The parent's windows come with the new period from the switch on, ours
+// follow its next SCHEDULE or POLL
+void switch_config() {
+  if (net_config_update(clock_time())) {
+    LOG_INFO("SENSOR - config %u, period %lu\n", net_config.version, (unsigned long)PERIOD);
+    duty_cycle_hold(DUTY_CYCLE_SEARCH, 1);
   }
-  return -1;
 }
 
+#if DUTY_CYCLE
+// The parent's SCHEDULE, or its POLL if it does not send any, opens our
+// window every period: from then to the last answers and a POLL that
+// recovers the missing ones. Not listed, the parent lost us: join it again
+// while it listens.
+void follow_parent(const message_t *pkt, int listed) {
+  if (pkt->type == POLL_TYPE && scheduled) {
+    return; // a recovery POLL, in the window of the SCHEDULE
+  }
+  if (!listed) {
+    send_pkt(OWN_TYPE, DISCOVERY_TYPE, 0, 0, &parent);
+    return;
+  }
+  duty_cycle_window(WINDOW_PARENT, clock_time() - 2*POLL_GUARD, poll_end(pkt) + 5*POLL_GUARD, PERIOD);
+  duty_cycle_hold(DUTY_CYCLE_SEARCH, 0);
+}
+#endif
+
+#if MAC_CONF_WITH_TSCH
+// Sends up in the cell of our position in the parent's list. Only a full
+// list, a coordinator's recovery POLL leaves out those that pushed.
+void follow_cells(const message_t *pkt) {
+  int position = poll_position(pkt, &linkaddr_node_addr);
+  if (position >= 0) {
+    tsch_cells_parent(parent_type == COORDINATOR_NODE ? TSCH_CELLS_COORDINATOR : TSCH_CELLS_SENSOR, position, &parent);
+  }
+}
+#endif /* MAC_CONF_WITH_TSCH */
+
 void input_callback(const void *data, uint16_t len, const linkaddr_t *src, const linkaddr_t *dest) {
-  if (!linkaddr_cmp(src, &linkaddr_node_addr) && len == sizeof(packet_t)) {
-    packet_t pkt;
-    memcpy(&pkt, data, sizeof(packet_t));
+  static message_t pkt;
+  if (!linkaddr_cmp(src, &linkaddr_node_addr) && protocol_decode(&pkt, data, len)) {
     LOG_INFO("Received from ");
     LOG_INFO_LLADDR(src);
     LOG_INFO_("\n");
@@ -176,110 +456,201 @@ void input_callback(const void *data, uint16_t len, const linkaddr_t *src, const
       // Update parent last update
       parent_last_update = clock_time();
     }
-    int8_t id = get_child_id(src);
-    if (id >= 0) {      
-      children_last_update[id] = clock_time();
+    neighbor_t *child = neighbor_table_lookup(&children, src);
+    if (child != NULL) {      
+      neighbor_table_heard(child);
     }
 
     if (is_unicast(dest)) {
-      switch (pkt.msg) {
-        case DISCOVERY_TYPE:          
-          if (pkt.node == COORDINATOR_NODE) {
-              // parent candidate
-              if (parent_type != COORDINATOR_NODE) {
-                // old parent : unkown or sensor
-                memcpy(&parent, src, sizeof(linkaddr_t));
-                parent_type = COORDINATOR_NODE;
-                parent_strength = get_strength();
-                LOG_INFO("SENSOR - New parent : coordinator => ");
-                LOG_INFO_LLADDR(&parent);
-                LOG_INFO("\n");
+      switch (pkt.type) {
+        case AGGREGATE_TYPE:
+          // a child answers with the aggregate of its subtree, for the next
+          // answers: it may come in any time before the next request
+          if (child != NULL) {
+            int i = neighbor_table_index(&children, child);
+            aggregate_t *a = aggregate_round(&rounds, pkt.round, round);
+            energy_merge(&children_peak, &pkt.energy);
+            if (a == NULL) {
+              break; // too late for its round
+            }
+            // a round is merged once, however often it is sent, and never
+            // after a later one
+            if (child_round[i] == AGGREGATE_NO_ROUND || (int8_t)(pkt.round - child_round[i]) > 0) {
+              child_round[i] = pkt.round;
+#if AGGREGATE_FILL_AGE > 0
+              child_last[i] = pkt.aggregate;
+#endif
+              // unless its last answer stood in for it, we answered already
+              if (aggregate_round_child(&rounds, pkt.round, i)) {
+                aggregate_merge(a, &pkt.aggregate);
+              }
+              if ((uint8_t)(round - pkt.round) > child_lag[i]) {
+                child_lag[i] = round - pkt.round;
+              }
+            }
+            if (!answered[i]) {
+              answered[i] = 1;
+              received_values++;
+            }
+            child_slots[i] = pkt.aggregate.count < 255 ? pkt.aggregate.count : 255;
+            if (polling) {
+              process_poll(&nullnet_example_process); // may end the POLL early
+            }
+          }
+          break;
+        case DISCOVERY_TYPE:
+          if (pkt.node == SENSOR_NODE && pkt.payload == 0) {
+            // child discovery
+            if (parent_ok && child == NULL) {
+              child = neighbor_table_add(&children, src);
+              if (child != NULL) {
+                LOG_INFO("SENSOR - New child\n");
+                neighbor_table_heard(child);
+                child_slots[neighbor_table_index(&children, child)] = 1;
+                child_lag[neighbor_table_index(&children, child)] = 0;
+                child_round[neighbor_table_index(&children, child)] = AGGREGATE_NO_ROUND;
+                aggregate_rounds_forget(&rounds, neighbor_table_index(&children, child));
+                answered[neighbor_table_index(&children, child)] = 0;
+                net_config_announce();
               } else {
-                  // compare strengt
-                  radio_value_t new_strength = get_strength();
-                  if (new_strength > parent_strength) {
-                    LOG_INFO("SENSOR - New parent : coordinator with higher signal strength :");
-                    LOG_INFO_LLADDR(&parent);
-                    LOG_INFO("\n");
-                    memcpy(&parent, src, sizeof(linkaddr_t));
-                    parent_strength = new_strength;
-                  }
+                send_pkt(OWN_TYPE, SYNCHRO_TYPE, DEAD, 0, src); // full, see the coordinator
               }
-          } else if (pkt.node == SENSOR_NODE) {
-            if (parent_ok) {
-              // child discovery
-              LOG_INFO("SENSOR - New child\n");
-              children[number_of_children] = *src;
-              children_last_update[number_of_children] = clock_time();
-              number_of_children++;
-            } else {
-              // parent candidate
-              LOG_INFO("SENSOR - Discovery + sensor\n");
-              if (parent_type != COORDINATOR_NODE) {
-                  if (parent_type != UNDEFINED_NODE) {
-                      // already have a parent
-                      radio_value_t new_strength = get_strength();
-                      if (new_strength > parent_strength) {
-                        memcpy(&parent, src, sizeof(linkaddr_t));
-                        parent_strength = new_strength;
-                        LOG_INFO("SENSOR - New parent : sensor with higher signal strength :");
-                        LOG_INFO_LLADDR(&parent);
-                        LOG_INFO("\n");
-                      }
-                  } else {
-                      // LOG_INFO("Discovery + sensor : new parent\n");
-                      memcpy(&parent, src, sizeof(linkaddr_t));
-                      LOG_INFO("SENSOR - New parent : sensor");
-                      LOG_INFO_LLADDR(&parent);
-                      LOG_INFO("\n");
-                      parent_type = SENSOR_NODE;
-                      parent_strength = get_strength();
-                  }
-              } // else discard
             }
           }
           break;
         case MESSAGE_TYPE:
           if (is_parent(src)) {
-            if (number_of_children == 0) {              
-              uint8_t to_send = get_sensor_count();
-              LOG_INFO("SENSOR - no child, count : %u\n",  to_send);
-              send_pkt(OWN_TYPE, MESSAGE_TYPE, to_send, 0, &parent);
-            } else {
-              total_count = 0;
+            round = pkt.round;
+            asked = 1;
+            last_round = clock_time();
+            answer_parent();
+            if (neighbor_table_count(&children) > 0) {
+              // the whole time left goes to the children, for the next answers
               received_values = 0;
-              must_respond = 1;
+              memset(answered, 0, sizeof(answered));
+              collecting = 1;
               must_repond_before = clock_time() + pkt.clock;
-              child_interval = pkt.clock / (number_of_children + 1);
+              child_interval = pkt.clock / neighbor_table_count(&children);
+              if (child_interval == 0) {
+                child_interval = 1; // a shrunk slot must still let the clock move
+              }
               LOG_INFO("SENSOR - Child interval %lu\n", child_interval);
-              // current_child = (current_child + 1) % number_of_children;
+              // children may have left since the last request
+              current_child = current_child % neighbor_table_count(&children);
               starting_child = current_child;
               process_poll(&nullnet_example_process);
-              send_pkt(OWN_TYPE, MESSAGE_TYPE, 0, child_interval, &children[current_child]);
+              if (net_config_due()) {
+                net_config_send(OWN_TYPE, clock_time(), 0, BROADCAST);
+              }
+              send_request(OWN_TYPE, child_interval, round, &neighbor_table_get(&children, current_child)->addr);
             }
           } else {
-            if (must_respond && get_child_id(src) >= 0) {
-              // if right child respond
-              total_count += pkt.payload;
-              received_values++;
-            } else {
-                LOG_INFO_LLADDR(src);
-              }
+            LOG_INFO_LLADDR(src);
+          }
+          break;
+        case SYNCHRO_TYPE:
+          if (child != NULL && pkt.payload == DEAD) {
+            // it moves to another parent
+            neighbor_table_remove(&children, child);
+          } else if (is_parent(src) && parent_ok && pkt.payload == DEAD) {
+            // it has no room for us
+            parent_lost = 1;
+            process_poll(&check_for_parent);
           }
           break;
         default:
-          //printf("Unsupported packet type %x\n", pkt.msg);
+          //printf("Unsupported packet type %x\n", pkt.type);
           break;
       }
     } else {
-      if (pkt.msg == DISCOVERY_TYPE && pkt.node == SENSOR_NODE && parent_ok) {
-        // Child node request for parent
-        static linkaddr_t to_callback;
-        memcpy(&to_callback, src, sizeof(linkaddr_t));
-        send_pkt(OWN_TYPE, DISCOVERY_TYPE, 0, 0, &to_callback);
+#if DUTY_CYCLE
+      if ((pkt.type == POLL_TYPE || pkt.type == SCHEDULE_TYPE) && !parent_ok) {
+        heard_poll = 1;
+        process_poll(&nullnet_example_process);
       }
-      if (pkt.msg == SYNCHRO_TYPE && is_parent(src) && pkt.payload == DEAD) {
-        dead_parent();
+#endif
+      if (pkt.type == POLL_TYPE || pkt.type == SCHEDULE_TYPE) {
+        heard_list(&pkt, src);
+        if (!parent_ok && pkt.node == COORDINATOR_NODE) {
+          // a coordinator that takes children around: ask again soon
+          trickle_reset(&search, clock_time());
+          process_poll(&nullnet_example_process);
+        }
+      }
+      if (pkt.type == CONFIG_TYPE && is_parent(src) && parent_ok) {
+        // its boundary comes in ticks from now
+        net_config_receive(&pkt.config, clock_time() + pkt.clock);
+      }
+      if (is_parent(src) && parent_ok) {
+        switch_config();
+      }
+      if (pkt.type == DISCOVERY_TYPE && pkt.node == SENSOR_NODE) {
+        if (parent_ok) {
+          // Child node request for parent
+          parent_select_solicited(OWN_TYPE, depth, offer_load());
+        } else {
+          // its offers come to us too
+          trickle_heard(&search);
+        }
+      }
+      if (pkt.type == OFFER_TYPE && (pkt.node == COORDINATOR_NODE || pkt.node == SENSOR_NODE)) {
+        // parent candidate, a sensor's offer carries its depth
+        parent_select_heard(src, pkt.payload, pkt.load);
+        parent_select_offered(pkt.payload, pkt.load);
+      }
+      if (pkt.type == POLL_TYPE && is_parent(src) && parent_ok) {
+        uint8_t listed = poll_lookup(&pkt, &linkaddr_node_addr, &poll_start, &poll_length);
+        if (listed || scheduled) {
+          // a scheduled sensor it does not list pushed already
+          last_round = clock_time();
+        }
+        if (listed) {
+          asked = 1;
+          round = pkt.round;
+          poll_micro = pkt.micro_slot;
+          poll_pending = 1;
+          process_poll(&nullnet_example_process);
+        }
+#if DUTY_CYCLE
+        if (pkt.round != polled_round) {
+          follow_parent(&pkt, listed);
+        }
+#endif
+#if MAC_CONF_WITH_TSCH
+        if (pkt.round != polled_round && (!PROTOCOL_PUSH || parent_type == SENSOR_NODE)) {
+          follow_cells(&pkt);
+        }
+#endif /* MAC_CONF_WITH_TSCH */
+        polled_round = pkt.round;
+      }
+      if (pkt.type == SCHEDULE_TYPE && is_parent(src) && parent_ok) {
+        // answered as a POLL now, then pushed one period later each time
+        uint8_t pushed = scheduled && clock_time() - pushed_at < PERIOD / 2;
+        scheduled = poll_lookup(&pkt, &linkaddr_node_addr, &poll_start, &poll_length);
+        if (scheduled) {
+          last_round = clock_time();
+          round = pkt.round;
+          poll_micro = pkt.micro_slot;
+          poll_pending = !pushed; // unless this period's push went just before
+          next_push = clock_time() + poll_start + PERIOD;
+          push_length = poll_length;
+          push_micro = poll_micro;
+        }
+#if DUTY_CYCLE
+        follow_parent(&pkt, scheduled);
+#endif
+#if MAC_CONF_WITH_TSCH
+        follow_cells(&pkt);
+#endif /* MAC_CONF_WITH_TSCH */
+        process_poll(&nullnet_example_process);
+      }
+      if (pkt.type == SYNCHRO_TYPE && is_parent(src) && pkt.payload == DEAD) {
+        if (pkt.clock != 0) {
+          dead_parent(pkt.clock); // it moves to that channel, follow it
+        } else {
+          parent_lost = 1;
+          process_poll(&check_for_parent);
+        }
       }
     }
   }
@@ -291,12 +662,23 @@ PROCESS_THREAD(nullnet_example_process, ev, data) {
   PROCESS_BEGIN();
   // SENSORS_ACTIVATE(button_sensor);
   /* Initialize NullNet */
-  nullnet_buf = (uint8_t *)&to_send;
-  nullnet_len = sizeof(packet_t);
   nullnet_set_input_callback(input_callback);
+  neighbor_table_init(&children);
+  parent_select_init();
+  duty_cycle_init();
+  border_select_init();
+#if MAC_CONF_WITH_TSCH
+  tsch_cells_init();
+#endif /* MAC_CONF_WITH_TSCH */
 
   static struct etimer wait_for_parents;
-  static struct etimer wait_interval;
+  static slot_timer_t slot_timer; // our windows and the requests to the children
+  static const parent_candidate_t *best;
+  static uint8_t step; // of the search's Trickle timer
+#if DUTY_CYCLE
+  static uint8_t soliciting; // a DISCOVERY for the next POLL heard
+#endif
+  slot_timer_init(&slot_timer);
 
   while(1) {
     if (!parent_ok) {
@@ -307,48 +689,150 @@ PROCESS_THREAD(nullnet_example_process, ev, data) {
         etimer_reset(&wait_for_parents);
         recovery_period = 0;
         LOG_INFO("SENSOR - End of recovery, searching a new parent\n");
+        if (search_channel != 0) {
+          // where the parent went, its death notice is out by now
+          border_select_tune(search_channel);
+          search_channel = 0;
+        }
       }
-      // No parent
-      send_pkt(DISCOVERY_TYPE, OWN_TYPE, 0, 0, BROADCAST);
-      etimer_set(&wait_for_parents, 2*PERIOD);
-      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&wait_for_parents));
-      if (parent_type != UNDEFINED_NODE) {
-        send_pkt(OWN_TYPE, DISCOVERY_TYPE, 0, 0, &parent);
-        parent_ok = 1;
-        parent_last_update = clock_time();
-        // Starts check for parent failure
-        process_poll(&check_for_parent);
-      } else {
-        //printf("No parent found :(\n)");
+      // No parent: a DISCOVERY on the search's Trickle timer, the offers
+      // it brings, or another sensor's, are in soon after
+      search_since = clock_time();
+      trickle_init(&search, SEARCH_IMIN, PARENT_SELECT_SEARCH_DOUBLINGS, PARENT_SELECT_SEARCH_REDUNDANCY, clock_time());
+#if DUTY_CYCLE
+      soliciting = 0;
+#endif
+      best = NULL;
+      while (best == NULL) {
+        etimer_set(&wait_for_parents, (int32_t)(trickle_next(&search) - clock_time()) > 0 ? trickle_next(&search) - clock_time() : 0);
+        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&wait_for_parents) || ev == PROCESS_EVENT_POLL);
+        etimer_stop(&wait_for_parents);
+        step = trickle_run(&search, clock_time());
+#if DUTY_CYCLE
+        // nodes with a parent only listen in their windows: ask right after
+        // a POLL, else all along a period until one answers
+        if (step & TRICKLE_SEND) {
+          heard_poll = 0;
+          soliciting = 1;
+        }
+        if (soliciting && heard_poll) {
+          send_pkt(OWN_TYPE, DISCOVERY_TYPE, 0, 0, BROADCAST);
+          soliciting = 0;
+          step |= TRICKLE_SEND;
+        } else if (soliciting && (step & TRICKLE_END)) {
+          static clock_time_t asked_for;
+          for (asked_for = 0; asked_for < PERIOD && parent_select_best(search_since, PARENT_SELECT_MAX_DEPTH) == NULL; asked_for += DISCOVERY_SPACING) {
+            send_pkt(OWN_TYPE, DISCOVERY_TYPE, 0, 0, BROADCAST);
+            etimer_set(&wait_for_parents, DISCOVERY_SPACING);
+            PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&wait_for_parents));
+          }
+          soliciting = 0;
+        } else {
+          step &= ~TRICKLE_SEND;
+        }
+#else
+        if (step & TRICKLE_SEND) {
+          send_pkt(OWN_TYPE, DISCOVERY_TYPE, 0, 0, BROADCAST);
+        }
+#endif
+        if (step & TRICKLE_SEND) {
+          etimer_set(&wait_for_parents, OFFERS_IN);
+          PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&wait_for_parents));
+        }
+        if (step != 0) {
+          best = parent_select_best(search_since, PARENT_SELECT_MAX_DEPTH);
+        }
+#if BORDER_SELECT_CHANNELS > 1
+        if (best == NULL && (step & TRICKLE_END)) {
+          // maybe on another border's channel
+          border_select_tune(border_select_next(border_select_tuned()));
+        }
+#endif
       }
-      etimer_reset(&wait_for_parents);
+      take_parent(best);
+#if DUTY_CYCLE
+      // in the window its offer came in
+      static clock_time_t offer_at;
+      offer_at = best->heard;
+      etimer_set(&wait_for_parents, (PERIOD - (clock_time() - offer_at) % PERIOD) % PERIOD);
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&wait_for_parents));
+#endif
+      send_pkt(OWN_TYPE, DISCOVERY_TYPE, 0, 0, &parent);
+      parent_ok = 1;
+      parent_last_update = clock_time();
+      last_round = clock_time();
+      rounds_started = 0;
+      next_check();
+      // Starts check for parent failure
+      process_poll(&check_for_parent);
     } else {
-      if (must_respond) {
-        if (clock_time() < (must_repond_before - child_interval)) {
-          // have the time
-          current_child = (current_child + 1) % number_of_children;
-          if (received_values == number_of_children) {
-            // get answer from all children => respond
-            LOG_INFO("SENSOR - All children have respond (count: %d)\n", total_count);
-            send_pkt(OWN_TYPE, MESSAGE_TYPE, total_count + get_sensor_count(), 0, &parent);
-            must_respond = 0;
-          } else {
-            if (current_child != starting_child) {
-              // Ask the next child for his count
-              LOG_INFO("SENSOR - Ask for next child %d\n", current_child);
-              send_pkt(OWN_TYPE, MESSAGE_TYPE, 0, child_interval, &children[current_child]);
-            }
+      if (collecting) {
+        // one child per interval, the first one was asked with the request
+        slot_timer_set(&slot_timer, clock_time() + child_interval);
+        PROCESS_WAIT_EVENT_UNTIL(slot_timer_expired(&slot_timer));
+        if (neighbor_table_count(&children) == 0 || received_values >= neighbor_table_count(&children)
+            || clock_time() + child_interval > must_repond_before) {
+          collecting = 0;
+        } else {
+          // round after round while time is left, only the ones that have
+          // not answered
+          do {
+            current_child = (current_child + 1) % neighbor_table_count(&children);
+          } while (answered[neighbor_table_index(&children, neighbor_table_get(&children, current_child))]);
+          // Ask the next child for his count
+          LOG_INFO("SENSOR - Ask for next child %d\n", current_child);
+          send_request(OWN_TYPE, child_interval, round, &neighbor_table_get(&children, current_child)->addr);
+        }
+      } else if (poll_pending) {
+        poll_pending = 0;
+        duty_cycle_hold(DUTY_CYCLE_ANSWER, 1);
+        // wait for its window
+        if (poll_start > 0) {
+          slot_timer_set(&slot_timer, clock_time() + poll_start);
+          PROCESS_WAIT_EVENT_UNTIL(slot_timer_expired(&slot_timer));
+          LOG_INFO("SENSOR - window starts %u us late, %u at most\n", slot_timer.late, slot_timer.max_late);
+        }
+        answer_parent();
+        if (neighbor_table_count(&children) > 0) {
+          // then POLL its own children in the rest of the window. A new child
+          // has no room yet: its answer gets it some next time. The POLL
+          // leaves after the answer, and late answers only wait for the next
+          // round: one more guard.
+          received_values = 0;
+          memset(answered, 0, sizeof(answered));
+          polling = 1;
+          if (net_config_due()) {
+            net_config_send(OWN_TYPE, clock_time(), 0, BROADCAST);
           }
-          // Wait for one subinterval
-          etimer_set(&wait_interval, child_interval);
-          PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&wait_interval));
-          etimer_reset(&wait_interval);
+          slot_timer_set(&slot_timer, clock_time() + send_poll(OWN_TYPE, &children, child_slots, NULL, poll_length - poll_micro, round) + 2*POLL_GUARD);
+#if MAC_CONF_WITH_TSCH
+          tsch_cells_children(TSCH_CELLS_SENSOR, TSCH_CELLS_FIRST(neighbor_table_count(&children)));
+#endif /* MAC_CONF_WITH_TSCH */
+          PROCESS_WAIT_EVENT_UNTIL(slot_timer_expired(&slot_timer) || received_values >= neighbor_table_count(&children));
+          slot_timer_stop(&slot_timer);
+          polling = 0;
+        }
+        duty_cycle_hold(DUTY_CYCLE_ANSWER, 0);
+      } else if (scheduled) {
+        // push in its window, unasked
+        while ((int32_t)(next_push - clock_time()) < 0) {
+          next_push += PERIOD; // missed it
+        }
+        slot_timer_set(&slot_timer, next_push);
+        // a POLL, a request or a new SCHEDULE comes first
+        PROCESS_WAIT_EVENT_UNTIL(slot_timer_expired(&slot_timer) || ev == PROCESS_EVENT_POLL);
+        if (slot_timer_expired(&slot_timer) && scheduled) {
+          LOG_INFO("SENSOR - window starts %u us late, %u at most\n", slot_timer.late, slot_timer.max_late);
+          switch_config();
+          pushed_at = clock_time();
+          next_push += PERIOD;
+          round++;
+          poll_pending = 1;
+          poll_start = 0;
+          poll_length = push_length;
+          poll_micro = push_micro;
         } else {
-          uint8_t c_count = get_sensor_count() + total_count;
-          LOG_INFO("SENSOR - sending %d to parent\n", c_count);
-          // Send to parent before it's too late
-          send_pkt(OWN_TYPE, MESSAGE_TYPE, c_count, 0, &parent);
-          must_respond = 0;
+          slot_timer_stop(&slot_timer);
         }
       } else {
         PROCESS_YIELD();
@@ -363,18 +847,61 @@ PROCESS_THREAD(nullnet_example_process, ev, data) {
 PROCESS_THREAD(check_for_parent, ev, data) {
   PROCESS_BEGIN();
   static struct etimer wait_interval;
+  static clock_time_t radio_on;
+  static const parent_candidate_t *best;
+#if DUTY_CYCLE
+  static clock_time_t offer_at;
+#endif
 
   while (1) {
     if (!parent_ok) {
       PROCESS_YIELD();
     } else {
       // TODO: check
-      if (clock_time() > (parent_last_update + (10*PERIOD))) {
-        dead_parent();
+      switch_config();
+#if DUTY_CYCLE
+      // a POLL comes every period, a SCHEDULE every SCHEDULE_REFRESH periods
+      // at least: none, our window no longer matches the parent's slot,
+      // listen for the next one
+      if (clock_time() > parent_last_update + (scheduled ? SCHEDULE_REFRESH + 1 : 2)*PERIOD) {
+        duty_cycle_hold(DUTY_CYCLE_SEARCH, 1);
       }
+#endif
       check_dead_children();
+      if (parent_lost || missed_rounds()) {
+        // straight to a backup, our children along, else a new search
+        LOG_INFO("SENSOR - parent lost, fails over\n");
+        parent_lost = 0;
+        best = backup_parent();
+        if (best == NULL) {
+          dead_parent(0);
+        }
+      } else {
+        best = check_parent();
+      }
+      if (best != NULL) {
+#if DUTY_CYCLE
+        offer_at = best->heard;
+#endif
+        change_parent(best);
+#if DUTY_CYCLE
+        // in the window its list came in
+        etimer_set(&wait_interval, (PERIOD - (clock_time() - offer_at) % PERIOD) % PERIOD);
+        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&wait_interval));
+#endif
+        if (parent_ok) {
+          send_pkt(OWN_TYPE, DISCOVERY_TYPE, 0, 0, &parent);
+          parent_last_update = clock_time();
+          last_round = clock_time();
+          rounds_started = 0;
+          next_check();
+        }
+      }
+      LOG_INFO("SENSOR - radio on %lu%% of the last period\n", (unsigned long)(100 * (duty_cycle_on_time() - radio_on) / PERIOD));
+      radio_on = duty_cycle_on_time();
       etimer_set(&wait_interval, PERIOD);
-      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&wait_interval));
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&wait_interval) || parent_lost);
+      etimer_stop(&wait_interval);
     }
   }
   PROCESS_END();
@@ -0,0 +1,306 @@
+import argparse
+import asyncio
+import json
+import signal
+import sys
+import time
+
+from server_test import LATENCY_BIN, Report, ReportDecoder
+from store import Store
+
+# Ingestion daemon: keeps a TCP connection to every border (Cooja's serial
+# socket, or anything serving the border's serial line), decodes their
+# streams as they come with non-blocking reads, and publishes every record
+# tagged with its border as one JSON line: one "report" per period, the
+# border's log lines in between ("log"), and "connect"/"disconnect" as the
+# connections come and go. A border that closes, cannot be reached or
+# stays silent longer than --idle is reconnected, waiting twice as long
+# after every failed attempt. Records go to stdout (or --output) and to
+# every client of --publish, and the reports to the store (store.py) of
+# --store. With --commands, the lines of stdin go to the serial line of the
+# borders: "name: line" to one of them, "line" to all, for instance
+# "north: config period=10000" (see project/common/net-config.h).
+#
+# With several borders sharing one area, each with coordinators of its own
+# (see project/common/border-select.h), their reports of a period also add
+# up to a "network" record: the period is over when a border reports
+# again, or when all of them have.
+
+RECONNECT_MIN = 1  # s
+RECONNECT_MAX = 30  # s
+READ_SIZE = 65536
+# Bytes waiting for a --publish client before it is dropped as too slow
+SUBSCRIBER_BUFFER = 1 << 20
+
+
+def report_record(report):
+    record = {
+        "type": "report",
+        "seq": report.seq,
+        "clock": report.clock,
+        "refused": report.refused,
+        "readings": report.readings,
+        "sum": report.total,
+        "min": report.min,
+        "max": report.max,
+        "mean": report.mean(),
+        "histogram": report.histogram,
+        "filled": report.filled,
+        "filled_age": report.filled_age,
+        "coverage": report.coverage(),
+        "coordinators": {
+            str(c): {"readings": n, "filled": report.coordinators_filled.get(c, 0),
+                     "sum": total, "sync_error": error,
+                     "cpu": energy.cpu, "lpm": energy.lpm, "tx": energy.tx, "rx": energy.rx,
+                     "current": energy.current, "peak_node": energy.peak_node,
+                     "peak_current": energy.peak_current}
+            for c, (n, total, error, energy) in report.coordinators.items()},
+    }
+    if any(report.traces.values()):
+        end_to_end, per_hop = report.latency()
+        record["traces"] = {str(c): t for c, t in report.traces.items()}
+        record["latency"] = {"bin_ms": LATENCY_BIN, "end_to_end": end_to_end, "per_hop": per_hop}
+    return record
+
+
+class Publisher:
+    def __init__(self, out, text, store):
+        self.out = out
+        self.text = text
+        self.store = store
+        self.subscribers = set()
+        # decoded from the borders, and the time spent decoding and
+        # publishing them
+        self.records = 0
+        self.busy = 0.0  # s
+
+    def publish(self, border, record):
+        record["border"] = border
+        record["time"] = round(time.time(), 3)
+        line = json.dumps(record, separators=(",", ":")) + "\n"
+        self.out.write(self.format(record) if self.text else line)
+        if self.subscribers:
+            data = line.encode()
+            for writer in list(self.subscribers):
+                if writer.transport.get_write_buffer_size() > SUBSCRIBER_BUFFER:
+                    self.subscribers.discard(writer)
+                    writer.close()
+                else:
+                    writer.write(data)
+
+    @staticmethod
+    def format(record):
+        # server_test.py's lines, prefixed with the border
+        kind = record["type"]
+        if kind == "report":
+            return "[%s] %s%s\n" % (record["border"],
+                                     "Lost %d period(s) " % record["lost"] if record["lost"] else "",
+                                     record["text"])
+        if kind == "network":
+            return "[%s] %s\n" % (record["border"], record["text"])
+        if kind == "log":
+            return "[%s] Log : %s\n" % (record["border"], record["line"])
+        return "[%s] %s %s\n" % (record["border"], kind, record.get("reason", ""))
+
+    async def subscribe(self, reader, writer):
+        self.subscribers.add(writer)
+        try:
+            # nothing is read from them, only their closing
+            while await reader.read(4096):
+                pass
+        except (OSError, asyncio.CancelledError):
+            # gone, or the daemon stopping
+            pass
+        self.subscribers.discard(writer)
+        writer.close()
+
+
+class Network:
+    def __init__(self, publisher, borders):
+        self.publisher = publisher
+        self.borders = borders
+        self.reports = {}  # border: Report, in the period under way
+
+    def add(self, border, report):
+        if border in self.reports:
+            self.flush()
+        self.reports[border] = report
+        if len(self.reports) == self.borders:
+            self.flush()
+
+    def flush(self):
+        reports = self.reports.values()
+        readings = sum(r.readings for r in reports)
+        filled = sum(r.filled for r in reports)
+        total = sum(r.total for r in reports)
+        counted = [r for r in reports if r.readings]
+        record = {
+            "type": "network",
+            "borders": sorted(self.reports),
+            "coordinators": sum(len(r.coordinators) for r in reports),
+            "readings": readings,
+            "coverage": (readings - filled) / readings if readings else 0,
+            "sum": total,
+            "min": min(r.min for r in counted) if counted else 0,
+            "max": max(r.max for r in counted) if counted else 0,
+            "mean": total / readings if readings else 0,
+        }
+        if self.publisher.text:
+            record["text"] = "%d borders, %d coordinators, %d readings, mean %.2f" % (
+                len(self.reports), record["coordinators"], readings, record["mean"])
+        self.reports = {}
+        self.publisher.publish("*", record)
+
+
+class Border:
+    def __init__(self, name, host, port, publisher, idle, network):
+        self.name = name
+        self.host = host
+        self.port = port
+        self.publisher = publisher
+        self.idle = idle
+        self.network = network  # None with a single border
+        self.last_seq = None  # kept across reconnections, to count the periods lost
+        self.last_clock = None  # the border's clock starts over from zero when it restarts
+        self.writer = None  # while connected
+
+    def send(self, line):
+        if self.writer is None:
+            return False
+        self.writer.write(line.encode() + b"\n")
+        return True
+
+    async def run(self):
+        delay = RECONNECT_MIN
+        while True:
+            try:
+                reader, writer = await asyncio.wait_for(
+                    asyncio.open_connection(self.host, self.port), self.idle)
+            except (OSError, asyncio.TimeoutError) as e:
+                self.publisher.publish(self.name, {"type": "disconnect", "reason": str(e) or "timeout"})
+                await asyncio.sleep(delay)
+                delay = min(2 * delay, RECONNECT_MAX)
+                continue
+            delay = RECONNECT_MIN
+            self.publisher.publish(self.name, {"type": "connect"})
+            self.writer = writer
+            reason = await self.receive(reader)
+            self.writer = None
+            writer.close()
+            self.publisher.publish(self.name, {"type": "disconnect", "reason": reason})
+            await asyncio.sleep(delay)
+
+    async def receive(self, reader):
+        # a frame cut by the disconnection is dropped with the decoder
+        decoder = ReportDecoder()
+        publisher = self.publisher
+        while True:
+            try:
+                data = await asyncio.wait_for(reader.read(READ_SIZE), self.idle)
+            except asyncio.TimeoutError:
+                return "idle for %g s" % self.idle
+            except OSError as e:
+                return str(e)
+            if not data:
+                return "closed"
+            start = time.perf_counter()
+            items = decoder.feed(data)
+            for item in items:
+                if isinstance(item, Report):
+                    record = report_record(item)
+                    # a clock going back is a border that restarted, its
+                    # sequence numbers only count the periods lost within a run
+                    restart = self.last_clock is not None and item.clock < self.last_clock
+                    lost = (item.seq - self.last_seq - 1) & 0xffff if self.last_seq is not None else 0
+                    record["lost"] = 0 if restart else lost
+                    record["restart"] = restart
+                    if publisher.text:
+                        record["text"] = str(item)
+                    self.last_seq = item.seq
+                    self.last_clock = item.clock
+                    publisher.publish(self.name, record)
+                    if publisher.store is not None:
+                        publisher.store.append(self.name, item, record["lost"], record["time"])
+                    if self.network is not None:
+                        self.network.add(self.name, item)
+                else:
+                    publisher.publish(self.name, {"type": "log", "line": item})
+            publisher.records += len(items)
+            publisher.busy += time.perf_counter() - start
+
+
+def parse_border(spec):
+    # [name=]host:port
+    name, _, address = spec.rpartition("=")
+    host, _, port = address.rpartition(":")
+    return (name or address), host, int(port)
+
+
+async def read_commands(borders):
+    loop = asyncio.get_running_loop()
+    reader = asyncio.StreamReader()
+    await loop.connect_read_pipe(lambda: asyncio.StreamReaderProtocol(reader), sys.stdin)
+    while True:
+        line = (await reader.readline()).decode()
+        if not line:
+            return
+        line = line.strip()
+        name, _, command = line.partition(":")
+        targets = [b for b in borders if b.name == name.strip()]
+        if not targets:
+            targets, command = borders, line
+        command = command.strip()
+        if not command:
+            continue
+        for border in targets:
+            if not border.send(command):
+                print("%s is not connected, dropped: %s" % (border.name, command), file=sys.stderr)
+
+
+async def print_stats(publisher, interval):
+    while True:
+        await asyncio.sleep(interval)
+        if publisher.records:
+            print("%d records, %.1f us each" % (publisher.records, 1e6 * publisher.busy / publisher.records),
+                  file=sys.stderr)
+
+
+async def main(args):
+    out = open(args.output, "a", buffering=1) if args.output else sys.stdout
+    store = Store(args.store, writable=True) if args.store else None
+    publisher = Publisher(out, args.text, store)
+    network = Network(publisher, len(args.border)) if len(args.border) > 1 else None
+    borders = [Border(*parse_border(b), publisher, args.idle, network) for b in args.border]
+    tasks = [asyncio.ensure_future(b.run()) for b in borders]
+    if args.commands:
+        tasks.append(asyncio.ensure_future(read_commands(borders)))
+    if args.publish:
+        await asyncio.start_server(publisher.subscribe, port=args.publish)
+    if args.stats:
+        tasks.append(asyncio.ensure_future(print_stats(publisher, args.stats)))
+    stop = asyncio.Event()
+    for sig in (signal.SIGINT, signal.SIGTERM):
+        asyncio.get_running_loop().add_signal_handler(sig, stop.set)
+    await stop.wait()
+    for task in tasks:
+        task.cancel()
+    if store is not None:
+        store.close()
+    if publisher.records:
+        print("%d records, %.1f us each" % (publisher.records, 1e6 * publisher.busy / publisher.records),
+              file=sys.stderr)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Collects the reports of several borders")
+    parser.add_argument("border", nargs="+", help="[name=]host:port of a border's serial socket")
+    parser.add_argument("--output", help="append the records to this file instead of stdout")
+    parser.add_argument("--text", action="store_true", help="write server_test.py's lines instead of JSON")
+    parser.add_argument("--store", help="also append the reports to the store in this directory")
+    parser.add_argument("--publish", type=int, help="also stream the JSON records to the clients of this port")
+    parser.add_argument("--commands", action="store_true",
+                        help="send the lines of stdin to the borders (\"name: line\" to one of them)")
+    parser.add_argument("--idle", type=float, default=30, help="reconnect after this many silent seconds")
+    parser.add_argument("--stats", type=float, default=0,
+                        help="print the records and the time spent per record every this many seconds")
+    asyncio.run(main(parser.parse_args()))
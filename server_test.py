@@ -1,28 +1,243 @@
 import socket
 import argparse
+import binascii
+import functools
+import struct
 import sys
-import time
 
-def recv(sock):
-    data = sock.recv(1)
-    buf = b""
-    while data.decode("utf-8") != "\n":
-        buf += data
-        data = sock.recv(1)
-    return buf
+# Report frame written by the border once per period (see border.c),
+# multi-byte fields little endian:
+#   magic (2) | version | n | buckets | trace hops | seq (2) |
+#   network clock (4) | joins refused (2) |
+#   aggregate: sum (4), readings (2), min (2), max (2), stand-ins (2),
+#              their age (1), buckets x (2), trace |
+#   n x (coordinator id (2), readings (2), stand-ins (2), sum (4),
+#        sync error (1),
+#        cpu, lpm, tx, rx in 1/10000 of the period (2 each),
+#        peak node (2), peak current in uA (2), current in uA (2),
+#        trace) | crc (2)
+# Stand-ins are readings among the others: the last answer of a sensor whose
+# answer was lost, at most "age" periods old. The peak is the node of the coordinator's subtree drawing the most. A
+# trace, only there if trace hops is not 0, follows the oldest reading:
+# hops (1), then trace hops x (ms the node held it (2)), from the sensor
+# that took it to the border.
+REPORT_MAGIC = b"\xa5\x5a"
+REPORT_VERSION = 7
+REPORT_HEADER = struct.Struct("<2sBBBBHIH")
+REPORT_AGGREGATE = struct.Struct("<IHHHHB")
+REPORT_ENTRY = struct.Struct("<HHHIBHHHHHHH")
+
+# Latency histograms of each period, in bins of LATENCY_BIN ms, the last
+# one taking everything above
+LATENCY_BIN = 1000
+LATENCY_BINS = 8
+
+
+def trace_len(hops):
+    return 1 + 2 * hops if hops else 0
+
+
+@functools.lru_cache()
+def entry_struct(hops):
+    # An entry with its trace, if any
+    return struct.Struct(REPORT_ENTRY.format + ("B%dH" % hops if hops else ""))
+
+
+def latency_histogram(values):
+    histogram = [0] * LATENCY_BINS
+    last = LATENCY_BINS - 1
+    for v in values:
+        i = v // LATENCY_BIN
+        histogram[i if i < last else last] += 1
+    return histogram
+
+
+# Bytes with their bits in reverse order
+REVERSED = bytes(int("{:08b}".format(b)[::-1], 2) for b in range(256))
+
+
+def reverse16(value):
+    return REVERSED[value & 0xff] << 8 | REVERSED[value >> 8]
+
+
+def crc16(data, acc=0):
+    # Contiki's lib/crc16.c is CRC-CCITT with the bits of every byte in
+    # reverse order (CRC-16/KERMIT), computed here by binascii's
+    return reverse16(binascii.crc_hqx(bytes(data).translate(REVERSED), reverse16(acc)))
+
+
+class Energy:
+    def __init__(self, cpu, lpm, tx, rx, peak_node, peak_current, current):
+        # shares of the period, in 1/10000
+        self.cpu = cpu
+        self.lpm = lpm
+        self.tx = tx
+        self.rx = rx
+        self.peak_node = peak_node
+        self.peak_current = peak_current  # uA
+        self.current = current  # uA
+
+    def __str__(self):
+        return "cpu %.1f%% tx %.2f%% rx %.1f%% %duA, peak %d %duA" % (
+            self.cpu / 100, self.tx / 100, self.rx / 100, self.current,
+            self.peak_node, self.peak_current)
+
+
+class Report:
+    def __init__(self, seq, clock, total, readings, minimum, maximum, histogram, coordinators, traces,
+                 filled=0, filled_age=0, coordinators_filled=None, refused=0):
+        self.seq = seq
+        self.clock = clock
+        # coordinators turned away since the last report, the border full
+        self.refused = refused
+        self.total = total  # sum of the readings
+        self.readings = readings
+        self.min = minimum
+        self.max = maximum
+        self.histogram = histogram
+        # readings that stand in for lost answers, and how old the oldest is
+        self.filled = filled
+        self.filled_age = filled_age
+        # {coordinator id: (readings, sum, sync error, Energy)}
+        self.coordinators = coordinators
+        # {coordinator id: stand-ins among its readings}
+        self.coordinators_filled = coordinators_filled or {}
+        # {coordinator id: [ms held by each node]} of its oldest reading
+        self.traces = traces
+
+    def mean(self):
+        return self.total / self.readings if self.readings else 0
+
+    def coverage(self):
+        # share of the readings that are fresh
+        return (self.readings - self.filled) / self.readings if self.readings else 0
+
+    def latency(self):
+        # end-to-end histogram, then one per hop from the sensors
+        paths = [t for t in self.traces.values() if t]
+        hops = max((len(t) for t in paths), default=0)
+        return (latency_histogram(sum(t) for t in paths),
+                [latency_histogram(t[i] for t in paths if i < len(t)) for i in range(hops)])
+
+    def __str__(self):
+        if not self.readings:
+            return "#%d clock %d no readings" % (self.seq, self.clock)
+        per_coord = " ".join("%d:%d/%d~%d %s" % (c, n, t, e, energy) for c, (n, t, e, energy) in self.coordinators.items())
+        line = "#%d clock %d total %d readings %d min %d max %d mean %.2f histogram %s [%s]" % (
+            self.seq, self.clock, self.total, self.readings, self.min, self.max,
+            self.mean(), self.histogram, per_coord)
+        if self.filled:
+            line += " coverage %.3f (%d stand-ins, %d periods old at most)" % (
+                self.coverage(), self.filled, self.filled_age)
+        if self.refused:
+            line += " refused %d" % self.refused
+        if any(self.traces.values()):
+            end_to_end, per_hop = self.latency()
+            line += " latency/%dms %s hops %s" % (LATENCY_BIN, end_to_end, " ".join(str(h) for h in per_hop))
+        return line
+
+
+class ReportDecoder:
+    """Streaming decoder, bytes in, reports and log lines out.
+
+    Bytes that do not start a valid frame are the border's log output, they
+    are returned as text lines.
+    """
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.text = bytearray()
+
+    def frame_len(self, start):
+        # Length of the frame at start in buf, 0 if incomplete, -1 if none
+        buf = self.buf
+        available = len(buf) - start
+        if available < 1:
+            return 0
+        if buf[start] != REPORT_MAGIC[0]:
+            return -1
+        if available < REPORT_HEADER.size:
+            return 0
+        if buf[start + 1] != REPORT_MAGIC[1] or buf[start + 2] != REPORT_VERSION:
+            return -1
+        trace = trace_len(buf[start + 5])
+        length = (REPORT_HEADER.size + REPORT_AGGREGATE.size + 2 * buf[start + 4] + trace
+                  + buf[start + 3] * (REPORT_ENTRY.size + trace) + 2)
+        if available < length:
+            return 0
+        (crc,) = struct.unpack_from("<H", buf, start + length - 2)
+        if crc16(memoryview(buf)[start + 2:start + length - 2]) != crc:
+            return -1
+        return length
+
+    def lines(self, data, out):
+        # Log text, complete lines go out
+        lines = data.split(b"\n")
+        self.text += lines[0]
+        for line in lines[1:]:
+            out.append(self.text.decode("utf-8", "replace"))
+            self.text = bytearray(line)
+
+    def report(self, pos):
+        _, _, n, buckets, hops, seq, clock, refused = REPORT_HEADER.unpack_from(self.buf, pos)
+        pos += REPORT_HEADER.size
+        total, readings, minimum, maximum, filled, filled_age = REPORT_AGGREGATE.unpack_from(self.buf, pos)
+        pos += REPORT_AGGREGATE.size
+        histogram = list(struct.unpack_from("<%dH" % buckets, self.buf, pos))
+        pos += 2 * buckets + trace_len(hops)
+        coordinators = {}
+        traces = {}
+        coordinators_filled = {}
+        entry = entry_struct(hops)
+        for fields in entry.iter_unpack(memoryview(self.buf)[pos:pos + n * entry.size]):
+            coord, coord_readings, coord_filled, coord_sum, coord_error = fields[:5]
+            coordinators[coord] = (coord_readings, coord_sum, coord_error, Energy(*fields[5:12]))
+            coordinators_filled[coord] = coord_filled
+            if hops:
+                traces[coord] = list(fields[13:13 + min(fields[12], hops)])
+        return Report(seq, clock, total, readings, minimum, maximum, histogram, coordinators, traces,
+                      filled, filled_age, coordinators_filled, refused)
+
+    def feed(self, data):
+        self.buf += data
+        out = []
+        start = 0
+        while True:
+            length = self.frame_len(start)
+            if length == 0:
+                break
+            if length < 0:
+                # text up to the next byte that can start a frame
+                end = self.buf.find(REPORT_MAGIC[:1], start + 1)
+                if end < 0:
+                    end = len(self.buf)
+                self.lines(self.buf[start:end], out)
+                start = end
+                continue
+            out.append(self.report(start))
+            start += length
+        del self.buf[:start]
+        return out
+
 
 def main(ip, port):
     sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
     sock.connect((ip, port))
 
-    while True: 
-        sock.send(b"ln0=0")
-        data = recv(sock)
-        try:
-            print(int(data.decode("utf-8")))
-        except:
-            print("Non numerical log : ", data.decode("utf-8"))        
-        time.sleep(1)
+    decoder = ReportDecoder()
+    last_seq = None
+    while True:
+        data = sock.recv(4096)
+        if not data:
+            break
+        for item in decoder.feed(data):
+            if isinstance(item, Report):
+                if last_seq is not None and item.seq != (last_seq + 1) & 0xffff:
+                    print("Lost %d period(s)" % ((item.seq - last_seq - 1) & 0xffff))
+                last_seq = item.seq
+                print(item)
+            else:
+                print("Log : ", item)
 
 
 if __name__ == "__main__":
@@ -33,4 +248,3 @@ if __name__ == "__main__":
     args = parser.parse_args()
 
     main(args.ip, args.port)
-
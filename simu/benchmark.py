@@ -0,0 +1,171 @@
+import argparse
+import concurrent.futures
+import csv
+import hashlib
+import itertools
+import os
+import subprocess
+import sys
+import tempfile
+
+from generate_csc import Topology
+
+# Headless benchmark: generates the simulation of every combination of the
+# topology parameters (generate_csc.py) and seed, runs it with hostsim
+# (the firmware compiled natively, see README.md) and writes one row per
+# run, and optionally one per period, to CSV. Given the rows of an earlier
+# run, for instance on the commit before a protocol change, it also prints
+# how every topology changed.
+#
+# hostsim is built for the benchmark in hostsim/build-bench, with traces
+# long enough for the deepest topology (AGGREGATE_CONF_TRACE_HOPS), from
+# which the round completion time comes: how old the oldest reading of the
+# round was when the border reported it.
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+HOSTSIM = os.path.join(ROOT, "hostsim")
+
+PARAMETERS = ["coordinators", "sensors", "depth", "density", "loss"]
+RESULTS = ["formation_s", "delivery", "complete_rounds", "round_ms", "round_max_ms",
+           "frames", "frames_per_period"]
+
+
+def build(trace_hops, cflags):
+    flags = "-O2 -g -DAGGREGATE_CONF_TRACE_HOPS=%d %s" % (trace_hops, cflags)
+    # make does not rebuild when only the flags change: one build per flags
+    name = hashlib.sha1(flags.encode()).hexdigest()[:10]
+    build_dir = os.path.join(HOSTSIM, "build-bench", name)
+    subprocess.run(["make", "-s", "-C", HOSTSIM, "BUILD=" + build_dir, "CFLAGS=" + flags],
+                   check=True)
+    return os.path.join(build_dir, "hostsim")
+
+
+def run(hostsim, config, seed, args):
+    topology = Topology(config["coordinators"], config["sensors"], config["depth"],
+                        config["density"], config["loss"], args.range, seed)
+    with tempfile.TemporaryDirectory() as tmp:
+        csc = os.path.join(tmp, "simulation.csc")
+        reports = os.path.join(tmp, "reports.csv")
+        with open(csc, "w") as f:
+            f.write(topology.csc(args.duration))
+        subprocess.run([hostsim, "--csc", csc, "--seed", str(seed), "-t", str(args.duration),
+                        "--warmup", str(args.warmup), "--csv", reports],
+                       check=True, stdout=subprocess.DEVNULL)
+        with open(reports) as f:
+            periods = list(csv.DictReader(f))
+    return summarize(periods, args), periods
+
+
+def summarize(periods, args):
+    result = dict.fromkeys(RESULTS, "")
+    # time to formation: the first period the border got enough of the
+    # readings
+    for p in periods:
+        if float(p["delivery_ratio"]) >= args.formation:
+            result["formation_s"] = "%.1f" % float(p["time_s"])
+            break
+    steady = [p for p in periods if float(p["time_s"]) >= args.warmup]
+    if periods:
+        result["frames"] = periods[-1]["frames_sent"]
+    if not steady:
+        return result
+    ratios = [float(p["delivery_ratio"]) for p in steady]
+    result["delivery"] = "%.4f" % (sum(ratios) / len(ratios))
+    result["complete_rounds"] = "%.4f" % (sum(1 for r in ratios if r >= 1.0) / len(ratios))
+    rounds = [int(p["oldest_reading_ms"]) for p in steady if int(p["oldest_reading_ms"]) > 0]
+    if rounds:
+        result["round_ms"] = "%.0f" % (sum(rounds) / len(rounds))
+        result["round_max_ms"] = "%d" % max(rounds)
+    if len(steady) > 1:
+        frames = int(steady[-1]["frames_sent"]) - int(steady[0]["frames_sent"])
+        result["frames_per_period"] = "%.1f" % (frames / (len(steady) - 1))
+    return result
+
+
+def values(text, kind):
+    return [kind(v) for v in text.split(",")]
+
+
+def key(row):
+    return tuple(float(row[p]) for p in PARAMETERS) + (int(row["seed"]),)
+
+
+def compare(rows, baseline_file):
+    with open(baseline_file) as f:
+        baseline = {key(row): row for row in csv.DictReader(f)}
+    print("%-42s %-26s %-22s %-24s %-22s" % ("topology (seed)", "delivery", "formation s",
+                                           "round ms", "frames/period"))
+    for row in rows:
+        base = baseline.get(key(row))
+        if base is None:
+            continue
+        name = "%sx%s depth %s density %s loss %s (%s)" % tuple(
+            row[p] for p in PARAMETERS + ["seed"])
+        cells = []
+        for field in ["delivery", "formation_s", "round_ms", "frames_per_period"]:
+            if row[field] == "" or base[field] == "":
+                cells.append("%s -> %s" % (base[field] or "-", row[field] or "-"))
+            else:
+                cells.append("%s -> %s (%+.4g)" % (base[field], row[field],
+                                                   float(row[field]) - float(base[field])))
+        print("%-42s %-26s %-22s %-24s %-22s" % tuple([name] + cells))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Runs the project over generated topologies")
+    parser.add_argument("-c", "--coordinators", default="4", help="comma separated values")
+    parser.add_argument("-s", "--sensors", default="4", help="sensors per coordinator")
+    parser.add_argument("--depth", default="1", help="levels of sensors under a coordinator")
+    parser.add_argument("--density", default="6", help="sensors of the first level in range of each other")
+    parser.add_argument("--loss", default="0", help="share of transmissions lost")
+    parser.add_argument("--seeds", default="1", help="seeds of the topology and of hostsim")
+    parser.add_argument("--range", type=float, default=50.0, help="transmission range")
+    parser.add_argument("-t", "--duration", type=int, default=300, help="simulated seconds")
+    parser.add_argument("--warmup", type=int, default=60, help="seconds before the steady state")
+    parser.add_argument("--formation", type=float, default=0.9,
+                        help="delivery ratio the network is formed at")
+    parser.add_argument("--cflags", default="", help="firmware flags, e.g. -DPROTOCOL_CONF_PUSH=0")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count())
+    parser.add_argument("-o", "--output", default="benchmark.csv", help="one row per run")
+    parser.add_argument("--periods", help="also write one row per period of every run")
+    parser.add_argument("--baseline", help="results of an earlier run to compare with")
+    args = parser.parse_args()
+
+    grid = [dict(zip(PARAMETERS, combination)) for combination in itertools.product(
+        values(args.coordinators, int), values(args.sensors, int), values(args.depth, int),
+        values(args.density, float), values(args.loss, float))]
+    seeds = values(args.seeds, int)
+    # the sensors, their coordinator and the border hold a reading
+    hostsim = build(max(c["depth"] for c in grid) + 2, args.cflags)
+
+    runs = [(config, seed) for config in grid for seed in seeds]
+    with concurrent.futures.ThreadPoolExecutor(args.jobs) as pool:
+        results = list(pool.map(lambda r: run(hostsim, r[0], r[1], args), runs))
+
+    rows = []
+    with open(args.output, "w", newline="") as f:
+        writer = csv.DictWriter(f, PARAMETERS + ["seed"] + RESULTS)
+        writer.writeheader()
+        for (config, seed), (result, _) in zip(runs, results):
+            row = dict(config, seed=seed, **result)
+            writer.writerow(row)
+            rows.append({k: str(v) for k, v in row.items()})
+    if args.periods:
+        with open(args.periods, "w", newline="") as f:
+            writer = csv.writer(f)
+            writer.writerow(PARAMETERS + ["seed", "time_s", "seq", "delivery_ratio", "frames",
+                                          "oldest_reading_ms"])
+            for (config, seed), (_, periods) in zip(runs, results):
+                frames = 0
+                for p in periods:
+                    writer.writerow([config[k] for k in PARAMETERS] + [
+                        seed, p["time_s"], p["seq"], p["delivery_ratio"],
+                        int(p["frames_sent"]) - frames, p["oldest_reading_ms"]])
+                    frames = int(p["frames_sent"])
+    print("%d runs written to %s" % (len(runs), args.output), file=sys.stderr)
+    if args.baseline:
+        compare(rows, args.baseline)
+
+
+if __name__ == "__main__":
+    main()
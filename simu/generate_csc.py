@@ -0,0 +1,249 @@
+import argparse
+import math
+import random
+import sys
+
+# Cooja simulation generator: a border, N coordinators around it and M
+# sensors per coordinator, on a UDGM radio medium. The sensors of a
+# coordinator are spread over `depth` levels: the first level is in range
+# of the coordinator, and every sensor of the next levels is placed in
+# range of a sensor of the level above but out of range of the coordinator
+# and of the levels further up, so that it has to join through a sensor.
+# `density` is the number of sensors of the first level in range of each
+# other (on average, it sets how far from the coordinator they are spread)
+# and `loss` the share of transmissions UDGM drops.
+#
+# The motes use the firmwares of the three examples, as the simulations
+# next to this script. The simulation runs headless too (cooja --no-gui),
+# until the script of the ScriptRunner plugin ends it after `duration`
+# seconds, with the serial output of every mote in COOJA.testlog; the
+# border's serial line is also served on `port` for server_test.py.
+#
+# With several `borders`, they stand on a small circle in the middle and
+# the coordinators stay in range of all of them; the serial line of the
+# k-th border is served on `port` + k, for server.py.
+#
+# With several `rings`, the coordinators are spread over them: the first
+# ring is in range of the borders, every coordinator of the next rings is
+# placed outwards of one of the ring inside, in its range, so that it
+# reaches the border through the coordinators of the rings inside.
+
+FIRMWARES = [
+    ("border", "my_border", "border"),
+    ("coord", "my_coordinator", "coordinator"),
+    ("sensor", "my_sensor", "sensor"),
+]
+
+MOTE_INTERFACES = [
+    "org.contikios.cooja.interfaces.Position",
+    "org.contikios.cooja.interfaces.RimeAddress",
+    "org.contikios.cooja.interfaces.IPAddress",
+    "org.contikios.cooja.interfaces.Mote2MoteRelations",
+    "org.contikios.cooja.interfaces.MoteAttributes",
+    "org.contikios.cooja.mspmote.interfaces.MspClock",
+    "org.contikios.cooja.mspmote.interfaces.MspMoteID",
+    "org.contikios.cooja.mspmote.interfaces.MspButton",
+    "org.contikios.cooja.mspmote.interfaces.Msp802154Radio",
+    "org.contikios.cooja.mspmote.interfaces.MspDefaultSerial",
+    "org.contikios.cooja.mspmote.interfaces.MspLED",
+    "org.contikios.cooja.mspmote.interfaces.MspDebugOutput",
+]
+
+# How far a sensor is from the sensor it joins through, in ranges
+HOP_MIN = 0.5
+HOP_MAX = 0.9
+# Placements tried for a sensor of a deeper level before taking the one
+# in range of the fewest motes it should not hear
+PLACEMENT_TRIES = 200
+
+
+class Topology:
+    def __init__(self, coordinators, sensors, depth=1, density=6.0,
+                 loss=0.0, tx_range=50.0, seed=1, borders=1, rings=1):
+        self.borders = max(1, borders)
+        self.rings = max(1, min(rings, coordinators)) if coordinators else 1
+        self.coordinators = coordinators
+        self.sensors = sensors
+        self.depth = max(1, min(depth, sensors)) if sensors else 1
+        self.density = density
+        self.loss = loss
+        self.tx_range = tx_range
+        self.seed = seed
+        # (firmware, id, x, y, level), level 0 for the border and the
+        # coordinators
+        self.motes = []
+        self._place(random.Random(seed))
+
+    def _add(self, firmware, x, y, level):
+        self.motes.append((firmware, len(self.motes) + 1, x, y, level))
+        return self.motes[-1]
+
+    def _place(self, rng):
+        r = self.tx_range
+        spread = r / 5 if self.borders > 1 else 0.0
+        for b in range(self.borders):
+            a = 2 * math.pi * b / self.borders
+            self._add("border", spread * math.cos(a), spread * math.sin(a), 0)
+        # The first ring evenly around the borders, in range of all of them,
+        # the next ones outwards of a coordinator of the ring inside
+        per_ring = [self.coordinators // self.rings + (1 if k < self.coordinators % self.rings else 0)
+                    for k in range(self.rings)]
+        coordinators = []
+        rings = []
+        for k, n in enumerate(per_ring):
+            ring = []
+            for c in range(n):
+                if k == 0:
+                    a = 2 * math.pi * (c + rng.uniform(-0.25, 0.25)) / n
+                    d = (r - spread) * rng.uniform(0.6, 0.9)
+                    x, y = d * math.cos(a), d * math.sin(a)
+                else:
+                    ix, iy = rings[k - 1][c % len(rings[k - 1])]
+                    d = r * rng.uniform(HOP_MIN, HOP_MAX)
+                    a = math.atan2(iy, ix) + rng.uniform(-math.pi / 6, math.pi / 6)
+                    x, y = ix + d * math.cos(a), iy + d * math.sin(a)
+                ring.append((x, y))
+                coordinators.append(self._add("coord", x, y, 0))
+            rings.append(ring)
+        per_level = [self.sensors // self.depth + (1 if k < self.sensors % self.depth else 0)
+                     for k in range(self.depth)]
+        # Level 1 within the disk in which per_level[0] sensors have
+        # `density` neighbors, but in range of the coordinator
+        first = min(0.9 * r, r * math.sqrt(per_level[0] / max(self.density, 1e-3)))
+        for _, _, cx, cy, _ in coordinators:
+            # outwards from the border, where the deeper levels go
+            outwards = math.atan2(cy, cx)
+            levels = [[(cx, cy)]]
+            for k, n in enumerate(per_level):
+                level = []
+                for i in range(n):
+                    if k == 0:
+                        d = first * math.sqrt(rng.random())
+                        a = 2 * math.pi * rng.random()
+                        x, y = cx + d * math.cos(a), cy + d * math.sin(a)
+                    else:
+                        x, y = self._deeper(rng, levels, levels[k][i % len(levels[k])],
+                                            outwards)
+                    level.append((x, y))
+                    self._add("sensor", x, y, k + 1)
+                levels.append(level)
+
+    def _deeper(self, rng, levels, parent, outwards):
+        # In range of parent, out of range of the levels above it
+        r = self.tx_range
+        far = [p for level in levels[:-1] for p in level]
+        best, best_heard = None, None
+        for _ in range(PLACEMENT_TRIES):
+            d = r * rng.uniform(HOP_MIN, HOP_MAX)
+            a = outwards + rng.uniform(-math.pi / 3, math.pi / 3)
+            x, y = parent[0] + d * math.cos(a), parent[1] + d * math.sin(a)
+            heard = sum(1 for p in far if math.hypot(x - p[0], y - p[1]) < r)
+            if best is None or heard < best_heard:
+                best, best_heard = (x, y), heard
+            if heard == 0:
+                break
+        return best
+
+    def csc(self, duration=300, port=60001):
+        out = []
+        out.append('<?xml version="1.0" encoding="UTF-8"?>')
+        out.append('<simconf version="2022112801">')
+        out.append("  <simulation>")
+        out.append("    <title>%s%d coordinators%s x %d sensors, depth %d, density %g, loss %g</title>"
+                   % ("%d borders, " % self.borders if self.borders > 1 else "",
+                      self.coordinators, " on %d rings" % self.rings if self.rings > 1 else "",
+                      self.sensors, self.depth, self.density, self.loss))
+        out.append("    <speedlimit>20.0</speedlimit>")
+        out.append("    <randomseed>%d</randomseed>" % self.seed)
+        out.append("    <motedelay_us>1000000</motedelay_us>")
+        out.append("    <radiomedium>")
+        out.append("      org.contikios.cooja.radiomediums.UDGM")
+        out.append("      <transmitting_range>%.1f</transmitting_range>" % self.tx_range)
+        out.append("      <interference_range>%.1f</interference_range>" % (2 * self.tx_range))
+        out.append("      <success_ratio_tx>%g</success_ratio_tx>" % (1.0 - self.loss))
+        out.append("      <success_ratio_rx>1.0</success_ratio_rx>")
+        out.append("    </radiomedium>")
+        out.append("    <events>")
+        out.append("      <logoutput>40000</logoutput>")
+        out.append("    </events>")
+        for description, example, name in FIRMWARES:
+            out.append("    <motetype>")
+            out.append("      org.contikios.cooja.mspmote.Z1MoteType")
+            out.append("      <description>%s</description>" % description)
+            out.append("      <source>[CONFIG_DIR]/examples/%s/%s.c</source>" % (example, name))
+            out.append("      <commands>make -j$(CPUS) %s.z1 TARGET=z1</commands>" % name)
+            out.append("      <firmware>[CONFIG_DIR]/examples/%s/build/z1/%s.z1</firmware>"
+                       % (example, name))
+            for interface in MOTE_INTERFACES:
+                out.append("      <moteinterface>%s</moteinterface>" % interface)
+            for firmware, mote_id, x, y, _ in self.motes:
+                if firmware != description:
+                    continue
+                out.append("      <mote>")
+                out.append("        <interface_config>")
+                out.append("          org.contikios.cooja.interfaces.Position")
+                out.append('          <pos x="%.3f" y="%.3f" />' % (x, y))
+                out.append("        </interface_config>")
+                out.append("        <interface_config>")
+                out.append("          org.contikios.cooja.mspmote.interfaces.MspMoteID")
+                out.append("          <id>%d</id>" % mote_id)
+                out.append("        </interface_config>")
+                out.append("      </mote>")
+            out.append("    </motetype>")
+        out.append("  </simulation>")
+        out.append("  <plugin>")
+        out.append("    org.contikios.cooja.plugins.ScriptRunner")
+        out.append("    <plugin_config>")
+        out.append("      <script>TIMEOUT(%d, log.testOK());" % (duration * 1000))
+        out.append("while (true) {")
+        out.append('  log.log(time + " ID:" + id + " " + msg + "\\n");')
+        out.append("  YIELD();")
+        out.append("}</script>")
+        out.append("      <active>true</active>")
+        out.append("    </plugin_config>")
+        out.append("  </plugin>")
+        # the borders are the first motes of the simulation
+        for b in range(self.borders):
+            out.append("  <plugin>")
+            out.append("    org.contikios.cooja.serialsocket.SerialSocketServer")
+            out.append("    <mote_arg>%d</mote_arg>" % b)
+            out.append("    <plugin_config>")
+            out.append("      <port>%d</port>" % (port + b))
+            out.append("      <bound>true</bound>")
+            out.append("    </plugin_config>")
+            out.append("  </plugin>")
+        out.append("</simconf>")
+        return "\n".join(out) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generates a Cooja simulation of the project")
+    parser.add_argument("-b", "--borders", type=int, default=1)
+    parser.add_argument("-c", "--coordinators", type=int, default=4)
+    parser.add_argument("-s", "--sensors", type=int, default=4, help="sensors per coordinator")
+    parser.add_argument("--rings", type=int, default=1,
+                        help="rings of coordinators, only the first in range of the borders")
+    parser.add_argument("--depth", type=int, default=1, help="levels of sensors under a coordinator")
+    parser.add_argument("--density", type=float, default=6.0,
+                        help="sensors of the first level in range of each other")
+    parser.add_argument("--loss", type=float, default=0.0, help="share of transmissions lost")
+    parser.add_argument("--range", type=float, default=50.0, dest="tx_range")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("-t", "--duration", type=int, default=300, help="simulated seconds")
+    parser.add_argument("--port", type=int, default=60001,
+                        help="serial socket of the border, the next ones for the others")
+    parser.add_argument("-o", "--output", help="file to write, stdout by default")
+    args = parser.parse_args()
+
+    topology = Topology(args.coordinators, args.sensors, args.depth, args.density,
+                        args.loss, args.tx_range, args.seed, args.borders, args.rings)
+    csc = topology.csc(args.duration, args.port)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(csc)
+    else:
+        sys.stdout.write(csc)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,330 @@
+import argparse
+import array
+import bisect
+import datetime
+import mmap
+import os
+import sys
+import time
+
+# Append-only time series of the border reports, for server.py --store.
+#
+# A directory per border holds a table of its periods and one per
+# coordinator it reported. A table is a directory with one file per column,
+# fixed-size values one after the other (a column of a row is at row x its
+# size), and a `rows` file with the number of complete rows: values are
+# written first, the count last, so a reader (or a restart after a crash)
+# never sees a row half written. Columns grow by COLUMN_CHUNK rows and are
+# memory-mapped, by the writer to append and by the readers to scan, so a
+# query only touches the pages of the rows it reads.
+#
+# Rows are in time order (a clock going back is clamped to the last row),
+# so a time range is two binary searches on the time column, and rollups
+# sum whole slices of a column at once.
+
+COLUMN_CHUNK = 1 << 16  # rows
+
+# (name, array typecode)
+PERIOD_COLUMNS = [
+    ("time", "d"),  # unix time the report was received
+    ("seq", "H"),
+    ("clock", "I"),  # network clock, in ticks
+    ("readings", "H"),
+    ("sum", "I"),
+    ("min", "H"),
+    ("max", "H"),
+    ("lost", "H"),  # periods missing before this one
+    ("coordinators", "B"),
+    ("filled", "H"),  # readings that stand in for lost answers
+]
+COORDINATOR_COLUMNS = [
+    ("time", "d"),
+    ("readings", "H"),
+    ("sum", "I"),
+    ("sync_error", "B"),
+    ("cpu", "H"),  # shares of the period, in 1/10000
+    ("lpm", "H"),
+    ("tx", "H"),
+    ("rx", "H"),
+    ("current", "H"),  # uA
+    ("peak_node", "H"),
+    ("peak_current", "H"),
+    ("latency", "I"),  # ms from its oldest reading to the border, 0 without trace
+    ("filled", "H"),
+]
+
+PERIODS = "periods"
+COORDINATOR = "coordinator-%d"
+
+ROLLUPS = {"minute": 60, "hour": 3600, "day": 86400}
+
+
+class Column:
+    def __init__(self, path, typecode, writable):
+        self.path = path
+        self.typecode = typecode
+        self.size = array.array(typecode).itemsize
+        self.writable = writable
+        self.file = None
+        self.map = None
+        self.capacity = 0  # rows mapped
+        self.view = None
+        self.remap()
+
+    def remap(self, rows=0):
+        # Maps at least rows rows, growing the file if writable
+        self.close()
+        mode = "a+b" if self.writable else "rb"
+        self.file = open(self.path, mode)
+        length = os.fstat(self.file.fileno()).st_size
+        if self.writable and length < rows * self.size:
+            length = -(-rows // COLUMN_CHUNK) * COLUMN_CHUNK * self.size
+            self.file.truncate(length)
+        self.capacity = length // self.size
+        if self.capacity:
+            access = mmap.ACCESS_WRITE if self.writable else mmap.ACCESS_READ
+            self.map = mmap.mmap(self.file.fileno(), self.capacity * self.size, access=access)
+            self.view = memoryview(self.map).cast(self.typecode)
+
+    def put(self, row, value):
+        if row >= self.capacity:
+            self.remap(row + 1)
+        self.view[row] = value
+
+    def close(self):
+        if self.view is not None:
+            self.view.release()
+            self.view = None
+        if self.map is not None:
+            self.map.close()
+            self.map = None
+        if self.file is not None:
+            self.file.close()
+            self.file = None
+
+
+class Table:
+    def __init__(self, path, columns, writable=False):
+        self.path = path
+        self.writable = writable
+        if writable:
+            os.makedirs(path, exist_ok=True)
+        rows = os.path.join(path, "rows")
+        if writable and not os.path.exists(rows):
+            with open(rows, "wb") as f:
+                f.write(bytes(8))
+        self.rows_file = open(rows, "r+b" if writable else "rb")
+        self.rows_map = mmap.mmap(self.rows_file.fileno(), 8,
+                                  access=mmap.ACCESS_WRITE if writable else mmap.ACCESS_READ)
+        self.rows_view = memoryview(self.rows_map).cast("Q")
+        self.columns = {name: Column(os.path.join(path, name), typecode, writable)
+                        for name, typecode in columns}
+        self.order = list(self.columns.values())
+        self.count = self.rows()  # the writer's
+        self.last_time = self.get("time", self.count - 1) if self.count else 0.0
+
+    def rows(self):
+        return self.rows_view[0]
+
+    def append(self, values):
+        # values in the order of the columns, time first
+        row = self.count
+        t = values[0] if values[0] > self.last_time else self.last_time
+        self.order[0].put(row, t)
+        for column, value in zip(self.order[1:], values[1:]):
+            column.put(row, value)
+        self.last_time = t
+        self.count = row + 1
+        self.rows_view[0] = self.count
+
+    def column(self, name):
+        # Every committed row of the column, remapped if it grew
+        column = self.columns[name]
+        rows = self.rows()
+        if rows > column.capacity:
+            column.remap()
+        return column.view[:rows] if column.view is not None else memoryview(array.array(column.typecode))
+
+    def get(self, name, row):
+        column = self.columns[name]
+        if row >= column.capacity:
+            column.remap()
+        return column.view[row]
+
+    def range(self, start=None, end=None):
+        # Rows with start <= time < end
+        times = self.column("time")
+        lo = 0 if start is None else bisect.bisect_left(times, start)
+        hi = len(times) if end is None else bisect.bisect_left(times, end)
+        return lo, hi
+
+    def scan(self, names, start=None, end=None):
+        # {name: array of its values}, for the rows of the range
+        lo, hi = self.range(start, end)
+        return {name: array.array(self.columns[name].typecode, self.column(name)[lo:hi]) for name in names}
+
+    def buckets(self, step, start=None, end=None):
+        # (bucket start, first row, end row) of each step seconds with rows
+        times = self.column("time")
+        lo, hi = self.range(start, end)
+        out = []
+        while lo < hi:
+            t = times[lo] - times[lo] % step
+            next_lo = bisect.bisect_left(times, t + step, lo, hi)
+            out.append((t, lo, next_lo))
+            lo = next_lo
+        return out
+
+    def close(self):
+        for column in self.columns.values():
+            column.close()
+        self.rows_view.release()
+        self.rows_map.close()
+        self.rows_file.close()
+
+
+class Store:
+    def __init__(self, path, writable=False):
+        self.path = path
+        self.writable = writable
+        self.tables = {}
+        if writable:
+            os.makedirs(path, exist_ok=True)
+
+    def directory(self, border):
+        # a border name is any string, a directory name cannot hold a "/"
+        return os.path.join(self.path, border.replace("/", "_"))
+
+    def table(self, border, name):
+        key = (border, name)
+        if key not in self.tables:
+            columns = PERIOD_COLUMNS if name == PERIODS else COORDINATOR_COLUMNS
+            directory = os.path.join(self.directory(border), name)
+            if not self.writable and not os.path.exists(os.path.join(directory, "rows")):
+                return None
+            self.tables[key] = Table(directory, columns, self.writable)
+        return self.tables[key]
+
+    def borders(self):
+        return sorted(os.listdir(self.path)) if os.path.isdir(self.path) else []
+
+    def coordinators(self, border):
+        directory = self.directory(border)
+        prefix = COORDINATOR.split("%")[0]
+        return sorted(int(name[len(prefix):]) for name in os.listdir(directory) if name.startswith(prefix))
+
+    def append(self, border, report, lost, now=None):
+        # One row for the period, one for each coordinator of its report
+        now = time.time() if now is None else now
+        self.table(border, PERIODS).append((
+            now, report.seq, report.clock, report.readings, report.total, report.min, report.max,
+            min(lost, 0xffff), len(report.coordinators), report.filled))
+        for c, (readings, total, error, energy) in report.coordinators.items():
+            self.table(border, COORDINATOR % c).append((
+                now, readings, total, error, energy.cpu, energy.lpm, energy.tx, energy.rx,
+                energy.current, energy.peak_node, energy.peak_current, sum(report.traces.get(c, ())),
+                report.coordinators_filled.get(c, 0)))
+
+    def rollup(self, border, step, start=None, end=None):
+        # Per bucket: start, periods, periods lost, readings, sum, min, max
+        table = self.table(border, PERIODS)
+        if table is None:
+            return []
+        readings, sums, lost = table.column("readings"), table.column("sum"), table.column("lost")
+        mins, maxs = table.column("min"), table.column("max")
+        out = []
+        for t, lo, hi in table.buckets(step, start, end):
+            full = [i for i in range(lo, hi) if readings[i]]
+            out.append((t, hi - lo, sum(lost[lo:hi]), sum(readings[lo:hi]), sum(sums[lo:hi]),
+                        min((mins[i] for i in full), default=0), max((maxs[i] for i in full), default=0)))
+        return out
+
+    def series(self, border, coordinator, field, step=None, start=None, end=None):
+        # (time, value) of a coordinator, or (bucket start, mean) every step s
+        table = self.table(border, COORDINATOR % coordinator)
+        if table is None:
+            return []
+        if step is None:
+            rows = table.scan(["time", field], start, end)
+            return list(zip(rows["time"], rows[field]))
+        values = table.column(field)
+        return [(t, sum(values[lo:hi]) / (hi - lo)) for t, lo, hi in table.buckets(step, start, end)]
+
+    def close(self):
+        for table in self.tables.values():
+            table.close()
+        self.tables.clear()
+
+
+def parse_time(text):
+    # unix time, ISO 8601, or ago: 90s, 15m, 2h, 7d
+    if text is None:
+        return None
+    units = {"s": 1, "m": 60, "h": 3600, "d": 86400}
+    if text[-1:] in units and text[:-1].replace(".", "", 1).isdigit():
+        return time.time() - float(text[:-1]) * units[text[-1]]
+    try:
+        return float(text)
+    except ValueError:
+        return datetime.datetime.fromisoformat(text).timestamp()
+
+
+def iso(t):
+    return datetime.datetime.fromtimestamp(t).isoformat(timespec="seconds")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Queries the store server.py --store writes")
+    parser.add_argument("store")
+    parser.add_argument("query", choices=["borders", "periods", "series"])
+    parser.add_argument("--border", help="all of them by default")
+    parser.add_argument("--coordinator", type=int, help="series: all of the border's by default")
+    parser.add_argument("--field", default="readings", choices=[c for c, _ in COORDINATOR_COLUMNS[1:]],
+                        help="series: column of the coordinators")
+    parser.add_argument("--since", help="unix time, ISO 8601 or ago (15m, 2h, 7d)")
+    parser.add_argument("--until")
+    parser.add_argument("--rollup", choices=sorted(ROLLUPS), help="one line per minute, hour or day")
+    args = parser.parse_args()
+
+    store = Store(args.store)
+    start, end = parse_time(args.since), parse_time(args.until)
+    step = ROLLUPS.get(args.rollup)
+    borders = [args.border] if args.border else store.borders()
+    out = sys.stdout
+    if args.query == "borders":
+        for border in borders:
+            periods = store.table(border, PERIODS)
+            if periods is None or not periods.rows():
+                continue
+            out.write("%s %d periods from %s to %s, coordinators %s\n" % (
+                border, periods.rows(), iso(periods.get("time", 0)),
+                iso(periods.get("time", periods.rows() - 1)),
+                " ".join(str(c) for c in store.coordinators(border))))
+    elif args.query == "periods":
+        out.write("border,time,%s\n" % ("periods,lost,readings,sum,min,max" if step else
+                                        ",".join(c for c, _ in PERIOD_COLUMNS[1:])))
+        for border in borders:
+            if step:
+                for t, n, lost, readings, total, low, high in store.rollup(border, step, start, end):
+                    out.write("%s,%s,%d,%d,%d,%d,%d,%d\n" % (border, iso(t), n, lost, readings, total, low, high))
+                continue
+            table = store.table(border, PERIODS)
+            if table is None:
+                continue
+            rows = table.scan([c for c, _ in PERIOD_COLUMNS], start, end)
+            for i in range(len(rows["time"])):
+                out.write("%s,%s,%s\n" % (border, iso(rows["time"][i]),
+                                          ",".join(str(rows[c][i]) for c, _ in PERIOD_COLUMNS[1:])))
+    else:
+        out.write("border,coordinator,time,%s\n" % args.field)
+        for border in borders:
+            coordinators = [args.coordinator] if args.coordinator is not None else store.coordinators(border)
+            for c in coordinators:
+                for t, value in store.series(border, c, args.field, step, start, end):
+                    out.write("%s,%d,%s,%s\n" % (border, c, iso(t),
+                                                 ("%.1f" % value) if step else value))
+    store.close()
+
+
+if __name__ == "__main__":
+    main()